@@ -0,0 +1,284 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "headers/archive.h"
+#include "headers/pack.h"
+
+/* bytes of a chunk before its data */
+#define CHUNK_HEADER_SIZE offsetof(struct archive_chunk_t, data)
+
+/* Writes all of a buffer at an offset, returns non-zero on success */
+static int write_at(int fd, const void *buffer, size_t size, off_t offset)
+{
+	const char *p = buffer;
+	ssize_t n;
+	while (size > 0) {
+		if ((n = pwrite(fd, p, size, offset)) <= 0)
+			return 0;
+		p += n;
+		size -= n;
+		offset += n;
+	}
+	return 1;
+}
+
+int archive_create(const char *path)
+{
+	struct archive_header_t header = { .version = ARCHIVE_VERSION,
+		.record_size = PACKED_SIZE };
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (fd < 0)
+		return -1;
+	memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+	if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int archive_chunk_add(struct archive_chunk_t *chunkPtr,
+		const struct packed_position_t *packedPtr)
+{
+	const unsigned char *now = (const unsigned char *)packedPtr;
+	const unsigned char *last = (const unsigned char *)&chunkPtr->last;
+	unsigned char *out = chunkPtr->data + chunkPtr->size;
+	unsigned char *p = out + 4;
+	uint32_t mask = 0;
+	/* the first position of a chunk is stored against an all zero one */
+	if (chunkPtr->records == 0)
+		memset(&chunkPtr->last, 0, sizeof(chunkPtr->last));
+	for (int i = 0; i < PACKED_SIZE; ++i) {
+		if (now[i] == last[i])
+			continue;
+		mask |= 1u << i;
+		*p++ = now[i];
+	}
+	memcpy(out, &mask, 4);
+	chunkPtr->size = p - chunkPtr->data;
+	chunkPtr->last = *packedPtr;
+	return ++chunkPtr->records == ARCHIVE_CHUNK_RECORDS;
+}
+
+int archive_chunk_write(int fd, struct archive_chunk_t *chunkPtr)
+{
+	const char *p = (const char *)chunkPtr;
+	size_t size = CHUNK_HEADER_SIZE + chunkPtr->size;
+	ssize_t n;
+	if (chunkPtr->records == 0)
+		return 1;
+	/* one write, so chunks of other threads don't land in the middle */
+	while (size > 0) {
+		if ((n = write(fd, p, size)) <= 0)
+			return 0;
+		p += n;
+		size -= n;
+	}
+	chunkPtr->records = 0;
+	chunkPtr->size = 0;
+	return 1;
+}
+
+long long archive_finish(const char *path)
+{
+	struct archive_header_t header;
+	struct archive_index_t *index = NULL;
+	struct stat st;
+	uint32_t chunk[2];
+	uint64_t offset = sizeof(header);
+	uint64_t records = 0;
+	uint64_t chunks = 0;
+	size_t size = 0;
+	int ok;
+	int fd = open(path, O_RDWR);
+	if (fd < 0)
+		return -1;
+	if ((pread(fd, &header, sizeof(header), 0) != sizeof(header))
+			|| memcmp(header.magic, ARCHIVE_MAGIC, sizeof(header.magic))
+			|| (header.version != ARCHIVE_VERSION)
+			|| (header.record_size != PACKED_SIZE) || fstat(fd, &st)) {
+		close(fd);
+		return -1;
+	}
+	if (header.index) {
+		close(fd);
+		return header.records;
+	}
+	/* chunks follow one another, each starting with records and size */
+	while (offset + CHUNK_HEADER_SIZE <= (uint64_t)st.st_size) {
+		if ((pread(fd, chunk, sizeof(chunk), offset) != sizeof(chunk))
+				|| (chunk[0] == 0)
+				|| (chunk[0] > ARCHIVE_CHUNK_RECORDS)
+				|| (offset + CHUNK_HEADER_SIZE + chunk[1]
+					> (uint64_t)st.st_size))
+			break;
+		if (chunks == size) {
+			size = size ? (2 * size) : 1024;
+			index = realloc(index, size
+					* sizeof(struct archive_index_t));
+			if (index == NULL) {
+				close(fd);
+				return -1;
+			}
+		}
+		index[chunks].offset = offset;
+		index[chunks++].first = records;
+		records += chunk[0];
+		offset += CHUNK_HEADER_SIZE + chunk[1];
+	}
+	/*
+	 * A chunk cut short by a crash is dropped along with anything after
+	 * it, the index is aligned for reading it in place
+	 */
+	header.records = records;
+	header.chunks = chunks;
+	header.index = (offset + 7) & ~7ull;
+	ok = !ftruncate(fd, offset) && write_at(fd, index, chunks
+				* sizeof(struct archive_index_t), header.index)
+		&& !fsync(fd)
+		&& write_at(fd, &header, sizeof(header), 0);
+	free(index);
+	close(fd);
+	return ok ? (long long)records : -1;
+}
+
+int archive_open(struct archive_t *archivePtr, const char *path)
+{
+	const struct archive_header_t *header;
+	const struct archive_index_t *entry;
+	struct stat st;
+	uint32_t chunk[2];
+	uint64_t end;
+	uint64_t next;
+	void *map;
+	int fd = open(path, O_RDONLY);
+	archivePtr->map = NULL;
+	if (fd < 0)
+		return 0;
+	if (fstat(fd, &st) || ((size_t)st.st_size < sizeof(*header))) {
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 0;
+	archivePtr->map = map;
+	archivePtr->size = st.st_size;
+	header = map;
+	archivePtr->header = header;
+	archivePtr->index = (const struct archive_index_t *)
+		(archivePtr->map + header->index);
+	archivePtr->cached = header->chunks;
+	archivePtr->ncache = 0;
+	if (memcmp(header->magic, ARCHIVE_MAGIC, sizeof(header->magic))
+			|| (header->version != ARCHIVE_VERSION)
+			|| (header->record_size != PACKED_SIZE)
+			|| (header->index < sizeof(*header))
+			|| (header->index % 8)
+			|| (header->index > archivePtr->size)
+			|| ((archivePtr->size - header->index) / sizeof(struct
+					archive_index_t) < header->chunks)) {
+		archive_close(archivePtr);
+		return 0;
+	}
+	/* readers of the archive need not check the chunks again */
+	for (uint64_t i = 0; i < header->chunks; ++i) {
+		entry = &archivePtr->index[i];
+		end = (i + 1 < header->chunks) ? entry[1].offset
+			: header->index;
+		next = (i + 1 < header->chunks) ? entry[1].first
+			: header->records;
+		if ((entry->offset < sizeof(*header))
+				|| (end < entry->offset + CHUNK_HEADER_SIZE)
+				|| (end > header->index)
+				|| (next < entry->first)) {
+			archive_close(archivePtr);
+			return 0;
+		}
+		memcpy(chunk, archivePtr->map + entry->offset, sizeof(chunk));
+		if ((chunk[0] != next - entry->first)
+				|| (chunk[0] > ARCHIVE_CHUNK_RECORDS)
+				|| (chunk[1] > end - entry->offset
+					- CHUNK_HEADER_SIZE)) {
+			archive_close(archivePtr);
+			return 0;
+		}
+	}
+	madvise(map, st.st_size, MADV_WILLNEED);
+	return 1;
+}
+
+void archive_close(struct archive_t *archivePtr)
+{
+	if (archivePtr->map != NULL)
+		munmap((void *)archivePtr->map, archivePtr->size);
+	archivePtr->map = NULL;
+}
+
+int archive_read_chunk(const struct archive_t *archivePtr, uint64_t chunk,
+		struct packed_position_t *packedPtr)
+{
+	const unsigned char *p = archivePtr->map
+		+ archivePtr->index[chunk].offset;
+	const unsigned char *end;
+	struct packed_position_t last = { 0 };
+	unsigned char *bytes = (unsigned char *)&last;
+	uint32_t records;
+	uint32_t size;
+	uint32_t mask;
+	int n = 0;
+	memcpy(&records, p, 4);
+	memcpy(&size, p + 4, 4);
+	p += CHUNK_HEADER_SIZE;
+	end = p + size;
+	/* archive_open() checked the sizes, only the masks can go wrong */
+	for (; (n < (int)records) && (p + 4 <= end); ++n) {
+		memcpy(&mask, p, 4);
+		p += 4;
+		if (p + __builtin_popcount(mask) > end)
+			break;
+		for (; mask; mask &= mask - 1)
+			bytes[__builtin_ctz(mask)] = *p++;
+		packedPtr[n] = last;
+	}
+	return n;
+}
+
+int archive_get(struct archive_t *archivePtr, uint64_t n,
+		struct packed_position_t *packedPtr)
+{
+	const struct archive_index_t *index = archivePtr->index;
+	uint64_t chunks = archivePtr->header->chunks;
+	uint64_t low = 0;
+	uint64_t high = chunks;
+	uint64_t mid;
+	if (n >= archivePtr->header->records)
+		return 0;
+	/* last chunk starting at or before n */
+	if ((archivePtr->cached < chunks)
+			&& (n >= index[archivePtr->cached].first)
+			&& (n < index[archivePtr->cached].first
+				+ archivePtr->ncache)) {
+		low = archivePtr->cached;
+	} else {
+		while (high - low > 1) {
+			mid = (low + high) / 2;
+			if (index[mid].first <= n)
+				low = mid;
+			else
+				high = mid;
+		}
+		archivePtr->ncache = archive_read_chunk(archivePtr, low,
+				archivePtr->cache);
+		archivePtr->cached = low;
+	}
+	if (n - index[low].first >= (uint64_t)archivePtr->ncache)
+		return 0;
+	*packedPtr = archivePtr->cache[n - index[low].first];
+	return 1;
+}
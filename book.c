@@ -0,0 +1,173 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "headers/chess.h"
+#include "headers/search.h"
+#include "headers/book.h"
+
+/*
+ * Polyglot books are sorted arrays of 16 byte big endian entries:
+ * 	key (8 bytes), move (2 bytes), weight (2 bytes), learn (4 bytes)
+ * Entries with the same key are stored next to each other, so a position is
+ * found with a binary search on the mapped file without reading the rest of
+ * the book
+ */
+#define BOOK_ENTRY_SIZE 16
+
+/* Polyglot move encoding */
+#define PG_END_SQUARE 0x003fu
+#define PG_START_SQUARE 0x0fc0u
+#define PG_PROMOTION 0x7000u
+
+static const uint8_t *book_base = NULL;
+static size_t book_size = 0;
+/* state of the generator picking weighted moves, seeded by book_open() */
+static uint64_t book_rng = 1;
+
+static uint64_t read_be(const uint8_t *p, int n)
+{
+	uint64_t x = 0;
+	for (int i = 0; i < n; ++i)
+		x = (x << 8) | p[i];
+	return x;
+}
+
+/* xorshift64* */
+static uint64_t random_next(void)
+{
+	book_rng ^= book_rng >> 12;
+	book_rng ^= book_rng << 25;
+	book_rng ^= book_rng >> 27;
+	return book_rng * 0x2545f4914f6cdd1dull;
+}
+
+void book_close(void)
+{
+	if (book_base != NULL)
+		munmap((void *)book_base, book_size);
+	book_base = NULL;
+	book_size = 0;
+}
+
+int book_open(const char *path)
+{
+	int fd;
+	struct stat st;
+	void *data;
+	book_close();
+	if (!path || !*path)
+		return 0;
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return 0;
+	if (fstat(fd, &st) || (st.st_size < BOOK_ENTRY_SIZE)) {
+		close(fd);
+		return 0;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return 0;
+	madvise(data, st.st_size, MADV_RANDOM);
+	book_base = data;
+	/* so separate games don't all follow the same line, never 0 */
+	book_rng = (((uint64_t)time(NULL) << 20) ^ getpid()) | 1;
+	/* a truncated last entry is ignored */
+	book_size = st.st_size - (st.st_size % BOOK_ENTRY_SIZE);
+	return book_size / BOOK_ENTRY_SIZE;
+}
+
+/*
+ * Converts a Polyglot move to a move from the movelist of a position,
+ * returns 0 if the move is not legal
+ * Polyglot encodes castling as the king capturing its own rook
+ */
+static uint16_t convert_move(struct position_t *posPtr, unsigned pgmv)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	unsigned start = (pgmv & PG_START_SQUARE) >> 6;
+	unsigned end = pgmv & PG_END_SQUARE;
+	int promotion = (pgmv & PG_PROMOTION) >> 12;
+	int legal;
+	uint16_t mv;
+	if ((start == posPtr->kingpos[color])
+			&& (posPtr->pieces[color][ROOK] & (1ull << end))) {
+		if (end > start)
+			end = start + 2;
+		else
+			end = start - 2;
+	}
+	movelist[0] = 0;
+	generate_moves(posPtr, movelist);
+	for (int i = 1; i <= movelist[0]; ++i) {
+		mv = movelist[i];
+		if (((mv & START_SQUARE) != start)
+				|| (((mv & END_SQUARE) >> 6) != end))
+			continue;
+		/* promotion pieces are 1-4 in Polyglot, 0-3 in move flags */
+		if (promotion && (!(mv & KNIGHT_PROMOTION)
+					|| (((mv >> 12) & 3) != (promotion - 1))))
+			continue;
+		if (!promotion && (mv & KNIGHT_PROMOTION))
+			continue;
+		make_move(posPtr, mv);
+		legal = was_legal(posPtr);
+		unmake_move(posPtr, mv);
+		return legal ? mv : 0;
+	}
+	return 0;
+}
+
+uint16_t book_probe(struct position_t *posPtr, int best)
+{
+	uint16_t moves[MAX_MOVES];
+	unsigned weights[MAX_MOVES];
+	unsigned total = 0;
+	size_t low = 0;
+	size_t high = book_size / BOOK_ENTRY_SIZE;
+	size_t mid;
+	uint64_t key;
+	const uint8_t *entry;
+	int n = 0;
+	int pick = 0;
+	unsigned r;
+	if (book_base == NULL)
+		return 0;
+	key = posPtr->hash;
+	/* find the first entry with this key */
+	while (low < high) {
+		mid = low + ((high - low) / 2);
+		if (read_be(book_base + (mid * BOOK_ENTRY_SIZE), 8) < key)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	for (entry = book_base + (low * BOOK_ENTRY_SIZE);
+			(entry < book_base + book_size) && (n < MAX_MOVES)
+			&& (read_be(entry, 8) == key);
+			entry += BOOK_ENTRY_SIZE) {
+		moves[n] = convert_move(posPtr, read_be(entry + 8, 2));
+		if (moves[n] == 0)
+			continue;
+		weights[n] = read_be(entry + 10, 2);
+		total += weights[n];
+		++n;
+	}
+	if (n == 0)
+		return 0;
+	if (best || (total == 0)) {
+		for (int i = 1; i < n; ++i)
+			if (weights[i] > weights[pick])
+				pick = i;
+		return moves[pick];
+	}
+	r = random_next() % total;
+	while (r >= weights[pick])
+		r -= weights[pick++];
+	return moves[pick];
+}
@@ -0,0 +1,403 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "headers/archive.h"
+#include "headers/chess.h"
+#include "headers/notation.h"
+#include "headers/pack.h"
+#include "headers/search.h"
+#include "headers/tt.h"
+
+/*
+ * Self-play training data generator
+ * usage: datagen [-t threads] [-g games] [-d depth] [-n nodes] [-r plies]
+ *                [-e openings] [-H hash] [-s seed] [-i seconds] [-b] output
+ * 	-t - number of games played at once, defaults to the number of cores
+ * 	-g - number of games, defaults to running until SIGINT or SIGTERM
+ * 	-d - deepest iteration of each search, defaults to DEFAULT_DEPTH, or
+ * 	     no limit if -n is given
+ * 	-n - node limit of each search, 0 for none
+ * 	-r - random moves played from the opening before the engine takes
+ * 	     over, defaults to 8
+ * 	-e - EPD file of opening positions to start from instead of the start
+ * 	     position, one is chosen at random per game
+ * 	-H - megabytes of the hash table of each thread, 0 for none, defaults
+ * 	     to TT_DEFAULT_MB
+ * 	-s - random seed, defaults to the time
+ * 	-i - seconds between throughput reports on stderr, defaults to 10
+ * 	-b - write output as an archive of packed positions (archive.h) with
+ * 	     the score and result of each, replacing the file
+ * Otherwise each record is one line appended to output:
+ * 	<fen> | <score> | <result>
+ * with the score of the search in centipawns and the result of the game (1,
+ * 0.5 or 0), both for white. Positions in check, positions whose best move is
+ * a capture or promotion, and mate or tablebase scores are not recorded
+ * Games are adjudicated like match.c: won once both sides agree on a score of
+ * RESIGN_SCORE for RESIGN_MOVES moves, drawn once both score a game within
+ * DRAW_SCORE for DRAW_MOVES moves after move DRAW_START
+ */
+
+#define MAX_GAME_PLIES 1024
+#define DEFAULT_DEPTH 8
+#define DEFAULT_RANDOM_PLIES 8
+#define RESIGN_SCORE 1000
+#define RESIGN_MOVES 4
+#define DRAW_SCORE 10
+#define DRAW_MOVES 8
+#define DRAW_START 40
+#define EPD_LINE_LENGTH 512
+/* records are written in one go once this much is buffered */
+#define BUFFER_SIZE (1 << 20)
+#define RECORD_LENGTH (FEN_LENGTH + 32)
+
+/*
+ * struct generator_t
+ * State of one thread, only the thread writes it
+ * 	rng: state of the random number generator
+ * 	games, positions: games finished and positions written, read by the
+ * 	                  main thread for reports
+ * 	buffer: records not written yet, length bytes of them
+ * 	chunk: records not written yet when writing an archive
+ * 	game: positions recorded in the game in progress with their scores,
+ * 	      nrecords of them
+ */
+struct generator_t {
+	pthread_t thread;
+	uint64_t rng;
+	unsigned long long games;
+	unsigned long long positions;
+	char *buffer;
+	size_t length;
+	struct archive_chunk_t *chunk;
+	struct packed_position_t game[MAX_GAME_PLIES];
+	int nrecords;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static int depth = 0;
+static unsigned long long nodes = 0;
+static int random_plies = DEFAULT_RANDOM_PLIES;
+static size_t hash_mb = TT_DEFAULT_MB;
+static unsigned long long maxgames = 0;
+static struct position_t *openings = NULL;
+static int nopenings = 0;
+static int output = -1;
+static int binary = 0;
+static unsigned long long nextgame = 0;
+static volatile sig_atomic_t quitting = 0;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	quitting = 1;
+}
+
+/* xorshift64* */
+static uint64_t random_next(struct generator_t *genPtr)
+{
+	genPtr->rng ^= genPtr->rng >> 12;
+	genPtr->rng ^= genPtr->rng << 25;
+	genPtr->rng ^= genPtr->rng >> 27;
+	return genPtr->rng * 0x2545f4914f6cdd1dull;
+}
+
+static void load_openings(const char *path)
+{
+	FILE *in;
+	char line[EPD_LINE_LENGTH];
+	int size = 0;
+	if ((in = fopen(path, "r")) == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	while (fgets(line, sizeof(line), in)) {
+		if (nopenings == size) {
+			size = size ? (2 * size) : 1024;
+			openings = realloc(openings,
+					size * sizeof(struct position_t));
+		}
+		if (parse_fen(&openings[nopenings], line))
+			++nopenings;
+	}
+	fclose(in);
+	if (nopenings == 0) {
+		fprintf(stderr, "No positions in %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* Writes the buffer of a thread, the file is appended to without a lock */
+static void flush_buffer(struct generator_t *genPtr)
+{
+	const char *p = genPtr->buffer;
+	ssize_t n;
+	if (binary && !archive_chunk_write(output, genPtr->chunk)) {
+		perror("write");
+		exit(EXIT_FAILURE);
+	}
+	while (genPtr->length > 0) {
+		if ((n = write(output, p, genPtr->length)) <= 0) {
+			perror("write");
+			exit(EXIT_FAILURE);
+		}
+		p += n;
+		genPtr->length -= n;
+	}
+}
+
+/* Moves the records of a finished game to the buffer of its thread */
+static void write_game(struct generator_t *genPtr, int result)
+{
+	static const char *results[3] = { "0", "0.5", "1" };
+	struct position_t pos;
+	char fen[FEN_LENGTH];
+	for (int i = 0; i < genPtr->nrecords; ++i) {
+		genPtr->game[i].result = result;
+		if (binary) {
+			if (archive_chunk_add(genPtr->chunk, &genPtr->game[i]))
+				flush_buffer(genPtr);
+			continue;
+		}
+		if (genPtr->length + RECORD_LENGTH > BUFFER_SIZE)
+			flush_buffer(genPtr);
+		unpack_position(&genPtr->game[i], &pos);
+		write_fen(&pos, fen);
+		genPtr->length += sprintf(genPtr->buffer + genPtr->length,
+				"%s | %d | %s\n", fen, genPtr->game[i].score,
+				results[result]);
+	}
+	__atomic_add_fetch(&genPtr->positions, genPtr->nrecords,
+			__ATOMIC_RELAXED);
+	__atomic_add_fetch(&genPtr->games, 1, __ATOMIC_RELAXED);
+	genPtr->nrecords = 0;
+}
+
+/* Plays random legal moves, returns 0 if the game ended on the way */
+static int random_opening(struct generator_t *genPtr,
+		struct position_t *posPtr)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	int n;
+	*posPtr = openings ? openings[random_next(genPtr) % nopenings]
+		: START_POSITION;
+	for (int ply = 0; ply < random_plies; ++ply) {
+		if ((n = legal_moves(posPtr, movelist)) == 0)
+			return 0;
+		make_move(posPtr, movelist[1 + (random_next(genPtr) % n)]);
+	}
+	update_game_status(posPtr);
+	return !(posPtr->flags & GAME_OVER);
+}
+
+/*
+ * Plays one game, recording its positions in genPtr->game, returns the
+ * result for white or -1 if the game was cut short by a signal
+ */
+static int play_game(struct generator_t *genPtr,
+		struct search_t *searchPtr, struct position_t pos)
+{
+	int color;
+	int resigning = 0;
+	int drawing = 0;
+	signed score;
+	uint16_t mv;
+	genPtr->nrecords = 0;
+	for (int ply = 0; ply < MAX_GAME_PLIES; ++ply) {
+		color = (pos.flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+		update_game_status(&pos);
+		if (pos.flags & GAME_DRAWN)
+			return PACKED_DRAW;
+		if (pos.flags & GAME_OVER)
+			return color ? PACKED_WIN : PACKED_LOSS;
+		if (quitting)
+			return -1;
+		searchPtr->maxnodes = nodes;
+		searchPtr->stop = 0;
+		mv = search_position(searchPtr, &pos, depth);
+		/* for white, so both sides have to agree on who is winning */
+		score = (color == WHITE) ? searchPtr->score : -searchPtr->score;
+		if (!in_check(&pos, color) && !(mv & (CAPTURE_MOVE
+						| KNIGHT_PROMOTION))
+				&& (abs(score) < TB_WIN_SCORE - MAX_PLY)) {
+			pack_position(&pos, &genPtr->game[genPtr->nrecords]);
+			genPtr->game[genPtr->nrecords++].score = score;
+		}
+		if (abs(score) >= RESIGN_SCORE) {
+			if ((score > 0) != (resigning > 0))
+				resigning = 0;
+			resigning += (score > 0) ? 1 : -1;
+			if (abs(resigning) >= 2 * RESIGN_MOVES)
+				return (resigning > 0) ? PACKED_WIN
+					: PACKED_LOSS;
+		} else {
+			resigning = 0;
+		}
+		if ((pos.moves >= 2 * DRAW_START) && (abs(score) <= DRAW_SCORE)) {
+			if (++drawing >= 2 * DRAW_MOVES)
+				return PACKED_DRAW;
+		} else {
+			drawing = 0;
+		}
+		make_move(&pos, mv);
+	}
+	return PACKED_DRAW;
+}
+
+static void *worker(void *arg)
+{
+	struct generator_t *genPtr = arg;
+	struct search_t search = { 0 };
+	struct tt_t tt = { 0 };
+	struct position_t pos;
+	int result;
+	if (hash_mb && tt_alloc(&tt, hash_mb, 1))
+		search.tt = &tt;
+	while (!quitting && (!maxgames || (__atomic_fetch_add(&nextgame, 1,
+						__ATOMIC_RELAXED) < maxgames))) {
+		while (!random_opening(genPtr, &pos))
+			;
+		/* games of different openings have nothing to share */
+		if (search.tt != NULL)
+			tt_clear(&tt, 1);
+		if ((result = play_game(genPtr, &search, pos)) >= 0)
+			write_game(genPtr, result);
+	}
+	flush_buffer(genPtr);
+	tt_free(&tt);
+	return NULL;
+}
+
+static void report(const struct generator_t *gens, int nthreads,
+		unsigned long long elapsed)
+{
+	unsigned long long games = 0;
+	unsigned long long positions = 0;
+	for (int i = 0; i < nthreads; ++i) {
+		games += __atomic_load_n(&gens[i].games, __ATOMIC_RELAXED);
+		positions += __atomic_load_n(&gens[i].positions,
+				__ATOMIC_RELAXED);
+	}
+	if (elapsed == 0)
+		elapsed = 1;
+	fprintf(stderr, "Games %llu, positions %llu: %llu positions/s, %llu "
+			"positions/s per thread\n", games, positions,
+			(positions * 1000) / elapsed,
+			(positions * 1000) / elapsed / nthreads);
+}
+
+int main(int argc, char **argv)
+{
+	struct generator_t *gens;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	uint64_t seed = time(NULL);
+	unsigned long long interval = 10000;
+	unsigned long long start;
+	unsigned long long last;
+	int running;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:g:d:n:r:e:H:s:i:b")) != -1) {
+		switch (opt) {
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'g':
+			maxgames = strtoull(optarg, NULL, 10);
+			break;
+		case 'd':
+			depth = atoi(optarg);
+			break;
+		case 'n':
+			nodes = strtoull(optarg, NULL, 10);
+			break;
+		case 'r':
+			random_plies = atoi(optarg);
+			break;
+		case 'e':
+			load_openings(optarg);
+			break;
+		case 'H':
+			hash_mb = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+		case 'i':
+			interval = strtoull(optarg, NULL, 10) * 1000;
+			break;
+		case 'b':
+			binary = 1;
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+	if (optind != argc - 1) {
+		fprintf(stderr, "usage: %s [-t threads] [-g games] [-d depth] "
+				"[-n nodes] [-r plies] [-e openings] "
+				"[-H hash] [-s seed] [-i seconds] [-b] "
+				"output\n",
+				argv[0]);
+		return EXIT_FAILURE;
+	}
+	if ((output = binary ? archive_create(argv[optind])
+				: open(argv[optind], O_WRONLY | O_CREAT
+					| O_APPEND, 0644)) < 0) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+	if ((depth <= 0) || (depth >= MAX_PLY))
+		depth = (nodes && (depth <= 0)) ? (MAX_PLY - 1) : DEFAULT_DEPTH;
+	if (posix_memalign((void **)&gens, CACHE_LINE_SIZE,
+				nthreads * sizeof(struct generator_t)))
+		return EXIT_FAILURE;
+	memset(gens, 0, nthreads * sizeof(struct generator_t));
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	start = get_time_ms();
+	for (int i = 0; i < nthreads; ++i) {
+		/* a zero state would stay zero */
+		gens[i].rng = (seed + i + 1) * 0x9e3779b97f4a7c15ull;
+		gens[i].buffer = malloc(BUFFER_SIZE);
+		gens[i].chunk = binary ? calloc(1,
+				sizeof(struct archive_chunk_t)) : NULL;
+		if ((gens[i].buffer == NULL) || (binary
+					&& (gens[i].chunk == NULL))) {
+			fprintf(stderr, "Not enough memory for %d threads\n",
+					nthreads);
+			return EXIT_FAILURE;
+		}
+		pthread_create(&gens[i].thread, NULL, worker, &gens[i]);
+	}
+	last = start;
+	do {
+		usleep(100000);
+		running = !maxgames || (__atomic_load_n(&nextgame,
+					__ATOMIC_RELAXED) < maxgames);
+		if (interval && running && (get_time_ms() - last >= interval)) {
+			last = get_time_ms();
+			report(gens, nthreads, last - start);
+		}
+	} while (running && !quitting);
+	for (int i = 0; i < nthreads; ++i) {
+		pthread_join(gens[i].thread, NULL);
+		free(gens[i].buffer);
+		free(gens[i].chunk);
+	}
+	report(gens, nthreads, get_time_ms() - start);
+	close(output);
+	if (binary && (archive_finish(argv[optind]) < 0)) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	free(gens);
+	free(openings);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "headers/chess.h"
+#include "headers/engine.h"
+#include "headers/notation.h"
+#include "headers/search.h"
+#include "headers/timeman.h"
+#include "headers/tt.h"
+
+/*
+ * struct engine_t
+ * 	search: search state, search.tt is the table searched with
+ * 	position: position searched from
+ * 	tt: table of the engine's own, empty when it has none or shares one
+ * 	callbacks: callbacks of the search in progress
+ * 	multipv: number of lines searched when the limits don't say
+ */
+struct engine_t {
+	struct search_t search;
+	struct position_t position;
+	struct tt_t tt;
+	struct engine_callbacks_t callbacks;
+	int multipv;
+};
+
+/* Passes the report of the search on to the callback of the engine */
+static void report(const struct search_t *searchPtr)
+{
+	const struct engine_t *enginePtr = searchPtr->data;
+	enginePtr->callbacks.report(searchPtr, enginePtr->callbacks.data);
+}
+
+struct engine_t *engine_create(const struct engine_options_t *optionsPtr)
+{
+	const struct engine_options_t defaults = { 0 };
+	struct engine_t *enginePtr;
+	size_t mb;
+	if (optionsPtr == NULL)
+		optionsPtr = &defaults;
+	/* search_t may be aligned to a cache line */
+	if (posix_memalign((void **)&enginePtr, CACHE_LINE_SIZE,
+				sizeof(struct engine_t)))
+		return NULL;
+	memset(enginePtr, 0, sizeof(struct engine_t));
+	enginePtr->position = START_POSITION;
+	enginePtr->multipv = optionsPtr->multipv;
+	enginePtr->search.disabled = optionsPtr->disabled;
+	enginePtr->search.data = enginePtr;
+	if (optionsPtr->shared_tt != NULL) {
+		enginePtr->search.tt = optionsPtr->shared_tt;
+	} else if (!optionsPtr->no_tt) {
+		mb = optionsPtr->hash_mb ? optionsPtr->hash_mb : TT_DEFAULT_MB;
+		if (!tt_alloc(&enginePtr->tt, mb, 1)) {
+			free(enginePtr);
+			return NULL;
+		}
+		enginePtr->search.tt = &enginePtr->tt;
+	}
+#ifdef SEARCH_STATS
+	stats_clear(&enginePtr->search.stats);
+#endif
+	return enginePtr;
+}
+
+void engine_destroy(struct engine_t *enginePtr)
+{
+	if (enginePtr == NULL)
+		return;
+	tt_free(&enginePtr->tt);
+	free(enginePtr);
+}
+
+int engine_set_position(struct engine_t *enginePtr, const char *fen,
+		const char *moves)
+{
+	struct position_t pos = START_POSITION;
+	char mv[MOVE_STRING_LENGTH];
+	uint16_t parsed;
+	int n;
+	if ((fen != NULL) && !parse_fen(&pos, fen))
+		return 0;
+	while ((moves != NULL) && (sscanf(moves, " %7s%n", mv, &n) == 1)) {
+		if (!(parsed = parse_coord(&pos, mv)))
+			return 0;
+		make_move(&pos, parsed);
+		moves += n;
+	}
+	enginePtr->position = pos;
+	return 1;
+}
+
+uint16_t engine_search(struct engine_t *enginePtr,
+		const struct engine_limits_t *limitsPtr,
+		const struct engine_callbacks_t *callbacksPtr)
+{
+	const struct engine_limits_t none = { 0 };
+	struct search_t *searchPtr = &enginePtr->search;
+	struct position_t pos = enginePtr->position;
+	int depth;
+	if (limitsPtr == NULL)
+		limitsPtr = &none;
+	depth = ((limitsPtr->depth > 0) && (limitsPtr->depth < MAX_PLY))
+		? limitsPtr->depth : (MAX_PLY - 1);
+	enginePtr->callbacks.report = NULL;
+	if (callbacksPtr != NULL)
+		enginePtr->callbacks = *callbacksPtr;
+	searchPtr->report = enginePtr->callbacks.report ? report : NULL;
+	searchPtr->maxnodes = limitsPtr->nodes;
+	searchPtr->multipv = limitsPtr->multipv ? limitsPtr->multipv
+		: enginePtr->multipv;
+	time_allocate(searchPtr, limitsPtr->time, limitsPtr->increment,
+			limitsPtr->movestogo, limitsPtr->overhead);
+	/* a fixed time per move is used in full */
+	if (limitsPtr->movetime) {
+		searchPtr->softlimit = 0;
+		searchPtr->deadline = get_time_ms() + limitsPtr->movetime;
+	}
+	searchPtr->stop = 0;
+	return search_position(searchPtr, &pos, depth);
+}
+
+void engine_stop(struct engine_t *enginePtr)
+{
+	enginePtr->search.stop = 1;
+}
+
+const struct search_t *engine_result(const struct engine_t *enginePtr)
+{
+	return &enginePtr->search;
+}
+
+const struct position_t *engine_position(const struct engine_t *enginePtr)
+{
+	return &enginePtr->position;
+}
+
+struct tt_t *engine_tt(struct engine_t *enginePtr)
+{
+	return enginePtr->search.tt;
+}
+
+void engine_new_game(struct engine_t *enginePtr)
+{
+	if (enginePtr->tt.buckets != NULL)
+		tt_clear(&enginePtr->tt, 1);
+}
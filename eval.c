@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include "headers/chess.h"
+#include "headers/search.h"
+
+const int16_t piece_values[7] = { 0, 100, 320, 330, 500, 900, 0 };
+
+/*
+ * Tables are from white's point of view, a1 first (same order as SQUARES)
+ * Black looks up the vertically mirrored square (sq ^ 56)
+ */
+const int16_t piece_square_tables[7][64] = {
+	{ 0 },
+	{
+		/* Pawn */
+		  0,   0,   0,   0,   0,   0,   0,   0,
+		  5,  10,  10, -20, -20,  10,  10,   5,
+		  5,  -5, -10,   0,   0, -10,  -5,   5,
+		  0,   0,   0,  20,  20,   0,   0,   0,
+		  5,   5,  10,  25,  25,  10,   5,   5,
+		 10,  10,  20,  30,  30,  20,  10,  10,
+		 50,  50,  50,  50,  50,  50,  50,  50,
+		  0,   0,   0,   0,   0,   0,   0,   0
+	},
+	{
+		/* Knight */
+		-50, -40, -30, -30, -30, -30, -40, -50,
+		-40, -20,   0,   5,   5,   0, -20, -40,
+		-30,   5,  10,  15,  15,  10,   5, -30,
+		-30,   0,  15,  20,  20,  15,   0, -30,
+		-30,   5,  15,  20,  20,  15,   5, -30,
+		-30,   0,  10,  15,  15,  10,   0, -30,
+		-40, -20,   0,   0,   0,   0, -20, -40,
+		-50, -40, -30, -30, -30, -30, -40, -50
+	},
+	{
+		/* Bishop */
+		-20, -10, -10, -10, -10, -10, -10, -20,
+		-10,   5,   0,   0,   0,   0,   5, -10,
+		-10,  10,  10,  10,  10,  10,  10, -10,
+		-10,   0,  10,  10,  10,  10,   0, -10,
+		-10,   5,   5,  10,  10,   5,   5, -10,
+		-10,   0,   5,  10,  10,   5,   0, -10,
+		-10,   0,   0,   0,   0,   0,   0, -10,
+		-20, -10, -10, -10, -10, -10, -10, -20
+	},
+	{
+		/* Rook */
+		  0,   0,   0,   5,   5,   0,   0,   0,
+		 -5,   0,   0,   0,   0,   0,   0,  -5,
+		 -5,   0,   0,   0,   0,   0,   0,  -5,
+		 -5,   0,   0,   0,   0,   0,   0,  -5,
+		 -5,   0,   0,   0,   0,   0,   0,  -5,
+		 -5,   0,   0,   0,   0,   0,   0,  -5,
+		  5,  10,  10,  10,  10,  10,  10,   5,
+		  0,   0,   0,   0,   0,   0,   0,   0
+	},
+	{
+		/* Queen */
+		-20, -10, -10,  -5,  -5, -10, -10, -20,
+		-10,   0,   5,   0,   0,   0,   0, -10,
+		-10,   5,   5,   5,   5,   5,   0, -10,
+		  0,   0,   5,   5,   5,   5,   0,  -5,
+		 -5,   0,   5,   5,   5,   5,   0,  -5,
+		-10,   0,   5,   5,   5,   5,   0, -10,
+		-10,   0,   0,   0,   0,   0,   0, -10,
+		-20, -10, -10,  -5,  -5, -10, -10, -20
+	},
+	{
+		/* King */
+		 20,  30,  10,   0,   0,  10,  30,  20,
+		 20,  20,   0,   0,   0,   0,  20,  20,
+		-10, -20, -20, -20, -20, -20, -20, -10,
+		-20, -30, -30, -40, -40, -30, -30, -20,
+		-30, -40, -40, -50, -50, -40, -40, -30,
+		-30, -40, -40, -50, -50, -40, -40, -30,
+		-30, -40, -40, -50, -50, -40, -40, -30,
+		-30, -40, -40, -50, -50, -40, -40, -30
+	}
+};
+
+signed evaluate(const struct position_t *posPtr)
+{
+	signed score = 0;
+	uint64_t bb;
+	int sq;
+	for (int i = PAWN; i <= KING; ++i) {
+		bb = posPtr->pieces[WHITE][i];
+		while (bb != 0) {
+			sq = ls1bindice(bb);
+			score += piece_values[i] + piece_square_tables[i][sq];
+			bb &= bb - 1;
+		}
+		bb = posPtr->pieces[BLACK][i];
+		while (bb != 0) {
+			sq = ls1bindice(bb);
+			score -= piece_values[i] + piece_square_tables[i][sq ^ 56];
+			bb &= bb - 1;
+		}
+	}
+	return (posPtr->flags & WHITE_TO_MOVE) ? score : -score;
+}
@@ -0,0 +1,162 @@
+/*
+ * * * archive.h
+ * Archives of packed positions
+ * An archive is a header, chunks of up to ARCHIVE_CHUNK_RECORDS positions
+ * each and an index of the chunks. Within a chunk each position is stored as
+ * the bytes that differ from the one before it, which for the positions of
+ * a game is a small part of PACKED_SIZE. Archives are read through mmap, a
+ * position is found through the index and its chunk decoded, so reading in
+ * order decodes each chunk once
+ * Numbers are stored in the byte order of the machine
+ */
+#ifndef INCLUDE_ARCHIVE_H
+#define INCLUDE_ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pack.h"
+
+#define ARCHIVE_MAGIC "CEARCHIV"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_CHUNK_RECORDS 4096
+/* a mask of the bytes that differ, then those bytes */
+#define ARCHIVE_MAX_RECORD (4 + PACKED_SIZE)
+
+/*
+ * struct archive_header_t
+ * 	magic: ARCHIVE_MAGIC
+ * 	version: ARCHIVE_VERSION
+ * 	record_size: PACKED_SIZE
+ * 	records: number of positions
+ * 	chunks: number of chunks
+ * 	index: offset of the index, 0 until archive_finish() writes it
+ */
+struct archive_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t records;
+	uint64_t chunks;
+	uint64_t index;
+};
+
+/*
+ * struct archive_index_t
+ * 	offset: offset of the chunk in the file
+ * 	first: number of the first position of the chunk
+ */
+struct archive_index_t {
+	uint64_t offset;
+	uint64_t first;
+};
+
+/*
+ * struct archive_chunk_t
+ * Chunk being written, records, size and data are written as they are
+ * 	records: number of positions in the chunk
+ * 	size: bytes of data used
+ * 	data: the positions, encoded
+ * 	last: the last position added
+ */
+struct archive_chunk_t {
+	uint32_t records;
+	uint32_t size;
+	unsigned char data[ARCHIVE_CHUNK_RECORDS * ARCHIVE_MAX_RECORD];
+	struct packed_position_t last;
+};
+
+/*
+ * struct archive_t
+ * Archive opened for reading
+ * 	map: the mapped file, size bytes of it
+ * 	header: header of the archive
+ * 	index: index of the archive
+ * 	cached: chunk decoded into cache, header->chunks if none
+ * 	ncache: number of positions in cache
+ */
+struct archive_t {
+	const unsigned char *map;
+	size_t size;
+	const struct archive_header_t *header;
+	const struct archive_index_t *index;
+	uint64_t cached;
+	int ncache;
+	struct packed_position_t cache[ARCHIVE_CHUNK_RECORDS];
+};
+
+/*
+ * int archive_create()
+ * Creates an empty archive, returns a file descriptor to write chunks to
+ * with archive_chunk_write() or -1 on failure
+ * The file is opened for appending, so several threads can write chunks to
+ * it at once, each chunk is written whole
+ * 	@path - file to create, an existing file is truncated
+ */
+int archive_create(const char *path);
+
+/*
+ * int archive_chunk_add()
+ * Adds a position to a chunk, returns non-zero if the chunk is full
+ * 	@chunkPtr - chunk to add to, zeroed before the first position
+ * 	@packedPtr - position to add
+ */
+int archive_chunk_add(struct archive_chunk_t *chunkPtr,
+		const struct packed_position_t *packedPtr);
+
+/*
+ * int archive_chunk_write()
+ * Appends a chunk to an archive and empties the chunk, returns non-zero on
+ * success, an empty chunk isn't written
+ * 	@fd - file descriptor returned by archive_create()
+ * 	@chunkPtr - chunk to write
+ */
+int archive_chunk_write(int fd, struct archive_chunk_t *chunkPtr);
+
+/*
+ * long long archive_finish()
+ * Writes the index of an archive once all chunks are written, returns the
+ * number of positions in it or -1 on failure
+ * 	@path - archive to finish, one already finished is left as it is
+ */
+long long archive_finish(const char *path);
+
+/*
+ * int archive_open()
+ * Maps an archive for reading, returns non-zero on success
+ * 	@archivePtr - set to the opened archive
+ * 	@path - archive to open, it has to be finished
+ */
+int archive_open(struct archive_t *archivePtr, const char *path);
+
+/*
+ * void archive_close()
+ * Unmaps an archive
+ * 	@archivePtr - archive to close
+ */
+void archive_close(struct archive_t *archivePtr);
+
+/*
+ * int archive_read_chunk()
+ * Decodes a whole chunk, returns the number of positions in it
+ * 	@archivePtr - archive to read
+ * 	@chunk - number of the chunk, less than archivePtr->header->chunks
+ * 	@packedPtr - set to the positions of the chunk, room for
+ * 	             ARCHIVE_CHUNK_RECORDS of them
+ */
+int archive_read_chunk(const struct archive_t *archivePtr, uint64_t chunk,
+		struct packed_position_t *packedPtr);
+
+/*
+ * int archive_get()
+ * Reads one position, returns 0 if there is no such position
+ * 	@archivePtr - archive to read, the chunk of the position is cached in
+ * 	              it
+ * 	@n - number of the position
+ * 	@packedPtr - set to the position
+ */
+int archive_get(struct archive_t *archivePtr, uint64_t n,
+		struct packed_position_t *packedPtr);
+
+
+
+#endif
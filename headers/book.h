@@ -0,0 +1,37 @@
+/*
+ * * * book.h
+ * Polyglot opening book probing
+ * Books are looked up by position_t.hash, which is the Polyglot key
+ */
+#ifndef INCLUDE_BOOK_H
+#define INCLUDE_BOOK_H
+
+#include <stdint.h>
+#include "chess.h"
+
+/*
+ * int book_open()
+ * Maps a Polyglot .bin book, returns the number of entries in the book
+ * Any previously opened book is closed first
+ * 	@path - file to open, NULL or "" closes the current book
+ */
+int book_open(const char *path);
+
+/*
+ * void book_close()
+ * Unmaps the current book
+ */
+void book_close(void);
+
+/*
+ * uint16_t book_probe()
+ * Returns a legal book move for a position, or 0 if the position is not in
+ * the book
+ * 	@posPtr - position to probe
+ * 	@best - non-zero picks the highest weighted move, otherwise moves are
+ * 	        picked at random in proportion to their weights
+ */
+uint16_t book_probe(struct position_t *posPtr, int best);
+
+
+#endif
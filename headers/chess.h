@@ -15,6 +15,13 @@
 #define FILL_MULTIPLIER 0x0101010101010101ull
 #define MAIN_DIAGONAL 0x8040201008040201ull
 #define MAIN_ANTIDIAGONAL 0x0102040810204080ull
+#define DARK_SQUARES 0xaa55aa55aa55aa55ull
+
+/*
+ * Marks a function written for either color that is copied into its callers,
+ * which pass the color as a constant so each copy is specialized for it
+ */
+#define COLOR_SPECIALIZED static inline __attribute__((always_inline))
 
 
 
@@ -99,7 +106,12 @@ enum FILES {
  * 	flags: Position flags, see #defines for more information
  * 	moves: Age of position, in halfmoves from start position
  * 	fiftymove: Number of halfmoves since an irreversible move took place
+ * 	hash: Polyglot key of the position, kept up to date by make_move()
+ * 	hash_history:
+ * 	fifty_history: hash and fiftymove of the earlier positions of the game,
+ * 	               index by moves % HISTORY_LENGTH
  */
+#define HISTORY_LENGTH 128
 struct position_t {
 	uint64_t pieces[2][7];
 	uint64_t occupied;
@@ -111,8 +123,18 @@ struct position_t {
 	uint16_t flags;
 	int moves;
 	int fiftymove;
+	uint64_t hash;
+	uint64_t hash_history[HISTORY_LENGTH];
+	unsigned short fifty_history[HISTORY_LENGTH];
 };
 
+/*
+ * castles[] value for rights that were already lost when a position was set
+ * up, it is never equal to the age of the position so unmake_move() will
+ * never restore them
+ */
+#define CASTLE_LOST_BEFORE 0xffffu
+
 /*
  * Position flags:
  * 012345	- En Passant square
@@ -143,6 +165,20 @@ struct position_t {
 
 extern const struct position_t START_POSITION;
 
+/*
+ * Random numbers from the Polyglot specification
+ * [0, 768): pieces, indice = (64 * kind) + square, kind is 2 * (piecetype - 1)
+ *           for black pieces and 2 * (piecetype - 1) + 1 for white pieces
+ * [768, 772): castle rights, white kingside, white queenside, black kingside,
+ *             black queenside
+ * [772, 780): e.p. file
+ * 780: white to move
+ */
+#define PG_CASTLE_OFFSET 768
+#define PG_EP_OFFSET 772
+#define PG_TURN_OFFSET 780
+extern const uint64_t polyglot_random[781];
+
 
 /*
  * Move encoding:
@@ -218,6 +254,32 @@ int popcount(uint64_t bb);
  */
 int ls1bindice(uint64_t bb);
 
+/*
+ * uint64_t polyglot_key()
+ * Returns the Polyglot hash key of a position, computed from scratch
+ * 	@posPtr - position to hash
+ */
+uint64_t polyglot_key(const struct position_t *posPtr);
+
+/*
+ * int is_repetition()
+ * Returns non-zero if a position is drawn by repetition: it occurred once
+ * before inside the search, or twice before it
+ * Only positions since the last irreversible move are looked at
+ * 	@posPtr - pointer to the position
+ * 	@ply - number of halfmoves since the root of the search
+ */
+int is_repetition(const struct position_t *posPtr, int ply);
+
+/*
+ * int insufficient_material()
+ * Returns non-zero if neither side has the material to checkmate: only
+ * kings and at most one minor piece, or only kings and bishops all on squares
+ * of one color
+ * 	@posPtr - pointer to the position
+ */
+int insufficient_material(const struct position_t *posPtr);
+
 /*
  * void push_ep()
  * Adds ep to position history
@@ -251,6 +313,8 @@ int pop_capture(struct position_t *posPtr);
 /*
  * void make_move()
  * Makes a move on a position
+ * NOTE: only the check flag of the side to move next is set, a move that
+ * left its own king in check is found with was_legal()
  * 	@posPtr - pointer to the position to make the move on
  * 	@mv - move to make
  * Assertions:
@@ -262,7 +326,6 @@ void make_move(struct position_t *posPtr, uint16_t mv);
 /*
  * void unmake_move()
  * Unmakes a move on a position
- * NOTE: fiftymove counter cannot be restored after it has been reset to 0
  * 	@posPtr - pointer to the position to unmake the move on
  * 	@mv - move to unmake
  * Assertions:
@@ -271,5 +334,21 @@ void make_move(struct position_t *posPtr, uint16_t mv);
  */
 void unmake_move(struct position_t *posPtr, uint16_t mv);
 
+/*
+ * void make_null_move()
+ * Passes the turn to the other side without moving
+ * 	@posPtr - pointer to the position to pass on
+ * Assertions:
+ * 	- the side to move is not in check
+ */
+void make_null_move(struct position_t *posPtr);
+
+/*
+ * void unmake_null_move()
+ * Takes back a null move
+ * 	@posPtr - pointer to the position to take the null move back on
+ */
+void unmake_null_move(struct position_t *posPtr);
+
 
 #endif
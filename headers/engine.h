@@ -0,0 +1,152 @@
+/*
+ * * * engine.h
+ * Engine library interface
+ * Each engine owns its position, search state and, unless it is given one to
+ * share, its hash table, so any number of engines can search at once in one
+ * process. Tablebases (tbprobe.h) are loaded once per process and shared by
+ * all engines
+ */
+#ifndef INCLUDE_ENGINE_H
+#define INCLUDE_ENGINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "chess.h"
+#include "search.h"
+#include "tt.h"
+
+/*
+ * struct engine_options_t
+ * Settings of a new engine, fields left 0 take the defaults
+ * 	hash_mb: size of the engine's own hash table, TT_DEFAULT_MB by default
+ * 	shared_tt: hash table to use instead of allocating one, it has to
+ * 	           outlive the engine
+ * 	no_tt: search without a hash table
+ * 	multipv: number of lines to search, 1 by default
+ * 	disabled: PRUNE_ techniques to leave out of the search
+ */
+struct engine_options_t {
+	size_t hash_mb;
+	struct tt_t *shared_tt;
+	int no_tt;
+	int multipv;
+	unsigned disabled;
+};
+
+/*
+ * struct engine_limits_t
+ * Limits of a search, fields left 0 don't limit it, with none set the search
+ * runs until engine_stop()
+ * 	depth: deepest iteration
+ * 	nodes: most nodes
+ * 	movetime: milliseconds to search for
+ * 	time: milliseconds on the clock of the side to move
+ * 	increment: milliseconds added to that clock per move
+ * 	movestogo: moves until the next time control
+ * 	overhead: milliseconds of the clock never used
+ * 	multipv: number of lines to search, 0 for the setting of the engine
+ */
+struct engine_limits_t {
+	int depth;
+	unsigned long long nodes;
+	unsigned long long movetime;
+	unsigned long long time;
+	unsigned long long increment;
+	int movestogo;
+	unsigned long long overhead;
+	int multipv;
+};
+
+/*
+ * struct engine_callbacks_t
+ * 	report: called after each completed iteration with the state of the
+ * 	        search (depth, lines, nodes, ...) and data, may be NULL
+ * 	data: passed to report untouched
+ */
+struct engine_callbacks_t {
+	void (*report)(const struct search_t *searchPtr, void *data);
+	void *data;
+};
+
+struct engine_t;
+
+/*
+ * struct engine_t *engine_create()
+ * Returns a new engine at the start position, NULL if there is not enough
+ * memory
+ * 	@optionsPtr - settings, NULL for the defaults
+ */
+struct engine_t *engine_create(const struct engine_options_t *optionsPtr);
+
+/*
+ * void engine_destroy()
+ * Frees an engine and its own hash table, a shared table is left alone
+ * 	@enginePtr - engine to free, NULL does nothing
+ */
+void engine_destroy(struct engine_t *enginePtr);
+
+/*
+ * int engine_set_position()
+ * Sets the position of an engine, returns non-zero on success and leaves the
+ * position unchanged if the FEN or a move is invalid
+ * 	@enginePtr - engine to set the position of
+ * 	@fen - FEN of the position, NULL for the start position
+ * 	@moves - moves in coordinate notation played from it, separated by
+ * 	         spaces, NULL for none
+ */
+int engine_set_position(struct engine_t *enginePtr, const char *fen,
+		const char *moves);
+
+/*
+ * uint16_t engine_search()
+ * Searches the position of an engine, returns the best move or 0 if there
+ * are no legal moves
+ * Returns once a limit is reached or another thread calls engine_stop()
+ * 	@enginePtr - engine to search with
+ * 	@limitsPtr - limits of the search, NULL for none
+ * 	@callbacksPtr - callbacks, NULL for none
+ */
+uint16_t engine_search(struct engine_t *enginePtr,
+		const struct engine_limits_t *limitsPtr,
+		const struct engine_callbacks_t *callbacksPtr);
+
+/*
+ * void engine_stop()
+ * Makes a search in progress return as soon as it can, safe to call from any
+ * thread
+ * 	@enginePtr - engine to stop
+ */
+void engine_stop(struct engine_t *enginePtr);
+
+/*
+ * const struct search_t *engine_result()
+ * Returns the state of the last search of an engine: score, depth, pv, lines
+ * 	@enginePtr - engine to look at
+ */
+const struct search_t *engine_result(const struct engine_t *enginePtr);
+
+/*
+ * const struct position_t *engine_position()
+ * Returns the position of an engine
+ * 	@enginePtr - engine to look at
+ */
+const struct position_t *engine_position(const struct engine_t *enginePtr);
+
+/*
+ * struct tt_t *engine_tt()
+ * Returns the hash table an engine searches with, to be passed as shared_tt
+ * to other engines, NULL if it has none
+ * 	@enginePtr - engine to look at
+ */
+struct tt_t *engine_tt(struct engine_t *enginePtr);
+
+/*
+ * void engine_new_game()
+ * Clears the hash table of an engine if the engine owns it
+ * 	@enginePtr - engine to clear
+ */
+void engine_new_game(struct engine_t *enginePtr);
+
+
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ * * * notation.h
+ * Conversion between positions or moves and their text forms: FEN, SAN and
+ * coordinate notation (e2e4, e7e8q)
+ */
+#ifndef INCLUDE_NOTATION_H
+#define INCLUDE_NOTATION_H
+
+#include <stdint.h>
+#include "chess.h"
+
+/* Buffer sizes, including the terminating null */
+#define FEN_LENGTH 92
+#define MOVE_STRING_LENGTH 8
+
+/*
+ * int parse_fen()
+ * Sets up a position from a FEN string, returns the number of characters
+ * read or 0 if the string is not a valid FEN
+ * The halfmove and fullmove fields are optional
+ * 	@posPtr - position to set up
+ * 	@fen - string to read
+ */
+int parse_fen(struct position_t *posPtr, const char *fen);
+
+/*
+ * void write_fen()
+ * Writes the FEN of a position
+ * 	@posPtr - position to write
+ * 	@str - buffer of at least FEN_LENGTH characters
+ */
+void write_fen(const struct position_t *posPtr, char *str);
+
+/*
+ * int legal_moves()
+ * Populates a movelist with the legal moves of a position, returns the
+ * number of moves
+ * 	@posPtr - position to generate moves for
+ * 	@lsPtr - pointer to the movelist to use
+ */
+int legal_moves(struct position_t *posPtr, uint16_t *lsPtr);
+
+/*
+ * void move_to_coord()
+ * Writes a move in coordinate notation
+ * 	@mv - move to write
+ * 	@str - buffer of at least MOVE_STRING_LENGTH characters
+ */
+void move_to_coord(uint16_t mv, char *str);
+
+/*
+ * uint16_t parse_coord()
+ * Returns the legal move matching a move in coordinate notation, or 0 if
+ * there is none
+ * 	@posPtr - position the move is played from
+ * 	@str - string to read
+ */
+uint16_t parse_coord(struct position_t *posPtr, const char *str);
+
+/*
+ * void move_to_san()
+ * Writes a legal move in standard algebraic notation
+ * 	@posPtr - position the move is played from
+ * 	@mv - move to write
+ * 	@str - buffer of at least MOVE_STRING_LENGTH characters
+ */
+void move_to_san(struct position_t *posPtr, uint16_t mv, char *str);
+
+/*
+ * uint16_t parse_san()
+ * Returns the legal move matching a move in standard algebraic notation, or
+ * 0 if there is no single matching move
+ * Check, mate and annotation suffixes are ignored, as are the long
+ * algebraic forms some programs write (e2e4, Ng1-f3)
+ * 	@posPtr - position the move is played from
+ * 	@str - string to read, ends at the first whitespace or null
+ */
+uint16_t parse_san(struct position_t *posPtr, const char *str);
+
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * * * pack.h
+ * Packed positions
+ * A position_t carries the bitboards, history and undo records the search
+ * needs, far too much to store positions in bulk. A packed position keeps
+ * only what a FEN does, in PACKED_SIZE bytes, with room for the score and
+ * result of a training record
+ */
+#ifndef INCLUDE_PACK_H
+#define INCLUDE_PACK_H
+
+#include <stdint.h>
+#include "chess.h"
+
+#define PACKED_SIZE 32
+
+/* Results of a game, for white */
+#define PACKED_LOSS 0
+#define PACKED_DRAW 1
+#define PACKED_WIN 2
+
+/*
+ * struct packed_position_t
+ * 	occupied: occupied squares
+ * 	pieces: a PIECES code in 4 bits for each occupied square from a1 to h8,
+ * 	        the first square in the low bits of pieces[0]
+ * 	state: side to move (bit 0, set for white), castle rights (1-4, the
+ * 	       position flags shifted down by 6), e.p. square (5-10) and e.p.
+ * 	       available (11)
+ * 	fiftymove: halfmoves since an irreversible move, at most 255
+ * 	result: PACKED_LOSS, PACKED_DRAW or PACKED_WIN, not set by
+ * 	        pack_position()
+ * 	moves: age of the position in halfmoves
+ * 	score: score of the position for white, not set by pack_position()
+ */
+struct packed_position_t {
+	uint64_t occupied;
+	uint8_t pieces[16];
+	uint16_t state;
+	uint8_t fiftymove;
+	uint8_t result;
+	uint16_t moves;
+	int16_t score;
+};
+
+/*
+ * void pack_position()
+ * Packs a position of at most 32 pieces, score and result are set to 0
+ * 	@posPtr - position to pack
+ * 	@packedPtr - set to the packed position
+ */
+void pack_position(const struct position_t *posPtr,
+		struct packed_position_t *packedPtr);
+
+/*
+ * int unpack_position()
+ * Sets up a position from a packed one as parse_fen() would from its FEN,
+ * returns 0 if it isn't a valid packed position
+ * 	@packedPtr - packed position
+ * 	@posPtr - set to the position
+ */
+int unpack_position(const struct packed_position_t *packedPtr,
+		struct position_t *posPtr);
+
+
+
+#endif
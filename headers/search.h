@@ -8,9 +8,128 @@
 #define INCLUDE_SEARCH_H
 
 #include <stdint.h>
+#include "stats.h"
+#include "tt.h"
 
-#define INFINITY -32768
-#define NEG_INFINITY 32767
+/*
+ * Mate scores are MATE_SCORE less the distance to mate in plies, tablebase
+ * wins are TB_WIN_SCORE less the distance to the tablebase position
+ */
+#define MAX_PLY 128
+#define MATE_SCORE 32000
+#define TB_WIN_SCORE (MATE_SCORE - (2 * MAX_PLY))
+
+/* Most root moves a multi-pv search finds lines for */
+#define MAX_MULTIPV 64
+
+/*
+ * Selective search techniques, set in search_t.disabled to turn them off
+ */
+#define PRUNE_NULL_MOVE 0x01u
+#define PRUNE_LMR 0x02u
+#define PRUNE_REVERSE_FUTILITY 0x04u
+#define PRUNE_FUTILITY 0x08u
+#define PRUNE_RAZORING 0x10u
+#define PRUNE_ALL 0x1fu
+
+/*
+ * struct pv_line_t
+ * One line of a multi-pv search
+ * 	move: root move of the line
+ * 	score: score of the line
+ * 	pv: principal variation starting with move, pvsize moves
+ */
+struct pv_line_t {
+	uint16_t move;
+	signed score;
+	int pvsize;
+	uint16_t pv[MAX_PLY];
+};
+
+/*
+ * struct search_t
+ * State of one search, threads searching at the same time each need their
+ * own
+ * 	nodes: number of positions searched
+ * 	maxnodes: search stops after this many nodes, 0 for no limit
+ * 	stop: set non-zero to abort the search, the result of the iteration in
+ * 	      progress is discarded
+ * 	deadline: search stops once get_time_ms() reaches this, 0 for no limit
+ * 	softlimit: no new iteration is started once get_time_ms() reaches this
+ * 	           (scaled by the stability of the best move, see timeman.h),
+ * 	           0 for no limit
+ * 	overshoot: milliseconds the search returned after the deadline
+ * 	starttime: get_time_ms() when the search started
+ * 	depth: depth of the last completed iteration
+ * 	bestmove: best move of the last completed iteration
+ * 	score: score of the last completed iteration
+ * 	report: called after each completed iteration if not NULL
+ * 	data: not used by the search, for report to find the state of its owner
+ * 	disabled: PRUNE_ techniques not used, 0 uses all of them
+ * 	tt: transposition table, NULL to search without one, searches may share
+ * 	    a table
+ * 	history: success of quiet moves, index by COLORS, start and end square,
+ * 	         cleared at the start of each search
+ * 	line: moves leading to the node being searched, 0 for a null move
+ * 	pvtable: triangular array of principal variations, row ply holds the
+ * 	         best line found so far from that ply in columns ply to
+ * 	         pvlength[ply] - 1
+ * 	pv: principal variation of the last completed iteration, pvsize moves
+ * 	multipv: number of best root moves to find lines for, the second line
+ * 	         is searched with the first move left out and so on, 0 or 1
+ * 	         only finds the best
+ * 	lines: lines of the last completed iteration, best first, nlines of them
+ * 	       (fewer than multipv when there aren't as many legal moves)
+ * 	excluded: root moves search_root() leaves out, count in [0]
+ * 	stats: counters, see stats.h
+ */
+struct search_t {
+	unsigned long long nodes;
+	unsigned long long maxnodes;
+	volatile int stop;
+	unsigned long long deadline;
+	unsigned long long softlimit;
+	unsigned long long overshoot;
+	unsigned long long starttime;
+	int depth;
+	uint16_t bestmove;
+	signed score;
+	void (*report)(const struct search_t *searchPtr);
+	void *data;
+	unsigned disabled;
+	struct tt_t *tt;
+	int history[2][64][64];
+	uint16_t line[MAX_PLY];
+	uint16_t pvtable[MAX_PLY][MAX_PLY];
+	int pvlength[MAX_PLY];
+	uint16_t pv[MAX_PLY];
+	int pvsize;
+	int multipv;
+	struct pv_line_t lines[MAX_MULTIPV];
+	int nlines;
+	uint16_t excluded[MAX_MULTIPV + 1];
+#ifdef SEARCH_STATS
+	struct search_stats_t stats;
+#endif
+};
+
+/*
+ * struct check_info_t
+ * Check information of a position for the side to move, see get_check_info()
+ * 	checkers: enemy pieces giving check
+ * 	pinned: friendly pieces that are the only piece between the friendly
+ * 	        king and an enemy slider
+ * 	discoverers: friendly pieces that are the only piece between the enemy
+ * 	             king and a friendly slider
+ * 	check_squares: squares a friendly piece would give check from, index by
+ * 	               PIECETYPES
+ */
+struct check_info_t {
+	uint64_t checkers;
+	uint64_t pinned;
+	uint64_t discoverers;
+	uint64_t check_squares[7];
+};
 
 extern const uint64_t file_masks[8];
 
@@ -35,6 +154,12 @@ extern const uint64_t pawn_movement[2][64];
 
 extern const uint64_t pawn_attacks[2][64];
 
+/* Index by PIECETYPES */
+extern const int16_t piece_values[7];
+
+/* Index by PIECETYPES and square, from white's point of view */
+extern const int16_t piece_square_tables[7][64];
+
 
 
 /*
@@ -81,12 +206,81 @@ uint64_t queen_moves(uint64_t occupied, int rank, int file);
  */
 uint16_t check_status(const struct position_t pos);
 
+/*
+ * uint64_t attackers_to()
+ * Returns the pieces of both colors attacking a square
+ * 	@posPtr - pointer to the position
+ * 	@sq - square to find the attackers of
+ * 	@occupied - occupancy to use, only pieces in it are counted and only they
+ * 	            block sliders
+ */
+uint64_t attackers_to(const struct position_t *posPtr, int sq,
+		uint64_t occupied);
+
+/*
+ * int is_square_attacked()
+ * Returns non-zero if any piece of a color attacks a square
+ * 	@posPtr - pointer to the position
+ * 	@sq - square to test
+ * 	@color - color of the attackers in COLORS
+ */
+int is_square_attacked(const struct position_t *posPtr, int sq, int color);
+
+/*
+ * int in_check()
+ * Returns non-zero if the king of a color is attacked
+ * 	@posPtr - pointer to the position to test
+ * 	@color - color of the king in COLORS
+ */
+int in_check(const struct position_t *posPtr, int color);
+
+/*
+ * int was_legal()
+ * Returns non-zero if the last move made on a position did not leave the
+ * side that made it in check
+ * Slower than testing the move with is_legal() before making it
+ * 	@posPtr - pointer to the position the move was made on
+ */
+int was_legal(const struct position_t *posPtr);
+
+/*
+ * void get_check_info()
+ * Fills in the check information of a position for the side to move
+ * 	@posPtr - pointer to the position
+ * 	@ciPtr - pointer to the record to fill in
+ */
+void get_check_info(const struct position_t *posPtr,
+		struct check_info_t *ciPtr);
+
+/*
+ * int is_legal()
+ * Returns non-zero if a move from generate_moves() does not leave the side
+ * to move in check, without making the move
+ * 	@posPtr - pointer to the position the move is from
+ * 	@ciPtr - check information of the position
+ * 	@mv - move to test
+ */
+int is_legal(const struct position_t *posPtr,
+		const struct check_info_t *ciPtr, uint16_t mv);
+
+/*
+ * int gives_check()
+ * Returns non-zero if a legal move puts the other side in check, without
+ * making the move
+ * 	@posPtr - pointer to the position the move is from
+ * 	@ciPtr - check information of the position
+ * 	@mv - move to test
+ */
+int gives_check(const struct position_t *posPtr,
+		const struct check_info_t *ciPtr, uint16_t mv);
+
 /*
  * uint64_t castle_moves()
- * Returns attack set of a king for castling only
- * 	@pos - Position to generate moves for
+ * Returns attack set of a king for castling only, the king is not in check
+ * and does not pass an attacked square, but may land on one
+ * 	@posPtr - pointer to the position to generate moves for
  */
-uint64_t castle_moves(struct position_t pos);
+uint64_t castle_moves(const struct position_t *posPtr);
 
 /*
  * void serialize_moves()
@@ -105,10 +299,18 @@ void serialize_moves(int start, uint64_t attk, const struct position_t pos,
  * void generate_moves()
  * Populates a movelist with possible, but not nessicarily legal, moves 
  * possible from a position
- * 	@pos - Position to generate moves for
+ * 	@posPtr - pointer to the position to generate moves for
  * 	@lsPtr - Pointer to the movelist to use
  */
-void generate_moves(const struct position_t pos, uint16_t *lsPtr);
+void generate_moves(const struct position_t *posPtr, uint16_t *lsPtr);
+
+/*
+ * int count_moves()
+ * Returns the number of legal moves of a position without generating them,
+ * from the sizes of the attack sets of its pieces
+ * 	@posPtr - pointer to the position to count moves for
+ */
+int count_moves(const struct position_t *posPtr);
 
 /*
  * unsigned long long perft()
@@ -121,19 +323,69 @@ unsigned long long perft(struct position_t *posPtr, int depth);
 /*
  * signed evaluate()
  * Returns the evaluation for a position, relative to the side to move
- * 	@pos - Position to evaluate
+ * 	@posPtr - pointer to the position to evaluate
+ */
+signed evaluate(const struct position_t *posPtr);
+
+/*
+ * unsigned long long get_time_ms()
+ * Returns a monotonic time in milliseconds
  */
-signed evaluate(struct position_t pos);
+unsigned long long get_time_ms(void);
 
 /*
  * signed negamax()
  * Recursive negamax search function, returns evaluation of best child
+ * Hands over to a quiescence search of captures once depth runs out
+ * 	@searchPtr - pointer to the state of the search
  * 	@posPtr - pointer to position to search from
  * 	@depth - depth to search
+ * 	@ply - distance from the root
  * 	@alpha - minimum score
  * 	@beta - maximum score
  */
-signed negamax(struct position_t *posPtr, int depth, signed alpha, signed beta);
+signed negamax(struct search_t *searchPtr, struct position_t *posPtr,
+		int depth, int ply, signed alpha, signed beta);
+
+/*
+ * uint16_t search_root()
+ * Searches every legal move of a position not in searchPtr->excluded within a
+ * window, returns the best move or 0 if there are no legal moves or none
+ * scored above alpha
+ * The moves of the lines of the last iteration are searched first
+ * 	@searchPtr - pointer to the state of the search
+ * 	@posPtr - pointer to position to search from
+ * 	@depth - depth to search
+ * 	@alpha - minimum score
+ * 	@beta - maximum score
+ * 	@scorePtr - set to the score of the best move, alpha if no move scored
+ * 	            above alpha and beta if a move scored beta or more
+ */
+uint16_t search_root(struct search_t *searchPtr, struct position_t *posPtr,
+		int depth, signed alpha, signed beta, signed *scorePtr);
+
+/*
+ * uint16_t search_position()
+ * Iterative deepening search, returns the best move of the deepest completed
+ * iteration or 0 if there are no legal moves
+ * Clears the node count of the search state before starting, but not the stop
+ * flag: a stop requested before the search starts is kept
+ * 	@searchPtr - pointer to the state of the search, bestmove, score, pv,
+ * 	             lines, depth and overshoot are set on return
+ * 	@posPtr - pointer to position to search from
+ * 	@maxdepth - deepest iteration to search
+ */
+uint16_t search_position(struct search_t *searchPtr,
+		struct position_t *posPtr, int maxdepth);
+
+/*
+ * void update_game_status()
+ * Sets GAME_OVER in the flags of a position that is checkmate, stalemate or
+ * drawn by the fifty move rule, threefold repetition or material, and
+ * GAME_DRAWN as well if it is not checkmate
+ * 	@posPtr - pointer to the position
+ */
+void update_game_status(struct position_t *posPtr);
 
 
 
@@ -0,0 +1,94 @@
+/*
+ * * * stats.h
+ * Search statistics
+ * Counters are only kept when compiled with SEARCH_STATS defined, otherwise
+ * the STATS_ macros expand to nothing and struct search_t has no counters
+ * Every file of a program must be compiled with the same setting
+ */
+#ifndef INCLUDE_STATS_H
+#define INCLUDE_STATS_H
+
+#include <stdio.h>
+
+#define CACHE_LINE_SIZE 64
+#define STATS_MAX_DEPTH 64
+
+/*
+ * struct search_stats_t
+ * Counters of one thread, aligned to a cache line so threads never write to
+ * the same line
+ * 	searches: number of searches started
+ * 	nodes: positions searched, including qnodes
+ * 	qnodes: positions searched by the quiescence search
+ * 	tt_probes / tt_hits / tt_cutoffs: transposition table lookups, lookups
+ * 	                                  that found the position, and lookups
+ * 	                                  that ended the search of the node
+ * 	beta_cutoffs: nodes that failed high
+ * 	first_move_cutoffs: nodes that failed high on the first move searched
+ * 	null_tries / null_cutoffs: null move searches, and those that failed
+ * 	                           high
+ * 	aspiration_fails: iterations searched again with a wider window
+ * 	draws: nodes scored as a draw by repetition, fifty moves or material
+ * 	iterations: number of completed iterations at each depth
+ * 	depth_nodes: nodes searched by the completed iterations at each depth
+ */
+struct search_stats_t {
+	unsigned long long searches;
+	unsigned long long nodes;
+	unsigned long long qnodes;
+	unsigned long long tt_probes;
+	unsigned long long tt_hits;
+	unsigned long long tt_cutoffs;
+	unsigned long long beta_cutoffs;
+	unsigned long long first_move_cutoffs;
+	unsigned long long null_tries;
+	unsigned long long null_cutoffs;
+	unsigned long long aspiration_fails;
+	unsigned long long draws;
+	unsigned long long iterations[STATS_MAX_DEPTH];
+	unsigned long long depth_nodes[STATS_MAX_DEPTH];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+#ifdef SEARCH_STATS
+#define STATS_INC(searchPtr, counter) (++(searchPtr)->stats.counter)
+#define STATS_ADD(searchPtr, counter, n) ((searchPtr)->stats.counter += (n))
+#else
+#define STATS_INC(searchPtr, counter) ((void)0)
+#define STATS_ADD(searchPtr, counter, n) ((void)sizeof(n))
+#endif
+
+/*
+ * void stats_clear()
+ * Zeroes all counters
+ * 	@statsPtr - counters to clear
+ */
+void stats_clear(struct search_stats_t *statsPtr);
+
+/*
+ * void stats_add()
+ * Adds one set of counters to another, used to total the counters of
+ * several threads
+ * 	@totalPtr - counters to add to
+ * 	@statsPtr - counters to add
+ */
+void stats_add(struct search_stats_t *totalPtr,
+		const struct search_stats_t *statsPtr);
+
+/*
+ * void stats_print_info()
+ * Writes the counters as UCI "info string" lines
+ * 	@out - stream to write to
+ * 	@statsPtr - counters to write
+ */
+void stats_print_info(FILE *out, const struct search_stats_t *statsPtr);
+
+/*
+ * void stats_print_json()
+ * Writes the counters as a single line JSON object
+ * 	@out - stream to write to
+ * 	@statsPtr - counters to write
+ */
+void stats_print_json(FILE *out, const struct search_stats_t *statsPtr);
+
+
+#endif
@@ -0,0 +1,77 @@
+/*
+ * * * tbprobe.h
+ * Syzygy endgame tablebase probing
+ */
+#ifndef INCLUDE_TBPROBE_H
+#define INCLUDE_TBPROBE_H
+
+#include <stdint.h>
+#include "chess.h"
+
+/* Largest number of pieces (kings included) in a supported table */
+#define TB_MAX_PIECES 7
+
+/*
+ * WDL results, relative to the side to move
+ * Cursed wins and blessed losses are decided by the fifty move rule
+ */
+enum TB_WDL {
+	TB_LOSS = -2,
+	TB_BLESSED_LOSS,
+	TB_DRAW,
+	TB_CURSED_WIN,
+	TB_WIN
+};
+
+/* Largest number of pieces of any table found by tb_init(), 0 if none */
+extern int tb_largest;
+
+/* Search probes WDL tables in positions with this many pieces or fewer */
+extern int tb_probe_limit;
+
+/*
+ * int tb_init()
+ * Maps every .rtbw and .rtbz file in a directory, returns the number of
+ * tables found
+ * Any previously mapped tables are released first
+ * 	@path - directory holding the table files, NULL or "" releases all
+ * 	        tables without loading new ones
+ */
+int tb_init(const char *path);
+
+/*
+ * void tb_free()
+ * Unmaps all tables
+ */
+void tb_free(void);
+
+/*
+ * int tb_probe_wdl()
+ * Returns the WDL value of a position in TB_WDL
+ * 	@posPtr - position to probe, must have no castle rights
+ * 	@success - set to 0 if the probe failed, non-zero otherwise
+ */
+int tb_probe_wdl(struct position_t *posPtr, int *success);
+
+/*
+ * int tb_probe_dtz()
+ * Returns the distance to zero (capture or pawn move) of a position in plies,
+ * positive if the side to move wins and negative if it loses, 0 for a draw
+ * 	@posPtr - position to probe, must have no castle rights
+ * 	@success - set to 0 if the probe failed, non-zero otherwise
+ */
+int tb_probe_dtz(struct position_t *posPtr, int *success);
+
+/*
+ * int tb_root_filter()
+ * Removes every move from a movelist that doesn't preserve the best DTZ
+ * outcome of the position, returns 0 if the tables could not be probed
+ * 	@posPtr - root position
+ * 	@lsPtr - movelist of the root position, illegal moves are removed
+ * 	@scorePtr - set to the score of the remaining moves
+ */
+int tb_root_filter(struct position_t *posPtr, uint16_t *lsPtr,
+		signed *scorePtr);
+
+
+#endif
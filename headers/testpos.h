@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "chess.h"
+#include "tbprobe.h"
 
 /*
  * Start position perft values:
@@ -75,4 +76,134 @@ static const struct position_t perft1 = {
 	.fiftymove = 0
 };
 
+/*
+ * Positions searched by the bench command, the node count of a fixed depth
+ * bench changes only when the search does
+ */
+#define BENCH_POSITIONS 8
+static const char *const bench_positions[BENCH_POSITIONS] = {
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+	"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+	"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+	"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+	"r1bq1rk1/pp2bppp/2n1pn2/3p4/2PP4/2N1PN2/PP3PPP/R2QKB1R w KQ - 0 8",
+	"8/8/4k3/3p4/3P4/4K3/8/8 w - - 0 1"
+};
+
+/*
+ * Perft regression suite, node counts by depth with 0 past the last known one
+ * The CPW positions are followed by positions that each test one rule that
+ * move generators tend to get wrong
+ */
+#define PERFT_SUITE_DEPTH 7
+struct perft_test_t {
+	const char *name;
+	const char *fen;
+	unsigned long long nodes[PERFT_SUITE_DEPTH + 1];
+};
+
+static const struct perft_test_t perft_suite[] = {
+	{ "start position",
+		"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+		{ 1, 20, 400, 8902, 197281, 4865609, 119060324 } },
+	{ "kiwipete",
+		"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+		{ 1, 48, 2039, 97862, 4085603, 193690690 } },
+	{ "cpw position 3",
+		"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+		{ 1, 14, 191, 2812, 43238, 674624, 11030083, 178633661 } },
+	{ "cpw position 4",
+		"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+		{ 1, 6, 264, 9467, 422333, 15833292 } },
+	{ "cpw position 4 mirrored",
+		"r2q1rk1/pP1p2pp/Q4n2/bbp1p3/Np6/1B3NBn/pPPP1PPP/R3K2R b KQ - 0 1",
+		{ 1, 6, 264, 9467, 422333, 15833292 } },
+	{ "cpw position 5",
+		"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+		{ 1, 44, 1486, 62379, 2103487, 89941194 } },
+	{ "cpw position 6",
+		"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+		{ 1, 46, 2079, 89890, 3894594, 164075551 } },
+	{ "e.p. capture exposes king",
+		"3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1",
+		{ 1, 18, 92, 1670, 10138, 185429, 1134888 } },
+	{ "e.p. capture on a pinned diagonal",
+		"8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1",
+		{ 1, 13, 102, 1266, 10276, 135655, 1015133 } },
+	{ "e.p. capture gives check",
+		"8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",
+		{ 1, 15, 126, 1928, 13931, 206379, 1440467 } },
+	{ "short castling gives check",
+		"5k2/8/8/8/8/8/8/4K2R w K - 0 1",
+		{ 1, 15, 66, 1198, 6399, 120330, 661072 } },
+	{ "long castling gives check",
+		"3k4/8/8/8/8/8/8/R3K3 w Q - 0 1",
+		{ 1, 16, 71, 1286, 7418, 141077, 803711 } },
+	{ "castling rights lost",
+		"r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1",
+		{ 1, 26, 1141, 27826, 1274206 } },
+	{ "castling through check",
+		"r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1",
+		{ 1, 44, 1494, 50509, 1720476 } },
+	{ "promotion out of check",
+		"2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1",
+		{ 1, 11, 133, 1442, 19174, 266199, 3821001 } },
+	{ "discovered check",
+		"8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1",
+		{ 1, 29, 165, 5160, 31961, 1004658 } },
+	{ "promotion gives check",
+		"4k3/1P6/8/8/8/8/K7/8 w - - 0 1",
+		{ 1, 9, 40, 472, 2661, 38983, 217342 } },
+	{ "underpromotion gives check",
+		"8/P1k5/K7/8/8/8/8/8 w - - 0 1",
+		{ 1, 6, 27, 273, 1329, 18135, 92683 } },
+	{ "self stalemate",
+		"K1k5/8/P7/8/8/8/8/8 w - - 0 1",
+		{ 1, 2, 6, 13, 63, 382, 2217 } },
+	{ "stalemate and checkmate, pawn",
+		"8/k1P5/8/1K6/8/8/8/8 w - - 0 1",
+		{ 1, 10, 25, 268, 926, 10857, 43261, 567584 } },
+	{ "stalemate and checkmate, pieces",
+		"8/8/2k5/5q2/5n2/8/5K2/8 b - - 0 1",
+		{ 1, 37, 183, 6559, 23527 } }
+};
+#define PERFT_SUITE_SIZE (sizeof(perft_suite) / sizeof(perft_suite[0]))
+
+/*
+ * Tablebase positions with known results
+ * DTZ tables may round a win or loss one ply up, so a dtz of n also accepts
+ * n + 1 away from 0, TB_ANY_DTZ only checks the sign of a win or loss
+ */
+#define TB_ANY_DTZ 1000
+struct tb_test_t {
+	const char *name;
+	const char *fen;
+	int wdl;
+	int dtz;
+};
+
+static const struct tb_test_t tb_suite[] = {
+	{ "KQvK, mate in 1",
+		"7k/8/6K1/8/8/8/8/1Q6 w - - 0 1", TB_WIN, 1 },
+	{ "KQvK, mated next move",
+		"7k/8/6K1/8/8/8/8/1Q6 b - - 0 1", TB_LOSS, -2 },
+	{ "KQvK, queen hangs",
+		"8/8/8/8/8/8/1k6/Q6K b - - 0 1", TB_DRAW, 0 },
+	{ "KNvK",
+		"8/8/8/4k3/8/8/8/KN6 w - - 0 1", TB_DRAW, 0 },
+	{ "KPvK, pawn runs",
+		"8/8/8/8/8/8/4P3/4K2k w - - 0 1", TB_WIN, 1 },
+	{ "KPvK, pawn runs next move",
+		"8/8/8/8/8/8/4P3/4K2k b - - 0 1", TB_LOSS, -2 },
+	{ "KPvK, rook pawn",
+		"k7/8/8/8/8/8/P7/K7 w - - 0 1", TB_DRAW, 0 },
+	{ "KBvKB",
+		"8/8/8/8/8/8/8/KB3bk1 w - - 0 1", TB_DRAW, 0 },
+	{ "KBNvK",
+		"8/8/8/8/8/8/8/KBN4k w - - 0 1", TB_WIN, TB_ANY_DTZ }
+};
+#define TB_SUITE_SIZE (sizeof(tb_suite) / sizeof(tb_suite[0]))
+
 #endif
@@ -0,0 +1,44 @@
+/*
+ * * * timeman.h
+ * Time management
+ * A search gets two limits: the soft limit, after which no new iteration is
+ * started, and the hard limit (search_t.deadline), which stops the search
+ * wherever it is
+ */
+#ifndef INCLUDE_TIMEMAN_H
+#define INCLUDE_TIMEMAN_H
+
+#include "search.h"
+
+/* milliseconds kept back for the time lost between the GUI and the engine */
+#define MOVE_OVERHEAD 30
+/* moves the remaining time is split over when there is no movestogo */
+#define TIME_MOVES 30
+/* the hard limit is at most this many times the soft limit */
+#define HARD_RATIO 4
+
+/*
+ * void time_allocate()
+ * Sets the soft and hard limits of a search from the clock, starting now
+ * 	@searchPtr - search to set the limits of
+ * 	@time - milliseconds left on the clock, 0 clears both limits
+ * 	@increment - milliseconds added to the clock after each move
+ * 	@movestogo - moves until the next time control, 0 if there is none
+ * 	@overhead - milliseconds of the clock never used
+ */
+void time_allocate(struct search_t *searchPtr, unsigned long long time,
+		unsigned long long increment, int movestogo,
+		unsigned long long overhead);
+
+/*
+ * int time_soft_expired()
+ * Returns non-zero if the search should not start another iteration
+ * The soft limit is stretched while the best move keeps changing and cut
+ * short once it has been the same for several iterations
+ * 	@searchPtr - search to check
+ * 	@stable - number of iterations in a row the best move has not changed
+ */
+int time_soft_expired(const struct search_t *searchPtr, int stable);
+
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * * * tt.h
+ * Transposition table
+ * The table is a power of two number of buckets, each one cache line of
+ * TT_BUCKET_SIZE entries. It is mapped with 2 MB huge pages when the system
+ * has any to give, and its pages are first touched by several threads at once
+ * so that on a NUMA machine they are spread over the nodes of those threads
+ * A table can instead be mapped from a file, so that it outlives the program
+ * and a long analysis can carry on where it stopped
+ */
+#ifndef INCLUDE_TT_H
+#define INCLUDE_TT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "stats.h"
+
+#define TT_DEFAULT_MB 16
+#define TT_MAX_MB 65536
+#define TT_BUCKET_SIZE 4
+#define HUGE_PAGE_SIZE (2ul << 20)
+
+/* Table files start with a header, the buckets follow at TT_FILE_OFFSET */
+#define TT_FILE_MAGIC "CETTABLE"
+#define TT_FILE_VERSION 1
+#define TT_FILE_OFFSET 4096
+
+/* Results of tt_map_file() */
+#define TT_FILE_FAILED 0
+#define TT_FILE_NEW 1
+#define TT_FILE_LOADED 2
+
+/*
+ * Bounds of a stored score:
+ * TT_UPPER - the score is at most this, no move beat alpha
+ * TT_LOWER - the score is at least this, a move failed high
+ * TT_EXACT - the score is exact
+ */
+#define TT_UPPER 1
+#define TT_LOWER 2
+#define TT_EXACT 3
+
+/*
+ * struct tt_entry_t
+ * 	check: key of the position xor data, an entry torn by two threads
+ * 	       writing it at once matches neither key
+ * 	data: move (bits 0-15), score (16-31), depth (32-39), bound (40-41) and
+ * 	      age (42-47)
+ */
+struct tt_entry_t {
+	uint64_t check;
+	uint64_t data;
+};
+
+struct tt_bucket_t {
+	struct tt_entry_t entries[TT_BUCKET_SIZE];
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/*
+ * struct tt_hit_t
+ * Contents of an entry found by tt_probe()
+ * 	move: best move found, 0 if none
+ * 	score: score relative to the side to move, mate scores count from the
+ * 	       position
+ * 	depth: depth the score was searched to
+ * 	bound: TT_UPPER, TT_LOWER or TT_EXACT
+ */
+struct tt_hit_t {
+	uint16_t move;
+	signed score;
+	int depth;
+	int bound;
+};
+
+/*
+ * struct tt_file_header_t
+ * 	magic: TT_FILE_MAGIC, written last so a half written file isn't loaded
+ * 	version: TT_FILE_VERSION
+ * 	entries: TT_BUCKET_SIZE
+ * 	size: size of the table in bytes
+ * 	scheme: checksum of the hash keys and entry layout, a table hashed
+ * 	        differently can't be used
+ * 	age: generation of the last search saved
+ */
+struct tt_file_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t entries;
+	uint64_t size;
+	uint64_t scheme;
+	uint32_t age;
+};
+
+/*
+ * struct tt_t
+ * 	buckets: the table, NULL if none is allocated
+ * 	mask: number of buckets less one
+ * 	size: size of the table in bytes
+ * 	hugetlb: non-zero if the table was mapped from the reserved huge pages,
+ * 	         otherwise transparent huge pages were asked for
+ * 	header: header of the file the table is mapped from, NULL if the table
+ * 	        is only in memory
+ * 	age: generation of the current search, entries of older searches are
+ * 	     replaced first
+ */
+struct tt_t {
+	struct tt_bucket_t *buckets;
+	uint64_t mask;
+	size_t size;
+	int hugetlb;
+	struct tt_file_header_t *header;
+	unsigned age;
+};
+
+/*
+ * int tt_alloc()
+ * Replaces the table with a cleared one of at most mb megabytes, returns
+ * non-zero on success and leaves the table empty on failure
+ * 	@ttPtr - table to allocate
+ * 	@mb - size in megabytes, rounded down to a power of two
+ * 	@threads - number of threads clearing the new table
+ */
+int tt_alloc(struct tt_t *ttPtr, size_t mb, int threads);
+
+/*
+ * int tt_map_file()
+ * Replaces the table with one mapped from a file, which is loaded if it holds
+ * a table of the same size and hash scheme and otherwise created cleared
+ * Returns TT_FILE_LOADED, TT_FILE_NEW, or TT_FILE_FAILED leaving the table
+ * empty
+ * 	@ttPtr - table to map
+ * 	@path - file to map, a file that is neither empty nor a table file is
+ * 	        left as it is and fails
+ * 	@mb - size in megabytes, rounded down to a power of two
+ * 	@threads - number of threads clearing a new table
+ */
+int tt_map_file(struct tt_t *ttPtr, const char *path, size_t mb,
+		int threads);
+
+/*
+ * void tt_sync()
+ * Writes a table mapped from a file back to it, does nothing to other tables
+ * 	@ttPtr - table to write
+ */
+void tt_sync(struct tt_t *ttPtr);
+
+/*
+ * void tt_free()
+ * Frees a table, writing it back first if it is mapped from a file
+ * Freeing an empty table does nothing
+ * 	@ttPtr - table to free
+ */
+void tt_free(struct tt_t *ttPtr);
+
+/*
+ * void tt_clear()
+ * Empties a table, each thread writes one slice of huge pages so that the
+ * operating system places them on the node of that thread on the first write
+ * 	@ttPtr - table to clear, one without buckets is left as it is
+ * 	@threads - number of threads clearing the table
+ */
+void tt_clear(struct tt_t *ttPtr, int threads);
+
+/*
+ * size_t tt_huge_bytes()
+ * Returns how many bytes of a table are backed by huge pages
+ * 	@ttPtr - table to look at
+ */
+size_t tt_huge_bytes(const struct tt_t *ttPtr);
+
+/*
+ * void tt_new_search()
+ * Starts a new generation, entries stored before it are replaced first
+ * 	@ttPtr - table the search uses
+ */
+void tt_new_search(struct tt_t *ttPtr);
+
+/*
+ * int tt_probe()
+ * Looks up a position, returns non-zero if it was found
+ * 	@ttPtr - table to look in
+ * 	@key - hash key of the position
+ * 	@hitPtr - set to the contents of the entry if it was found
+ */
+int tt_probe(const struct tt_t *ttPtr, uint64_t key, struct tt_hit_t *hitPtr);
+
+/*
+ * void tt_store()
+ * Stores the result of a search, replacing the entry of the same position or
+ * else the one of the oldest or shallowest search in its bucket
+ * 	@ttPtr - table to store in
+ * 	@key - hash key of the position
+ * 	@move - best move, 0 keeps the move already stored for the position
+ * 	@score - score relative to the side to move
+ * 	@depth - depth searched
+ * 	@bound - TT_UPPER, TT_LOWER or TT_EXACT
+ */
+void tt_store(struct tt_t *ttPtr, uint64_t key, uint16_t move, signed score,
+		int depth, int bound);
+
+
+
+#endif
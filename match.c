@@ -0,0 +1,449 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "headers/chess.h"
+#include "headers/search.h"
+#include "headers/notation.h"
+#include "headers/book.h"
+#include "headers/timeman.h"
+#include "headers/tt.h"
+
+/*
+ * Self-play match runner
+ * usage: match [-t threads] [-g games] [-o openings] [-a player] [-b player]
+ *              [-e elo0,elo1] [-p alpha,beta] [-r score] [-d score] [-H hash]
+ *              [-n plies] [-s seed]
+ * 	-t - number of games played at once, defaults to the number of cores
+ * 	-g - maximum number of games, defaults to 20000
+ * 	-o - EPD file of opening positions, defaults to the start position
+ * 	-n - random moves played from the opening before the players take over,
+ * 	     defaults to 0 with -o and DEFAULT_RANDOM_PLIES without
+ * 	-s - seed of the random moves, defaults to the time
+ * 	-a, -b - settings of the two players, a comma separated list of
+ * 	         depth=plies, nodes=count, tc=seconds+increment and off=name,
+ * 	         which turns off one selective search technique of the player:
+ * 	         NullMove, LateMoveReductions, ReverseFutility, Futility or
+ * 	         Razoring
+ * 	-e - SPRT hypotheses in Elo, defaults to 0,5
+ * 	-p - SPRT type I and type II error rates, defaults to 0.05,0.05
+ * 	-r - resign once both sides agree on a score this many centipawns for
+ * 	     RESIGN_MOVES moves, 0 disables, defaults to 1000
+ * 	-d - adjudicate a draw once both sides score a game within this many
+ * 	     centipawns for DRAW_MOVES moves after move DRAW_START, 0 disables,
+ * 	     defaults to 10
+ * 	-H - megabytes of the hash table of each player in each game, cleared
+ * 	     between games, 0 for none, defaults to TT_DEFAULT_MB
+ * Each opening is played twice with colors reversed, both games after the
+ * same random moves. Results are from player a's point of view, the match
+ * stops early once the SPRT accepts either hypothesis
+ */
+
+#define MAX_GAME_PLIES 1024
+#define RESIGN_MOVES 4
+#define DRAW_MOVES 8
+#define DRAW_START 40
+#define DEFAULT_DEPTH 6
+#define DEFAULT_RANDOM_PLIES 8
+#define EPD_LINE_LENGTH 512
+/* searches returning this many milliseconds after their deadline are logged */
+#define OVERSHOOT_WARNING 10
+
+enum RESULTS {
+	RESULT_LOSS,
+	RESULT_DRAW,
+	RESULT_WIN
+};
+
+/*
+ * struct player_t
+ * 	depth: deepest iteration of each search
+ * 	nodes: node limit of each search, 0 for none
+ * 	base: starting clock in milliseconds, 0 for no clock
+ * 	increment: milliseconds added to the clock after each move
+ * 	disabled: PRUNE_ techniques the player doesn't use
+ */
+struct player_t {
+	int depth;
+	unsigned long long nodes;
+	unsigned long long base;
+	unsigned long long increment;
+	unsigned disabled;
+};
+
+/* Names of the PRUNE_ techniques, as the UCI options of uci.c */
+static const struct {
+	const char *name;
+	unsigned flag;
+} prune_names[] = {
+	{ "NullMove", PRUNE_NULL_MOVE },
+	{ "LateMoveReductions", PRUNE_LMR },
+	{ "ReverseFutility", PRUNE_REVERSE_FUTILITY },
+	{ "Futility", PRUNE_FUTILITY },
+	{ "Razoring", PRUNE_RAZORING }
+};
+#define PRUNE_NAMES (sizeof(prune_names) / sizeof(prune_names[0]))
+
+static struct player_t players[2] = {
+	{ DEFAULT_DEPTH, 0, 0, 0, 0 },
+	{ DEFAULT_DEPTH, 0, 0, 0, 0 }
+};
+static struct position_t *openings = NULL;
+static int nopenings = 0;
+static int maxgames = 20000;
+static int resign_score = 1000;
+static int draw_score = 10;
+static size_t hash_mb = TT_DEFAULT_MB;
+static int random_plies = -1;
+static uint64_t seed = 0;
+static double elo0 = 0.0;
+static double elo1 = 5.0;
+static double alpha = 0.05;
+static double beta = 0.05;
+
+/* Shared match state, guarded by match_lock */
+static pthread_mutex_t match_lock = PTHREAD_MUTEX_INITIALIZER;
+static int nextgame = 0;
+static int results[3] = { 0 };
+static int decided = 0;
+
+static int parse_player(struct player_t *playerPtr, char *str)
+{
+	double base;
+	double increment = 0.0;
+	unsigned i;
+	for (char *opt = strtok(str, ","); opt; opt = strtok(NULL, ",")) {
+		if (sscanf(opt, "depth=%d", &playerPtr->depth) == 1)
+			continue;
+		if (sscanf(opt, "nodes=%llu", &playerPtr->nodes) == 1)
+			continue;
+		if (sscanf(opt, "tc=%lf+%lf", &base, &increment) >= 1) {
+			playerPtr->base = base * 1000;
+			playerPtr->increment = increment * 1000;
+			/* a clock replaces the default depth limit */
+			if (playerPtr->depth == DEFAULT_DEPTH)
+				playerPtr->depth = MAX_PLY - 1;
+			continue;
+		}
+		if (!strncmp(opt, "off=", 4)) {
+			for (i = 0; i < PRUNE_NAMES; ++i)
+				if (!strcmp(opt + 4, prune_names[i].name))
+					break;
+			if (i < PRUNE_NAMES) {
+				playerPtr->disabled |= prune_names[i].flag;
+				continue;
+			}
+		}
+		fprintf(stderr, "Unknown player setting \"%s\"\n", opt);
+		return 0;
+	}
+	return 1;
+}
+
+static void load_openings(const char *path)
+{
+	FILE *in;
+	char line[EPD_LINE_LENGTH];
+	int size = 0;
+	if ((in = fopen(path, "r")) == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	while (fgets(line, sizeof(line), in)) {
+		if (nopenings == size) {
+			size = size ? (2 * size) : 1024;
+			openings = realloc(openings,
+					size * sizeof(struct position_t));
+		}
+		if (parse_fen(&openings[nopenings], line))
+			++nopenings;
+	}
+	fclose(in);
+	if (nopenings == 0) {
+		fprintf(stderr, "No positions in %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+}
+
+/* splitmix64, any state will do */
+static uint64_t random_next(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+/*
+ * Sets up the start of the games of a pair, the opening followed by random
+ * legal moves drawn from a generator seeded by the pair, so both games start
+ * from the same position. Random moves ending the game are drawn again
+ */
+static void pair_opening(int pair, struct position_t *posPtr)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	uint64_t state = seed ^ ((uint64_t)pair << 32);
+	int ply;
+	int n;
+	do {
+		*posPtr = openings ? openings[pair % nopenings]
+			: START_POSITION;
+		for (ply = 0; ply < random_plies; ++ply) {
+			if ((n = legal_moves(posPtr, movelist)) == 0)
+				break;
+			make_move(posPtr, movelist[1 + (random_next(&state)
+						% n)]);
+		}
+		update_game_status(posPtr);
+	} while ((random_plies > 0) && ((ply < random_plies)
+				|| (posPtr->flags & GAME_OVER)));
+}
+
+/*
+ * Plays one game, returns the result for white
+ * Each player searches with its own search_t, so neither sees the other's
+ * hash table
+ */
+static int play_game(struct position_t pos, const struct player_t *white,
+		struct search_t *wsearch, const struct player_t *black,
+		struct search_t *bsearch)
+{
+	const struct player_t *side[2] = { white, black };
+	struct search_t *search[2] = { wsearch, bsearch };
+	unsigned long long clock[2] = { white->base, black->base };
+	unsigned long long start;
+	unsigned long long elapsed;
+	int color;
+	int resigning = 0;
+	int drawing = 0;
+	signed score;
+	uint16_t mv;
+	for (int ply = 0; ply < MAX_GAME_PLIES; ++ply) {
+		color = (pos.flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+		update_game_status(&pos);
+		if (pos.flags & GAME_DRAWN)
+			return RESULT_DRAW;
+		if (pos.flags & GAME_OVER)
+			return color ? RESULT_WIN : RESULT_LOSS;
+		search[color]->maxnodes = side[color]->nodes;
+		search[color]->stop = 0;
+		start = get_time_ms();
+		time_allocate(search[color], side[color]->base ? clock[color]
+				: 0, side[color]->increment, 0, MOVE_OVERHEAD);
+		mv = search_position(search[color], &pos, side[color]->depth);
+		score = search[color]->score;
+		if (search[color]->overshoot >= OVERSHOOT_WARNING)
+			fprintf(stderr, "Player %c overshot its deadline by %llu "
+					"ms\n", (side[color] == &players[0])
+					? 'a' : 'b', search[color]->overshoot);
+		if (side[color]->base) {
+			elapsed = get_time_ms() - start;
+			if (elapsed > clock[color])
+				return color ? RESULT_WIN : RESULT_LOSS;
+			clock[color] += side[color]->increment - elapsed;
+		}
+		/* for white, so both sides have to agree on who is winning */
+		score = (color == WHITE) ? score : -score;
+		if (resign_score && (abs(score) >= resign_score)) {
+			if ((score > 0) != (resigning > 0))
+				resigning = 0;
+			resigning += (score > 0) ? 1 : -1;
+			if (abs(resigning) >= 2 * RESIGN_MOVES)
+				return (resigning > 0) ? RESULT_WIN
+					: RESULT_LOSS;
+		} else {
+			resigning = 0;
+		}
+		if (draw_score && (pos.moves >= 2 * DRAW_START)
+				&& (abs(score) <= draw_score)) {
+			if (++drawing >= 2 * DRAW_MOVES)
+				return RESULT_DRAW;
+		} else {
+			drawing = 0;
+		}
+		make_move(&pos, mv);
+	}
+	return RESULT_DRAW;
+}
+
+static double score_to_elo(double score)
+{
+	if (score <= 0.0)
+		return -HUGE_VAL;
+	if (score >= 1.0)
+		return HUGE_VAL;
+	return -400.0 * log10((1.0 / score) - 1.0);
+}
+
+static double elo_to_score(double elo)
+{
+	return 1.0 / (1.0 + pow(10.0, -elo / 400.0));
+}
+
+/*
+ * Log-likelihood ratio of elo1 against elo0, using the normal approximation
+ * of the trinomial (win/draw/loss) distribution
+ */
+static double sprt_llr(const int counts[3])
+{
+	/* half a game stands in for a result not seen yet, keeping var > 0 */
+	double wins = counts[RESULT_WIN] ? counts[RESULT_WIN] : 0.5;
+	double losses = counts[RESULT_LOSS] ? counts[RESULT_LOSS] : 0.5;
+	double n = wins + counts[RESULT_DRAW] + losses;
+	double w = wins / n;
+	double d = counts[RESULT_DRAW] / n;
+	double score;
+	double var;
+	double s0 = elo_to_score(elo0);
+	double s1 = elo_to_score(elo1);
+	score = w + (d / 2.0);
+	var = w + (d / 4.0) - (score * score);
+	if (var <= 0.0)
+		return 0.0;
+	return n * (s1 - s0) * ((2.0 * score) - s0 - s1) / (2.0 * var);
+}
+
+static void print_status(const int counts[3], double llr, FILE *out)
+{
+	double n = counts[RESULT_WIN] + counts[RESULT_DRAW] + counts[RESULT_LOSS];
+	double score = (counts[RESULT_WIN] + (counts[RESULT_DRAW] / 2.0)) / n;
+	double var = ((counts[RESULT_WIN] + (counts[RESULT_DRAW] / 4.0)) / n)
+		- (score * score);
+	/* 95% confidence interval */
+	double margin = 1.96 * sqrt(var / n);
+	fprintf(out, "Games %d: +%d -%d =%d  Elo %.1f +/- %.1f  LLR %.2f "
+			"(%.2f, %.2f)\n", (int)n, counts[RESULT_WIN],
+			counts[RESULT_LOSS], counts[RESULT_DRAW],
+			score_to_elo(score), (score_to_elo(score + margin)
+				- score_to_elo(score - margin)) / 2.0, llr,
+			log(beta / (1.0 - alpha)), log((1.0 - beta) / alpha));
+}
+
+static void *worker(void *arg)
+{
+	struct search_t search[2] = { { 0 }, { 0 } };
+	struct tt_t tt[2] = { { 0 }, { 0 } };
+	struct position_t pos;
+	int game;
+	int result;
+	int stop;
+	double llr;
+	(void)arg;
+	/* search[0] and tt[0] are player a's */
+	for (int i = 0; i < 2; ++i) {
+		search[i].disabled = players[i].disabled;
+		if (hash_mb && tt_alloc(&tt[i], hash_mb, 1))
+			search[i].tt = &tt[i];
+	}
+	for (;;) {
+		pthread_mutex_lock(&match_lock);
+		game = nextgame++;
+		stop = decided || (game >= maxgames);
+		pthread_mutex_unlock(&match_lock);
+		if (stop)
+			break;
+		pair_opening(game / 2, &pos);
+		/* neither player should get to use what the last game found */
+		for (int i = 0; i < 2; ++i)
+			if (search[i].tt != NULL)
+				tt_clear(&tt[i], 1);
+		/* player a is white in even games */
+		if (game % 2)
+			result = RESULT_WIN - play_game(pos, &players[1],
+					&search[1], &players[0], &search[0]);
+		else
+			result = play_game(pos, &players[0], &search[0],
+					&players[1], &search[1]);
+		pthread_mutex_lock(&match_lock);
+		/* games still running when the test ends don't count */
+		if (!decided) {
+			++results[result];
+			llr = sprt_llr(results);
+			print_status(results, llr, stdout);
+			fflush(stdout);
+			if ((llr >= log((1.0 - beta) / alpha))
+					|| (llr <= log(beta / (1.0 - alpha))))
+				decided = (llr > 0.0) ? 1 : -1;
+		}
+		pthread_mutex_unlock(&match_lock);
+	}
+	tt_free(&tt[0]);
+	tt_free(&tt[1]);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t *threads;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	while ((opt = getopt(argc, argv, "t:g:o:a:b:e:p:r:d:H:n:s:")) != -1) {
+		switch (opt) {
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'g':
+			maxgames = atoi(optarg);
+			break;
+		case 'o':
+			load_openings(optarg);
+			break;
+		case 'a':
+		case 'b':
+			if (!parse_player(&players[opt - 'a'], optarg))
+				return EXIT_FAILURE;
+			break;
+		case 'e':
+			sscanf(optarg, "%lf,%lf", &elo0, &elo1);
+			break;
+		case 'p':
+			sscanf(optarg, "%lf,%lf", &alpha, &beta);
+			break;
+		case 'r':
+			resign_score = atoi(optarg);
+			break;
+		case 'd':
+			draw_score = atoi(optarg);
+			break;
+		case 'H':
+			hash_mb = strtoull(optarg, NULL, 10);
+			break;
+		case 'n':
+			random_plies = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-g games] "
+					"[-o openings] [-a player] [-b player] "
+					"[-e elo0,elo1] [-p alpha,beta] "
+					"[-r score] [-d score] [-H hash] "
+					"[-n plies] [-s seed]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+	/* fixed depth games from one position would all be the same */
+	if (random_plies < 0)
+		random_plies = openings ? 0 : DEFAULT_RANDOM_PLIES;
+	if (seed == 0)
+		seed = time(NULL);
+	threads = malloc(nthreads * sizeof(pthread_t));
+	for (int i = 0; i < nthreads; ++i)
+		pthread_create(&threads[i], NULL, worker, NULL);
+	for (int i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	free(openings);
+	if (decided)
+		printf("SPRT: H%d accepted\n", (decided > 0) ? 1 : 0);
+	else
+		printf("SPRT: no decision after %d games\n", results[RESULT_WIN]
+				+ results[RESULT_DRAW] + results[RESULT_LOSS]);
+	return 0;
+}
@@ -493,14 +493,14 @@ const uint64_t pawn_movement[2][64] = {
 
 const uint64_t pawn_attacks[2][64] = {
 	{
-		0x0ull,
-		0x0ull,
-		0x0ull,
-		0x0ull,
-		0x0ull,
-		0x0ull,
-		0x0ull,
-		0x0ull,
+		0x200ull,
+		0x500ull,
+		0xa00ull,
+		0x1400ull,
+		0x2800ull,
+		0x5000ull,
+		0xa000ull,
+		0x4000ull,
 		0x20000ull,
 		0x50000ull,
 		0xa0000ull,
@@ -615,22 +615,23 @@ const uint64_t pawn_attacks[2][64] = {
 		0x500000000000ull,
 		0xa00000000000ull,
 		0x400000000000ull,
-		0x0ull,
-		0x0ull,
-		0x0ull,
-		0x0ull,
-		0x0ull,
-		0x0ull,
-		0x0ull,
-		0x0ull
+		0x2000000000000ull,
+		0x5000000000000ull,
+		0xa000000000000ull,
+		0x14000000000000ull,
+		0x28000000000000ull,
+		0x50000000000000ull,
+		0xa0000000000000ull,
+		0x40000000000000ull
 	}
 };
 
 
-uint64_t pawn_moves(uint64_t enemy, uint64_t empty, int color, int sq)
+COLOR_SPECIALIZED uint64_t pawn_moves_of(uint64_t enemy, uint64_t empty,
+		const int color, int sq)
 {
 	uint64_t r = 0ull;
-	if ((sq / 8) == (color ? 6 : 1)) {
+	if ((sq / 8) == (color ? RANK_7 : RANK_2)) {
 		if (!(pawn_doublepush[color][sq % 8] & ~empty))
 			r |= pawn_movement[color][color ? (sq - 8) : (sq + 8)];
 	}
@@ -639,6 +640,12 @@ uint64_t pawn_moves(uint64_t enemy, uint64_t empty, int color, int sq)
 	return r;
 }
 
+uint64_t pawn_moves(uint64_t enemy, uint64_t empty, int color, int sq)
+{
+	return color ? pawn_moves_of(enemy, empty, BLACK, sq)
+		: pawn_moves_of(enemy, empty, WHITE, sq);
+}
+
 uint64_t bishop_moves(uint64_t occupied, int rank, int file)
 {
 	uint64_t r = 0ull;
@@ -667,8 +674,11 @@ uint64_t rook_moves(uint64_t occupied, int rank, int file)
 	key = ((occupied & file_masks[file]) >> file) * MAIN_ANTIDIAGONAL;
 	key >>= 54;
 	key &= OUTER_SQ_MASK;
-	key = sliding_attack_lookups[key + rank] * MAIN_ANTIDIAGONAL;
-	r |= (key >> (7 - file)) & file_masks[file];
+	key = sliding_attack_lookups[key + rank];
+	/* the products of ranks 1 and 8 overlap and carry, add rank 8 alone */
+	r |= (((key & 0x7f) * MAIN_ANTIDIAGONAL) >> (7 - file))
+		& file_masks[file];
+	r |= ((key >> 7) & 1ull) << (S_A8 + file);
 	return r;
 }
 
@@ -682,109 +692,295 @@ uint64_t queen_moves(uint64_t occupied, int rank, int file)
 
 uint16_t check_status(const struct position_t pos)
 {
-	uint64_t occupied = pos.occupied;
 	uint16_t ret = 0;
-	int brank = pos.kingpos[BLACK] / 8;
-	int bfile = pos.kingpos[BLACK] % 8;
-	int wrank = pos.kingpos[WHITE] / 8;
-	int wfile = pos.kingpos[WHITE] % 8;
-	if (rook_moves(occupied, wrank, wfile) & (pos.pieces[BLACK][ROOK]
-				| pos.pieces[BLACK][QUEEN])) {
+	if (is_square_attacked(&pos, pos.kingpos[WHITE], BLACK))
 		ret |= WHITE_CHECK;
-		goto test_black;
-	} else if (bishop_moves(occupied, wrank, wfile) & (pos.pieces[BLACK][BISHOP]
-				| pos.pieces[BLACK][QUEEN])) {
-		ret |= WHITE_CHECK;
-		goto test_black;
-	} else if (knight_attack_lookups[pos.kingpos[WHITE]] &
-				pos.pieces[BLACK][KNIGHT]) {
-		ret |= WHITE_CHECK;
-		goto test_black;
-	} else if (pawn_attacks[WHITE][pos.kingpos[WHITE]]
-				& pos.pieces[BLACK][PAWN]) {
-		ret |= WHITE_CHECK;
-		goto test_black;
-	} else if (king_attack_lookups[pos.kingpos[WHITE]]
-				& pos.pieces[BLACK][KING]) {
-		ret |= WHITE_CHECK;
-	}
-test_black:
-	if (rook_moves(occupied, brank, bfile) & (pos.pieces[WHITE][ROOK]
-				| pos.pieces[WHITE][QUEEN])) {
+	if (is_square_attacked(&pos, pos.kingpos[BLACK], WHITE))
 		ret |= BLACK_CHECK;
-		return ret;
-	} else if (bishop_moves(occupied, brank, bfile) & (pos.pieces[WHITE][BISHOP]
-				| pos.pieces[WHITE][QUEEN])) {
-		ret |= BLACK_CHECK;
-		return ret;
-	} else if (knight_attack_lookups[pos.kingpos[BLACK]]
-				& pos.pieces[WHITE][KNIGHT]) {
-		ret |= BLACK_CHECK;
-		return ret;
-	} else if (pawn_attacks[BLACK][pos.kingpos[BLACK]]
-				& pos.pieces[WHITE][PAWN]) {
-		ret |= BLACK_CHECK;
-		return ret;
-	} else if (king_attack_lookups[pos.kingpos[BLACK]]
-				& pos.pieces[WHITE][KING]) {
-		ret |= BLACK_CHECK;
-	}
 	return ret;
 }
 
-uint64_t castle_moves(struct position_t pos)
+/* Full line through two squares, 0 if they don't share one */
+static uint64_t line_through(int a, int b)
 {
-	uint64_t attk = 0ull;
-	uint64_t empty = pos.empty;
-	int color = (pos.flags & WHITE_TO_MOVE) ? WHITE : BLACK;
-	uint16_t friendly_check = color ? BLACK_CHECK : WHITE_CHECK;
-	int kingpos = color ? S_E8 : S_E1;
-	uint16_t kflag = color ? BLACK_KINGSIDE_CASTLE : WHITE_KINGSIDE_CASTLE;
-	uint16_t qflag = color ? BLACK_QUEENSIDE_CASTLE : WHITE_QUEENSIDE_CASTLE;
-	if (pos.flags & friendly_check)
+	int ra = a / 8;
+	int fa = a % 8;
+	int rb = b / 8;
+	int fb = b % 8;
+	if (ra == rb)
+		return rank_masks[ra];
+	if (fa == fb)
+		return file_masks[fa];
+	if ((ra - fa) == (rb - fb))
+		return diagonal_masks[(7 + ra) - fa];
+	if ((ra + fa) == (rb + fb))
+		return antidiagonal_masks[ra + fa];
+	return 0;
+}
+
+/* Squares strictly between two squares on a shared line, 0 if there are none */
+static uint64_t squares_between(int a, int b)
+{
+	uint64_t occupied = (1ull << a) | (1ull << b);
+	if (((a / 8) == (b / 8)) || ((a % 8) == (b % 8)))
+		return rook_moves(occupied, a / 8, a % 8)
+			& rook_moves(occupied, b / 8, b % 8);
+	if (line_through(a, b))
+		return bishop_moves(occupied, a / 8, a % 8)
+			& bishop_moves(occupied, b / 8, b % 8);
+	return 0;
+}
+
+uint64_t attackers_to(const struct position_t *posPtr, int sq,
+		uint64_t occupied)
+{
+	const uint64_t (*pieces)[7] = posPtr->pieces;
+	int rank = sq / 8;
+	int file = sq % 8;
+	return ((rook_moves(occupied, rank, file)
+				& (pieces[WHITE][ROOK] | pieces[WHITE][QUEEN]
+					| pieces[BLACK][ROOK]
+					| pieces[BLACK][QUEEN]))
+			| (bishop_moves(occupied, rank, file)
+				& (pieces[WHITE][BISHOP] | pieces[WHITE][QUEEN]
+					| pieces[BLACK][BISHOP]
+					| pieces[BLACK][QUEEN]))
+			| (knight_attack_lookups[sq]
+				& (pieces[WHITE][KNIGHT] | pieces[BLACK][KNIGHT]))
+			| (pawn_attacks[BLACK][sq] & pieces[WHITE][PAWN])
+			| (pawn_attacks[WHITE][sq] & pieces[BLACK][PAWN])
+			| (king_attack_lookups[sq]
+				& (pieces[WHITE][KING] | pieces[BLACK][KING])))
+		& occupied;
+}
+
+int is_square_attacked(const struct position_t *posPtr, int sq, int color)
+{
+	const uint64_t *pieces = posPtr->pieces[color];
+	int rank = sq / 8;
+	int file = sq % 8;
+	/* cheapest tests first */
+	if ((knight_attack_lookups[sq] & pieces[KNIGHT])
+			|| (pawn_attacks[BLACK - color][sq] & pieces[PAWN])
+			|| (king_attack_lookups[sq] & pieces[KING]))
+		return 1;
+	if ((pieces[BISHOP] | pieces[QUEEN]) && (bishop_moves(posPtr->occupied,
+				rank, file) & (pieces[BISHOP] | pieces[QUEEN])))
+		return 1;
+	return (pieces[ROOK] | pieces[QUEEN]) && (rook_moves(posPtr->occupied,
+				rank, file) & (pieces[ROOK] | pieces[QUEEN]));
+}
+
+/*
+ * Pieces of color blocker that are the only piece between a square and a
+ * slider of color slider
+ */
+static uint64_t lone_blockers(const struct position_t *posPtr, int sq,
+		int slider, int blocker)
+{
+	const uint64_t *pieces = posPtr->pieces[slider];
+	uint64_t transparent = posPtr->occupied & ~posPtr->pieces[blocker][0];
+	uint64_t snipers;
+	uint64_t between;
+	uint64_t r = 0;
+	snipers = (rook_moves(transparent, sq / 8, sq % 8)
+			& (pieces[ROOK] | pieces[QUEEN]))
+		| (bishop_moves(transparent, sq / 8, sq % 8)
+			& (pieces[BISHOP] | pieces[QUEEN]));
+	while (snipers != 0) {
+		between = squares_between(sq, ls1bindice(snipers))
+			& posPtr->occupied;
+		if (between && !(between & (between - 1)))
+			r |= between & posPtr->pieces[blocker][0];
+		snipers &= snipers - 1;
+	}
+	return r;
+}
+
+int in_check(const struct position_t *posPtr, int color)
+{
+	return is_square_attacked(posPtr, posPtr->kingpos[color], BLACK - color);
+}
+
+void get_check_info(const struct position_t *posPtr,
+		struct check_info_t *ciPtr)
+{
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	int ksq = posPtr->kingpos[BLACK - color];
+	uint64_t occupied = posPtr->occupied;
+	ciPtr->checkers = attackers_to(posPtr, posPtr->kingpos[color], occupied)
+		& posPtr->pieces[BLACK - color][0];
+	ciPtr->pinned = lone_blockers(posPtr, posPtr->kingpos[color],
+			BLACK - color, color);
+	ciPtr->discoverers = lone_blockers(posPtr, ksq, color, color);
+	ciPtr->check_squares[0] = 0;
+	ciPtr->check_squares[PAWN] = pawn_attacks[BLACK - color][ksq];
+	ciPtr->check_squares[KNIGHT] = knight_attack_lookups[ksq];
+	ciPtr->check_squares[BISHOP] = bishop_moves(occupied, ksq / 8, ksq % 8);
+	ciPtr->check_squares[ROOK] = rook_moves(occupied, ksq / 8, ksq % 8);
+	ciPtr->check_squares[QUEEN] = ciPtr->check_squares[BISHOP]
+		| ciPtr->check_squares[ROOK];
+	ciPtr->check_squares[KING] = 0;
+}
+
+int is_legal(const struct position_t *posPtr,
+		const struct check_info_t *ciPtr, uint16_t mv)
+{
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	int start = mv & START_SQUARE;
+	int end = (mv & END_SQUARE) >> 6;
+	int ksq = posPtr->kingpos[color];
+	uint64_t startbb = 1ull << start;
+	uint64_t endbb = 1ull << end;
+	uint64_t checkers = ciPtr->checkers;
+	uint64_t occupied;
+	if (start == ksq) {
+		/* the king can't shield its new square from a slider */
+		occupied = (posPtr->occupied ^ startbb) | endbb;
+		return !(attackers_to(posPtr, end, occupied)
+				& posPtr->pieces[BLACK - color][0] & ~endbb);
+	}
+	if ((mv & QUEEN_CAPTURE_PROMOTION) == EP_CAPTURE) {
+		/* two pieces leave the king's lines, test them all again */
+		occupied = posPtr->occupied ^ startbb ^ endbb
+			^ (1ull << (color ? (end + 8) : (end - 8)));
+		return !(attackers_to(posPtr, ksq, occupied)
+				& posPtr->pieces[BLACK - color][0]);
+	}
+	if (checkers) {
+		if (checkers & (checkers - 1))
+			return 0;
+		if (!((checkers | squares_between(ksq, ls1bindice(checkers)))
+					& endbb))
+			return 0;
+	}
+	if ((ciPtr->pinned & startbb) && !(line_through(start, ksq) & endbb))
 		return 0;
-	if ((pos.flags & kflag) && !(pos.occupied &
-				(6ull << kingpos))) {
-		make_move(&pos, color ? 0x0f7c : 0x0144);
-		if (!(pos.flags & friendly_check))
-			attk |= 1ull << (color ? S_G8 : S_G1 );
-		unmake_move(&pos, color ? 0x0f7c : 0x0144);
+	return 1;
+}
+
+int gives_check(const struct position_t *posPtr,
+		const struct check_info_t *ciPtr, uint16_t mv)
+{
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	int start = mv & START_SQUARE;
+	int end = (mv & END_SQUARE) >> 6;
+	int ksq = posPtr->kingpos[BLACK - color];
+	uint64_t startbb = 1ull << start;
+	uint64_t endbb = 1ull << end;
+	uint64_t kingbb = 1ull << ksq;
+	uint64_t occupied;
+	int rookstart;
+	int rookend;
+	int pt = PAWN;
+	if (mv & KNIGHT_PROMOTION) {
+		/* the promoted piece sees through the square the pawn left */
+		occupied = (posPtr->occupied ^ startbb) | endbb;
+		switch ((mv >> 12) & 3) {
+		case 0:
+			if (knight_attack_lookups[end] & kingbb)
+				return 1;
+			break;
+		case 1:
+			if (bishop_moves(occupied, end / 8, end % 8) & kingbb)
+				return 1;
+			break;
+		case 2:
+			if (rook_moves(occupied, end / 8, end % 8) & kingbb)
+				return 1;
+			break;
+		case 3:
+			if (queen_moves(occupied, end / 8, end % 8) & kingbb)
+				return 1;
+			break;
+		}
+	} else {
+		for (int i = PAWN; i <= KING; ++i) {
+			if (posPtr->pieces[color][i] & startbb) {
+				pt = i;
+				break;
+			}
+		}
+		if (ciPtr->check_squares[pt] & endbb)
+			return 1;
 	}
-	if ((pos.flags & qflag) && !(pos.occupied &
-				(14ull << (color * S_A8)))) {
-		make_move(&pos, color ? 0x0efc: 0x00c4);
-		if (!(pos.flags & friendly_check))
-			attk |= 1ull << (color ? S_C8 : S_C1 );
+	if ((ciPtr->discoverers & startbb) && !(line_through(start, ksq) & endbb))
+		return 1;
+	switch (mv & QUEEN_CAPTURE_PROMOTION) {
+	case KINGSIDE_CASTLE:
+	case QUEENSIDE_CASTLE:
+		rookstart = (end > start) ? (start + 3) : (start - 4);
+		rookend = (end > start) ? (start + 1) : (start - 1);
+		occupied = posPtr->occupied ^ startbb ^ endbb
+			^ (1ull << rookstart) ^ (1ull << rookend);
+		return (rook_moves(occupied, rookend / 8, rookend % 8)
+				& kingbb) != 0;
+	case EP_CAPTURE:
+		/* the captured pawn can uncover a slider too */
+		occupied = posPtr->occupied ^ startbb ^ endbb
+			^ (1ull << (color ? (end + 8) : (end - 8)));
+		return (attackers_to(posPtr, ksq, occupied)
+				& (posPtr->pieces[color][BISHOP]
+					| posPtr->pieces[color][ROOK]
+					| posPtr->pieces[color][QUEEN])) != 0;
 	}
+	return 0;
+}
+
+int was_legal(const struct position_t *posPtr)
+{
+	/* flags are already toggled to the side not moving */
+	return !in_check(posPtr, (posPtr->flags & WHITE_TO_MOVE) ? BLACK
+			: WHITE);
+}
+
+COLOR_SPECIALIZED uint64_t castle_moves_of(const struct position_t *posPtr,
+		const int color)
+{
+	uint64_t attk = 0ull;
+	const int kingpos = color ? S_E8 : S_E1;
+	const uint16_t kflag = color ? BLACK_KINGSIDE_CASTLE
+		: WHITE_KINGSIDE_CASTLE;
+	const uint16_t qflag = color ? BLACK_QUEENSIDE_CASTLE
+		: WHITE_QUEENSIDE_CASTLE;
+	if (posPtr->flags & (color ? BLACK_CHECK : WHITE_CHECK))
+		return 0;
+	/* the square the king lands on is tested like any other king move */
+	if ((posPtr->flags & kflag) && !(posPtr->occupied & (6ull << kingpos))
+			&& !is_square_attacked(posPtr, kingpos + 1,
+				BLACK - color))
+		attk |= 1ull << (kingpos + 2);
+	if ((posPtr->flags & qflag) && !(posPtr->occupied
+				& (14ull << (color * S_A8)))
+			&& !is_square_attacked(posPtr, kingpos - 1,
+				BLACK - color))
+		attk |= 1ull << (kingpos - 2);
 	return attk;
 }
 
-void serialize_moves(int start, uint64_t attk, const struct position_t pos,
-		uint16_t *lsPtr)
+uint64_t castle_moves(const struct position_t *posPtr)
+{
+	return (posPtr->flags & WHITE_TO_MOVE) ? castle_moves_of(posPtr, WHITE)
+		: castle_moves_of(posPtr, BLACK);
+}
+
+/*
+ * Appends the moves of a piece of known type to a movelist, when inlined with
+ * a constant piece type only the matching special cases are kept
+ */
+COLOR_SPECIALIZED void serialize_of(int start, int pt, uint64_t attk,
+		const struct position_t *posPtr, uint16_t *lsPtr,
+		const int color)
 {
-	int color = (pos.flags & WHITE_TO_MOVE) ? WHITE : BLACK;
 	int length = lsPtr[0];
-	uint64_t startbb = 1ull << start;
 	int end;
-	uint64_t endbb;
-	int pt;
 	uint16_t tmp;
-	assert(startbb & pos.pieces[color][0]);
-	if (attk == 0)
-		return;
-	for (int i = PAWN; i <= KING; ++i) {
-		if (pos.pieces[color][i] & startbb) {
-			pt = i;
-			break;
-		}
-	}
 	while (attk != 0) {
 		end = ls1bindice(attk);
-		endbb = 1ull << end;
 		attk &= attk - 1;
 		++length;
 		tmp = start | (end << 6);
-		if (pos.occupied & endbb)
+		if (posPtr->occupied & (1ull << end))
 			tmp |= CAPTURE_MOVE;
 		switch (pt) {
 		case PAWN:
@@ -792,7 +988,9 @@ void serialize_moves(int start, uint64_t attk, const struct position_t pos,
 				tmp |= DOUBLE_PAWN_PUSH;
 				break;
 			}
-			if (end == (pos.flags & EP_SQUARE)) {
+			if ((posPtr->flags & EN_PASSANT)
+					&& (end == (int)(posPtr->flags
+							& EP_SQUARE))) {
 				tmp |= CAPTURE_MOVE;
 				tmp |= EP_CAPTURE;
 				break;
@@ -819,62 +1017,257 @@ void serialize_moves(int start, uint64_t attk, const struct position_t pos,
 	lsPtr[0] = length;
 }
 
-void generate_moves(const struct position_t pos, uint16_t *lsPtr)
+void serialize_moves(int start, uint64_t attk, const struct position_t pos,
+		uint16_t *lsPtr)
 {
 	int color = (pos.flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	uint64_t startbb = 1ull << start;
+	int pt = KING;
+	assert(startbb & pos.pieces[color][0]);
+	for (int i = PAWN; i < KING; ++i) {
+		if (pos.pieces[color][i] & startbb) {
+			pt = i;
+			break;
+		}
+	}
+	if (color)
+		serialize_of(start, pt, attk, &pos, lsPtr, BLACK);
+	else
+		serialize_of(start, pt, attk, &pos, lsPtr, WHITE);
+}
+
+/*
+ * Appends the pawn moves to a set of squares that all start offset squares
+ * behind their end, moves to the last rank become the four promotions
+ */
+COLOR_SPECIALIZED void serialize_pawns_of(uint64_t targets, int offset,
+		uint16_t flags, uint16_t *lsPtr, const int color)
+{
+	uint64_t last = rank_masks[color ? RANK_1 : RANK_8];
+	int length = lsPtr[0];
+	int end;
+	uint16_t tmp;
+	for (uint64_t bb = targets & ~last; bb; bb &= bb - 1) {
+		end = ls1bindice(bb);
+		lsPtr[++length] = (end - offset) | (end << 6) | flags;
+	}
+	for (uint64_t bb = targets & last; bb; bb &= bb - 1) {
+		end = ls1bindice(bb);
+		tmp = (end - offset) | (end << 6) | flags;
+		lsPtr[++length] = tmp | KNIGHT_PROMOTION;
+		lsPtr[++length] = tmp | BISHOP_PROMOTION;
+		lsPtr[++length] = tmp | ROOK_PROMOTION;
+		lsPtr[++length] = tmp | QUEEN_PROMOTION;
+	}
+	lsPtr[0] = length;
+}
+
+/* Moves of all pawns at once, each kind of move is one shift of the pawns */
+COLOR_SPECIALIZED void generate_pawns_of(const struct position_t *posPtr,
+		uint16_t *lsPtr, const int color)
+{
+	const int up = color ? -8 : 8;
+	uint64_t pawns = posPtr->pieces[color][PAWN];
+	uint64_t enemy = posPtr->pieces[BLACK - color][0];
+	uint64_t west = pawns & ~file_masks[A_FILE];
+	uint64_t east = pawns & ~file_masks[H_FILE];
+	uint64_t pushes;
+	int ep;
+	pushes = (color ? (pawns >> 8) : (pawns << 8)) & posPtr->empty;
+	serialize_pawns_of(pushes, up, 0, lsPtr, color);
+	pushes &= rank_masks[color ? RANK_6 : RANK_3];
+	pushes = (color ? (pushes >> 8) : (pushes << 8)) & posPtr->empty;
+	serialize_pawns_of(pushes, 2 * up, DOUBLE_PAWN_PUSH, lsPtr, color);
+	serialize_pawns_of((color ? (west >> 9) : (west << 7)) & enemy, up - 1,
+			CAPTURE_MOVE, lsPtr, color);
+	serialize_pawns_of((color ? (east >> 7) : (east << 9)) & enemy, up + 1,
+			CAPTURE_MOVE, lsPtr, color);
+	if (!(posPtr->flags & EN_PASSANT))
+		return;
+	ep = posPtr->flags & EP_SQUARE;
+	for (uint64_t bb = pawn_attacks[BLACK - color][ep] & pawns; bb;
+			bb &= bb - 1)
+		lsPtr[++lsPtr[0]] = ls1bindice(bb) | (ep << 6) | EP_CAPTURE;
+}
+
+COLOR_SPECIALIZED void generate_of(const struct position_t *posPtr,
+		uint16_t *lsPtr, const int color)
+{
 	int sq = 0;
 	uint64_t pbb = 0;
 	uint64_t attk = 0;
-	uint64_t enemy = pos.pieces[BLACK - color][0];
-	uint64_t friendly = pos.pieces[color][0];
-	pbb = pos.pieces[color][PAWN];
-	if (pos.flags & EN_PASSANT)
-		enemy ^= 1ull << (pos.flags & EP_SQUARE);
-	while (pbb != 0) {
-		sq = ls1bindice(pbb);
-		attk = pawn_moves(enemy, pos.empty, color, sq);
-		attk &= ~friendly;
-		serialize_moves(sq, attk, pos, lsPtr);
-		pbb &= pbb - 1;
-	}
-	if (pos.flags & EN_PASSANT)
-		enemy ^= 1ull << (pos.flags & EP_SQUARE);
-	pbb = pos.pieces[color][BISHOP];
+	uint64_t friendly = posPtr->pieces[color][0];
+	uint64_t occupied = posPtr->occupied;
+	generate_pawns_of(posPtr, lsPtr, color);
+	pbb = posPtr->pieces[color][BISHOP];
 	while (pbb != 0) {
 		sq = ls1bindice(pbb);
-		attk = bishop_moves(pos.occupied, sq / 8, sq % 8);
+		attk = bishop_moves(occupied, sq / 8, sq % 8);
 		attk &= ~friendly;
-		serialize_moves(sq, attk, pos, lsPtr);
+		serialize_of(sq, BISHOP, attk, posPtr, lsPtr, color);
 		pbb &= pbb - 1;
 	}
-	pbb = pos.pieces[color][KNIGHT];
+	pbb = posPtr->pieces[color][KNIGHT];
 	while (pbb != 0) {
 		sq = ls1bindice(pbb);
 		attk = knight_attack_lookups[sq];
 		attk &= ~friendly;
-		serialize_moves(sq, attk, pos, lsPtr);
+		serialize_of(sq, KNIGHT, attk, posPtr, lsPtr, color);
 		pbb &= pbb - 1;
 	}
-	pbb = pos.pieces[color][ROOK];
+	pbb = posPtr->pieces[color][ROOK];
 	while (pbb != 0) {
 		sq = ls1bindice(pbb);
-		attk = rook_moves(pos.occupied, sq / 8, sq % 8);
+		attk = rook_moves(occupied, sq / 8, sq % 8);
 		attk &= ~friendly;
-		serialize_moves(sq, attk, pos, lsPtr);
+		serialize_of(sq, ROOK, attk, posPtr, lsPtr, color);
 		pbb &= pbb - 1;
 	}
-	pbb = pos.pieces[color][QUEEN];
+	pbb = posPtr->pieces[color][QUEEN];
 	while (pbb != 0) {
 		sq = ls1bindice(pbb);
-		attk = queen_moves(pos.occupied, sq / 8, sq % 8);
+		attk = queen_moves(occupied, sq / 8, sq % 8);
 		attk &= ~friendly;
-		serialize_moves(sq, attk, pos, lsPtr);
+		serialize_of(sq, QUEEN, attk, posPtr, lsPtr, color);
 		pbb &= pbb - 1;
 	}
-	sq = pos.kingpos[color];
+	sq = posPtr->kingpos[color];
 	attk = king_attack_lookups[sq];
 	attk &= ~friendly;
-	serialize_moves(sq, attk, pos, lsPtr);
-	if (pos.flags & BOTH_BOTH_CASTLE)
-		serialize_moves(sq, castle_moves(pos), pos, lsPtr);
+	serialize_of(sq, KING, attk, posPtr, lsPtr, color);
+	if (posPtr->flags & (color ? BLACK_BOTH_CASTLE : WHITE_BOTH_CASTLE))
+		serialize_of(sq, KING, castle_moves_of(posPtr, color), posPtr,
+				lsPtr, color);
+}
+
+void generate_moves(const struct position_t *posPtr, uint16_t *lsPtr)
+{
+	if (posPtr->flags & WHITE_TO_MOVE)
+		generate_of(posPtr, lsPtr, WHITE);
+	else
+		generate_of(posPtr, lsPtr, BLACK);
+}
+
+/* Squares attacked by the pieces of color, seen through occupied */
+COLOR_SPECIALIZED uint64_t attacks_of(const struct position_t *posPtr,
+		uint64_t occupied, const int color)
+{
+	const uint64_t *pieces = posPtr->pieces[color];
+	uint64_t pawns = pieces[PAWN];
+	uint64_t bb;
+	uint64_t r;
+	int sq;
+	r = color ? (((pawns & ~file_masks[A_FILE]) >> 9)
+			| ((pawns & ~file_masks[H_FILE]) >> 7))
+		: (((pawns & ~file_masks[A_FILE]) << 7)
+			| ((pawns & ~file_masks[H_FILE]) << 9));
+	r |= king_attack_lookups[posPtr->kingpos[color]];
+	for (bb = pieces[KNIGHT]; bb; bb &= bb - 1)
+		r |= knight_attack_lookups[ls1bindice(bb)];
+	for (bb = pieces[BISHOP] | pieces[QUEEN]; bb; bb &= bb - 1) {
+		sq = ls1bindice(bb);
+		r |= bishop_moves(occupied, sq / 8, sq % 8);
+	}
+	for (bb = pieces[ROOK] | pieces[QUEEN]; bb; bb &= bb - 1) {
+		sq = ls1bindice(bb);
+		r |= rook_moves(occupied, sq / 8, sq % 8);
+	}
+	return r;
+}
+
+/* Number of moves to a set of squares, promotions count four times */
+COLOR_SPECIALIZED int count_targets(uint64_t targets, const int color)
+{
+	uint64_t last = rank_masks[color ? RANK_1 : RANK_8];
+	return popcount(targets & ~last) + (4 * popcount(targets & last));
+}
+
+COLOR_SPECIALIZED int count_of(const struct position_t *posPtr,
+		const int color)
+{
+	const uint64_t *pieces = posPtr->pieces[color];
+	const int ksq = posPtr->kingpos[color];
+	uint64_t occupied = posPtr->occupied;
+	uint64_t enemy = posPtr->pieces[BLACK - color][0];
+	uint64_t attacked;
+	uint64_t checkers;
+	uint64_t pinned;
+	uint64_t target;
+	uint64_t pawns;
+	uint64_t pushes;
+	uint64_t bb;
+	uint64_t attk;
+	int count;
+	int sq;
+	int ep;
+	/* the king doesn't shield the squares behind it from a slider */
+	attacked = attacks_of(posPtr, occupied ^ (1ull << ksq), BLACK - color);
+	count = popcount(king_attack_lookups[ksq] & ~pieces[0] & ~attacked);
+	checkers = attackers_to(posPtr, ksq, occupied) & enemy;
+	if (checkers & (checkers - 1))
+		return count;
+	/* out of check the other pieces have to capture or block the checker */
+	if (checkers)
+		target = checkers | squares_between(ksq, ls1bindice(checkers));
+	else
+		target = ~pieces[0];
+	if (!checkers && (posPtr->flags & (color ? BLACK_BOTH_CASTLE
+					: WHITE_BOTH_CASTLE)))
+		count += popcount(castle_moves_of(posPtr, color) & ~attacked);
+	pinned = lone_blockers(posPtr, ksq, BLACK - color, color);
+	/* a pinned knight has no moves along the pin */
+	for (bb = pieces[KNIGHT] & ~pinned; bb; bb &= bb - 1)
+		count += popcount(knight_attack_lookups[ls1bindice(bb)]
+				& target);
+	for (bb = pieces[BISHOP] | pieces[QUEEN]; bb; bb &= bb - 1) {
+		sq = ls1bindice(bb);
+		attk = bishop_moves(occupied, sq / 8, sq % 8) & target;
+		if (pinned & (1ull << sq))
+			attk &= line_through(sq, ksq);
+		count += popcount(attk);
+	}
+	for (bb = pieces[ROOK] | pieces[QUEEN]; bb; bb &= bb - 1) {
+		sq = ls1bindice(bb);
+		attk = rook_moves(occupied, sq / 8, sq % 8) & target;
+		if (pinned & (1ull << sq))
+			attk &= line_through(sq, ksq);
+		count += popcount(attk);
+	}
+	/* pawns that aren't pinned all at once, e.p. is tested on its own */
+	pawns = pieces[PAWN] & ~pinned;
+	pushes = (color ? (pawns >> 8) : (pawns << 8)) & posPtr->empty;
+	count += count_targets(pushes & target, color);
+	pushes &= rank_masks[color ? RANK_6 : RANK_3];
+	count += popcount((color ? (pushes >> 8) : (pushes << 8))
+			& posPtr->empty & target);
+	attk = color ? ((pawns & ~file_masks[A_FILE]) >> 9)
+		: ((pawns & ~file_masks[A_FILE]) << 7);
+	count += count_targets(attk & enemy & target, color);
+	attk = color ? ((pawns & ~file_masks[H_FILE]) >> 7)
+		: ((pawns & ~file_masks[H_FILE]) << 9);
+	count += count_targets(attk & enemy & target, color);
+	for (bb = pieces[PAWN] & pinned; bb; bb &= bb - 1) {
+		sq = ls1bindice(bb);
+		count += count_targets(pawn_moves_of(enemy, posPtr->empty,
+					color, sq) & target
+				& line_through(sq, ksq), color);
+	}
+	if (!(posPtr->flags & EN_PASSANT))
+		return count;
+	/* both pawns leave the king's lines, test them all again */
+	ep = posPtr->flags & EP_SQUARE;
+	for (bb = pawn_attacks[BLACK - color][ep] & pieces[PAWN]; bb;
+			bb &= bb - 1) {
+		attk = occupied ^ (bb & -bb) ^ (1ull << ep)
+			^ (1ull << (color ? (ep + 8) : (ep - 8)));
+		if (!(attackers_to(posPtr, ksq, attk) & enemy))
+			++count;
+	}
+	return count;
+}
+
+int count_moves(const struct position_t *posPtr)
+{
+	return (posPtr->flags & WHITE_TO_MOVE) ? count_of(posPtr, WHITE)
+		: count_of(posPtr, BLACK);
 }
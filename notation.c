@@ -0,0 +1,368 @@
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "headers/chess.h"
+#include "headers/search.h"
+#include "headers/notation.h"
+
+/* Index by PIECETYPES */
+static const char piece_chars[8] = " PNBRQK";
+
+static int piece_on(const struct position_t *posPtr, int sq)
+{
+	uint64_t bb = 1ull << sq;
+	int color = (posPtr->pieces[WHITE][0] & bb) ? WHITE : BLACK;
+	for (int i = PAWN; i <= KING; ++i)
+		if (posPtr->pieces[color][i] & bb)
+			return i;
+	return 0;
+}
+
+static int char_to_piece(char c)
+{
+	for (int i = PAWN; i <= KING; ++i)
+		if (piece_chars[i] == c)
+			return i;
+	return 0;
+}
+
+int parse_fen(struct position_t *posPtr, const char *fen)
+{
+	static const uint16_t castle_flags[4] = {
+		WHITE_KINGSIDE_CASTLE, WHITE_QUEENSIDE_CASTLE,
+		BLACK_KINGSIDE_CASTLE, BLACK_QUEENSIDE_CASTLE
+	};
+	static const char castle_chars[4] = { 'K', 'Q', 'k', 'q' };
+	/* king and rook squares each castle right needs */
+	static const uint64_t castle_pieces[4][2] = {
+		{ 1ull << S_E1, 1ull << S_H1 }, { 1ull << S_E1, 1ull << S_A1 },
+		{ 1ull << S_E8, 1ull << S_H8 }, { 1ull << S_E8, 1ull << S_A8 }
+	};
+	const char *p = fen;
+	int rank = RANK_8;
+	int file = A_FILE;
+	int color;
+	int pt;
+	int ep = -1;
+	int halfmove = 0;
+	int fullmove = 1;
+	int n = 0;
+	memset(posPtr, 0, sizeof(struct position_t));
+	while (*p == ' ')
+		++p;
+	for (; *p && (*p != ' '); ++p) {
+		if (*p == '/') {
+			if ((file != 8) || (rank == RANK_1))
+				return 0;
+			--rank;
+			file = A_FILE;
+		} else if ((*p >= '1') && (*p <= '8')) {
+			file += *p - '0';
+			if (file > 8)
+				return 0;
+		} else {
+			if ((file > H_FILE) || !(pt = char_to_piece(toupper(*p))))
+				return 0;
+			color = islower(*p) ? BLACK : WHITE;
+			posPtr->pieces[color][pt] |= 1ull << ((rank * 8) + file);
+			posPtr->pieces[color][0] |= 1ull << ((rank * 8) + file);
+			++file;
+		}
+	}
+	if ((rank != RANK_1) || (file != 8)
+			|| (popcount(posPtr->pieces[WHITE][KING]) != 1)
+			|| (popcount(posPtr->pieces[BLACK][KING]) != 1))
+		return 0;
+	posPtr->kingpos[WHITE] = ls1bindice(posPtr->pieces[WHITE][KING]);
+	posPtr->kingpos[BLACK] = ls1bindice(posPtr->pieces[BLACK][KING]);
+	posPtr->occupied = posPtr->pieces[WHITE][0] | posPtr->pieces[BLACK][0];
+	posPtr->empty = ~posPtr->occupied;
+	while (*p == ' ')
+		++p;
+	if (*p == 'w')
+		posPtr->flags |= WHITE_TO_MOVE;
+	else if (*p != 'b')
+		return 0;
+	++p;
+	while (*p == ' ')
+		++p;
+	/* rights without their king and rook in place are dropped */
+	for (; *p && (*p != ' '); ++p) {
+		if (*p == '-')
+			continue;
+		if (!strchr("KQkq", *p))
+			return 0;
+		for (int i = WK_CASTLE; i <= BQ_CASTLE; ++i) {
+			color = (i >= BK_CASTLE) ? BLACK : WHITE;
+			if ((*p == castle_chars[i])
+					&& (posPtr->pieces[color][KING]
+						& castle_pieces[i][0])
+					&& (posPtr->pieces[color][ROOK]
+						& castle_pieces[i][1]))
+				posPtr->flags |= castle_flags[i];
+		}
+	}
+	while (*p == ' ')
+		++p;
+	if ((p[0] >= 'a') && (p[0] <= 'h') && ((p[1] == '3') || (p[1] == '6'))) {
+		ep = (p[0] - 'a') + (8 * (p[1] - '1'));
+		p += 2;
+	} else if (*p == '-') {
+		++p;
+	} else {
+		return 0;
+	}
+	if (sscanf(p, " %d %d%n", &halfmove, &fullmove, &n) == 2)
+		p += n;
+	if (fullmove < 1)
+		fullmove = 1;
+	posPtr->fiftymove = (halfmove < 0) ? 0 : halfmove;
+	posPtr->moves = (2 * (fullmove - 1))
+		+ !(posPtr->flags & WHITE_TO_MOVE);
+	for (int i = WK_CASTLE; i <= BQ_CASTLE; ++i)
+		if (!(posPtr->flags & castle_flags[i]))
+			posPtr->castles[i] = CASTLE_LOST_BEFORE;
+	/* the e.p. square must be behind a pawn that just pushed two squares */
+	if ((ep >= 0) && ((ep / 8) == ((posPtr->flags & WHITE_TO_MOVE)
+					? RANK_6 : RANK_3))
+			&& (posPtr->pieces[(posPtr->flags & WHITE_TO_MOVE)
+				? BLACK : WHITE][PAWN] & (1ull << ((ep / 8 == RANK_6)
+					? (ep - 8) : (ep + 8))))) {
+		posPtr->flags |= EN_PASSANT | ep;
+		push_ep(posPtr, ep);
+	}
+	posPtr->flags |= check_status(*posPtr);
+	posPtr->hash = polyglot_key(posPtr);
+	return p - fen;
+}
+
+void write_fen(const struct position_t *posPtr, char *str)
+{
+	int empty;
+	int pt;
+	int sq;
+	for (int rank = RANK_8; rank >= RANK_1; --rank) {
+		empty = 0;
+		for (int file = A_FILE; file <= H_FILE; ++file) {
+			sq = (rank * 8) + file;
+			if (!(pt = piece_on(posPtr, sq))) {
+				++empty;
+				continue;
+			}
+			if (empty)
+				*str++ = '0' + empty;
+			empty = 0;
+			*str++ = (posPtr->pieces[WHITE][0] & (1ull << sq))
+				? piece_chars[pt] : tolower(piece_chars[pt]);
+		}
+		if (empty)
+			*str++ = '0' + empty;
+		if (rank != RANK_1)
+			*str++ = '/';
+	}
+	*str++ = ' ';
+	*str++ = (posPtr->flags & WHITE_TO_MOVE) ? 'w' : 'b';
+	*str++ = ' ';
+	if (!(posPtr->flags & BOTH_BOTH_CASTLE))
+		*str++ = '-';
+	if (posPtr->flags & WHITE_KINGSIDE_CASTLE)
+		*str++ = 'K';
+	if (posPtr->flags & WHITE_QUEENSIDE_CASTLE)
+		*str++ = 'Q';
+	if (posPtr->flags & BLACK_KINGSIDE_CASTLE)
+		*str++ = 'k';
+	if (posPtr->flags & BLACK_QUEENSIDE_CASTLE)
+		*str++ = 'q';
+	*str++ = ' ';
+	if (posPtr->flags & EN_PASSANT) {
+		*str++ = 'a' + ((posPtr->flags & EP_SQUARE) % 8);
+		*str++ = '1' + ((posPtr->flags & EP_SQUARE) / 8);
+	} else {
+		*str++ = '-';
+	}
+	sprintf(str, " %d %d", posPtr->fiftymove, (posPtr->moves / 2) + 1);
+}
+
+int legal_moves(struct position_t *posPtr, uint16_t *lsPtr)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	struct check_info_t ci;
+	movelist[0] = 0;
+	lsPtr[0] = 0;
+	generate_moves(posPtr, movelist);
+	get_check_info(posPtr, &ci);
+	for (int i = 1; i <= movelist[0]; ++i)
+		if (is_legal(posPtr, &ci, movelist[i]))
+			lsPtr[++lsPtr[0]] = movelist[i];
+	return lsPtr[0];
+}
+
+void move_to_coord(uint16_t mv, char *str)
+{
+	int start = mv & START_SQUARE;
+	int end = (mv & END_SQUARE) >> 6;
+	str[0] = 'a' + (start % 8);
+	str[1] = '1' + (start / 8);
+	str[2] = 'a' + (end % 8);
+	str[3] = '1' + (end / 8);
+	str[4] = '\0';
+	if (mv & KNIGHT_PROMOTION) {
+		str[4] = "nbrq"[(mv >> 12) & 3];
+		str[5] = '\0';
+	}
+}
+
+uint16_t parse_coord(struct position_t *posPtr, const char *str)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	char buf[MOVE_STRING_LENGTH];
+	int len = 0;
+	while (str[len] && !isspace((unsigned char)str[len]))
+		++len;
+	if ((len < 4) || (len > 5))
+		return 0;
+	legal_moves(posPtr, movelist);
+	for (int i = 1; i <= movelist[0]; ++i) {
+		move_to_coord(movelist[i], buf);
+		if (!strncmp(buf, str, len) && (buf[len] == '\0'))
+			return movelist[i];
+	}
+	return 0;
+}
+
+void move_to_san(struct position_t *posPtr, uint16_t mv, char *str)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	int start = mv & START_SQUARE;
+	int end = (mv & END_SQUARE) >> 6;
+	int pt = piece_on(posPtr, start);
+	int samefile = 0;
+	int samerank = 0;
+	int ambiguous = 0;
+	int other;
+	int color;
+	switch (mv & QUEEN_CAPTURE_PROMOTION) {
+	case KINGSIDE_CASTLE:
+		str += sprintf(str, "O-O");
+		goto check;
+	case QUEENSIDE_CASTLE:
+		str += sprintf(str, "O-O-O");
+		goto check;
+	}
+	legal_moves(posPtr, movelist);
+	if (pt != PAWN) {
+		*str++ = piece_chars[pt];
+		for (int i = 1; i <= movelist[0]; ++i) {
+			other = movelist[i] & START_SQUARE;
+			if ((other == start) || ((int)((movelist[i] & END_SQUARE) >> 6)
+						!= end) || (piece_on(posPtr, other) != pt))
+				continue;
+			ambiguous = 1;
+			samefile |= (other % 8) == (start % 8);
+			samerank |= (other / 8) == (start / 8);
+		}
+		if (ambiguous && (!samefile || samerank))
+			*str++ = 'a' + (start % 8);
+		if (ambiguous && samefile)
+			*str++ = '1' + (start / 8);
+	} else if (mv & CAPTURE_MOVE) {
+		*str++ = 'a' + (start % 8);
+	}
+	if (mv & CAPTURE_MOVE)
+		*str++ = 'x';
+	*str++ = 'a' + (end % 8);
+	*str++ = '1' + (end / 8);
+	if (mv & KNIGHT_PROMOTION) {
+		*str++ = '=';
+		*str++ = "NBRQ"[(mv >> 12) & 3];
+	}
+check:
+	make_move(posPtr, mv);
+	color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	if (posPtr->flags & (color ? BLACK_CHECK : WHITE_CHECK))
+		*str++ = legal_moves(posPtr, movelist) ? '+' : '#';
+	unmake_move(posPtr, mv);
+	*str = '\0';
+}
+
+uint16_t parse_san(struct position_t *posPtr, const char *str)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	char buf[MOVE_STRING_LENGTH + 8];
+	uint16_t found = 0;
+	uint16_t mv;
+	int len = 0;
+	int pt = PAWN;
+	int promotion = 0;
+	int file = -1;
+	int rank = -1;
+	int end;
+	int start;
+	int i;
+	while (str[len] && !isspace((unsigned char)str[len])
+			&& (len < (int)sizeof(buf) - 1)) {
+		buf[len] = str[len];
+		++len;
+	}
+	/* drop check, mate and annotation suffixes */
+	while ((len > 0) && strchr("+#!?", buf[len - 1]))
+		--len;
+	buf[len] = '\0';
+	legal_moves(posPtr, movelist);
+	if (!strcmp(buf, "O-O") || !strcmp(buf, "0-0")
+			|| !strcmp(buf, "O-O-O") || !strcmp(buf, "0-0-0")) {
+		for (i = 1; i <= movelist[0]; ++i)
+			if ((movelist[i] & QUEEN_CAPTURE_PROMOTION)
+					== ((len == 3) ? KINGSIDE_CASTLE
+						: QUEENSIDE_CASTLE))
+				return movelist[i];
+		return 0;
+	}
+	if ((len > 0) && (promotion = char_to_piece(toupper(buf[len - 1])))
+			&& (promotion != PAWN) && (promotion != KING)
+			&& (len >= 3) && ((buf[len - 2] == '=')
+				|| isdigit((unsigned char)buf[len - 2]))) {
+		len -= (buf[len - 2] == '=') ? 2 : 1;
+	} else {
+		promotion = 0;
+	}
+	if (len < 2)
+		return 0;
+	if ((buf[len - 2] < 'a') || (buf[len - 2] > 'h')
+			|| (buf[len - 1] < '1') || (buf[len - 1] > '8'))
+		return 0;
+	end = (buf[len - 2] - 'a') + (8 * (buf[len - 1] - '1'));
+	i = 0;
+	if (isupper((unsigned char)buf[0])) {
+		if (!(pt = char_to_piece(buf[0])))
+			return 0;
+		i = 1;
+	}
+	/* whatever is left between the piece and the end square disambiguates */
+	for (; i < len - 2; ++i) {
+		if ((buf[i] >= 'a') && (buf[i] <= 'h'))
+			file = buf[i] - 'a';
+		else if ((buf[i] >= '1') && (buf[i] <= '8'))
+			rank = buf[i] - '1';
+		else if ((buf[i] != 'x') && (buf[i] != '-') && (buf[i] != ':'))
+			return 0;
+	}
+	for (i = 1; i <= movelist[0]; ++i) {
+		mv = movelist[i];
+		start = mv & START_SQUARE;
+		if (((int)((mv & END_SQUARE) >> 6) != end)
+				|| (piece_on(posPtr, start) != pt)
+				|| ((file >= 0) && ((start % 8) != file))
+				|| ((rank >= 0) && ((start / 8) != rank)))
+			continue;
+		if (promotion ? (!(mv & KNIGHT_PROMOTION) || ((((mv >> 12) & 3)
+							+ KNIGHT) != promotion))
+				: (mv & KNIGHT_PROMOTION))
+			continue;
+		if (found)
+			return 0;
+		found = mv;
+	}
+	return found;
+}
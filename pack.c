@@ -0,0 +1,84 @@
+#include <stdint.h>
+#include <string.h>
+#include "headers/chess.h"
+#include "headers/pack.h"
+#include "headers/search.h"
+
+#define STATE_WHITE 0x0001u
+#define STATE_CASTLE_SHIFT 6
+#define STATE_EP_SHIFT 5
+#define STATE_EP_MASK (EN_PASSANT | EP_SQUARE)
+
+void pack_position(const struct position_t *posPtr,
+		struct packed_position_t *packedPtr)
+{
+	uint64_t bb = posPtr->occupied;
+	uint64_t sqbb;
+	int color;
+	int code;
+	int n = 0;
+	memset(packedPtr, 0, sizeof(struct packed_position_t));
+	packedPtr->occupied = bb;
+	/* squares in order, so the n-th occupied square has the n-th code */
+	for (; bb && (n < 32); bb &= bb - 1, ++n) {
+		sqbb = bb & -bb;
+		color = (posPtr->pieces[WHITE][0] & sqbb) ? WHITE : BLACK;
+		for (code = PAWN; code < KING; ++code)
+			if (posPtr->pieces[color][code] & sqbb)
+				break;
+		code = (2 * code) + color;
+		packedPtr->pieces[n / 2] |= code << (4 * (n % 2));
+	}
+	packedPtr->state = ((posPtr->flags & WHITE_TO_MOVE) ? STATE_WHITE : 0)
+		| ((posPtr->flags & BOTH_BOTH_CASTLE) >> STATE_CASTLE_SHIFT)
+		| ((posPtr->flags & STATE_EP_MASK) << STATE_EP_SHIFT);
+	packedPtr->fiftymove = (posPtr->fiftymove > 255) ? 255
+		: posPtr->fiftymove;
+	packedPtr->moves = (posPtr->moves > 0xffff) ? 0xffff : posPtr->moves;
+}
+
+int unpack_position(const struct packed_position_t *packedPtr,
+		struct position_t *posPtr)
+{
+	static const uint16_t castle_flags[4] = {
+		WHITE_KINGSIDE_CASTLE, WHITE_QUEENSIDE_CASTLE,
+		BLACK_KINGSIDE_CASTLE, BLACK_QUEENSIDE_CASTLE
+	};
+	uint64_t bb = packedPtr->occupied;
+	uint64_t sqbb;
+	int color;
+	int code;
+	int n = 0;
+	memset(posPtr, 0, sizeof(struct position_t));
+	for (; bb; bb &= bb - 1, ++n) {
+		if (n == 32)
+			return 0;
+		sqbb = bb & -bb;
+		code = (packedPtr->pieces[n / 2] >> (4 * (n % 2))) & 0xf;
+		if ((code < WHITE_PAWN) || (code > BLACK_KING))
+			return 0;
+		color = code % 2;
+		posPtr->pieces[color][code / 2] |= sqbb;
+		posPtr->pieces[color][0] |= sqbb;
+	}
+	if ((popcount(posPtr->pieces[WHITE][KING]) != 1)
+			|| (popcount(posPtr->pieces[BLACK][KING]) != 1))
+		return 0;
+	posPtr->kingpos[WHITE] = ls1bindice(posPtr->pieces[WHITE][KING]);
+	posPtr->kingpos[BLACK] = ls1bindice(posPtr->pieces[BLACK][KING]);
+	posPtr->occupied = packedPtr->occupied;
+	posPtr->empty = ~posPtr->occupied;
+	posPtr->flags = ((packedPtr->state & STATE_WHITE) ? WHITE_TO_MOVE : 0)
+		| ((packedPtr->state << STATE_CASTLE_SHIFT) & BOTH_BOTH_CASTLE)
+		| ((packedPtr->state >> STATE_EP_SHIFT) & STATE_EP_MASK);
+	posPtr->fiftymove = packedPtr->fiftymove;
+	posPtr->moves = packedPtr->moves;
+	for (int i = WK_CASTLE; i <= BQ_CASTLE; ++i)
+		if (!(posPtr->flags & castle_flags[i]))
+			posPtr->castles[i] = CASTLE_LOST_BEFORE;
+	if (posPtr->flags & EN_PASSANT)
+		push_ep(posPtr, posPtr->flags & EP_SQUARE);
+	posPtr->flags |= check_status(*posPtr);
+	posPtr->hash = polyglot_key(posPtr);
+	return 1;
+}
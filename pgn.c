@@ -0,0 +1,491 @@
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "headers/chess.h"
+#include "headers/search.h"
+#include "headers/notation.h"
+#include "headers/tbprobe.h"
+#include "headers/tt.h"
+
+/*
+ * Streaming PGN analyzer
+ * usage: pgn [-t threads] [-d depth] [-n nodes] [-j] [-s syzygy path]
+ *            [-H hash] [file]
+ * 	-t - number of analysis threads, defaults to the number of cores
+ * 	-d - depth searched in every position, defaults to 6
+ * 	-n - node limit of every search, 0 (the default) for none
+ * 	-j - write JSON lines (one object per position) instead of annotated
+ * 	     PGN
+ * 	-s - directory of Syzygy tables to probe
+ * 	-H - megabytes of the hash table of each thread, cleared between games,
+ * 	     0 for none, defaults to TT_DEFAULT_MB
+ * Games are read from the file (or stdin) one character at a time and queued
+ * as soon as their result is read, the queue holds at most two games per
+ * thread so memory use does not depend on the size of the input
+ * Games are written in the order they finish, not the order they were read
+ * When compiled with SEARCH_STATS the counters of all threads are totaled and
+ * written to stderr as JSON at exit
+ */
+
+#define MAX_GAME_PLIES 1024
+#define TAG_BUFFER_SIZE 4096
+#define TOKEN_LENGTH 256
+/* PGN export format limits lines to 80 characters */
+#define PGN_LINE_LENGTH 79
+
+enum TOKENS {
+	TOKEN_EOF,
+	TOKEN_TAG,
+	TOKEN_SYMBOL
+};
+
+/*
+ * struct game_t
+ * 	number: position of the game in the input, counted from 1
+ * 	start: starting position, from the FEN tag if there was one
+ * 	tags: tag pairs as they were read, one per line
+ * 	result: game termination marker
+ * 	plies: number of moves in moves[]
+ */
+struct game_t {
+	unsigned long number;
+	struct position_t start;
+	char tags[TAG_BUFFER_SIZE];
+	int taglength;
+	char result[8];
+	int plies;
+	uint16_t moves[MAX_GAME_PLIES];
+};
+
+/*
+ * struct queue_t
+ * Bounded queue of games waiting to be analyzed
+ * 	closed: set once the last game has been pushed
+ */
+struct queue_t {
+	struct game_t **games;
+	int size;
+	int head;
+	int count;
+	int closed;
+	pthread_mutex_t lock;
+	pthread_cond_t notempty;
+	pthread_cond_t notfull;
+};
+
+static struct queue_t queue = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.notempty = PTHREAD_COND_INITIALIZER,
+	.notfull = PTHREAD_COND_INITIALIZER
+};
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+static int maxdepth = 6;
+static unsigned long long maxnodes = 0;
+static int json = 0;
+static size_t hash_mb = TT_DEFAULT_MB;
+#ifdef SEARCH_STATS
+static struct search_stats_t total_stats;
+#endif
+
+static void queue_push(struct game_t *game)
+{
+	pthread_mutex_lock(&queue.lock);
+	while (queue.count == queue.size)
+		pthread_cond_wait(&queue.notfull, &queue.lock);
+	queue.games[(queue.head + queue.count) % queue.size] = game;
+	++queue.count;
+	pthread_cond_signal(&queue.notempty);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+/* Returns NULL once the queue is closed and empty */
+static struct game_t *queue_pop(void)
+{
+	struct game_t *game = NULL;
+	pthread_mutex_lock(&queue.lock);
+	while ((queue.count == 0) && !queue.closed)
+		pthread_cond_wait(&queue.notempty, &queue.lock);
+	if (queue.count != 0) {
+		game = queue.games[queue.head];
+		queue.head = (queue.head + 1) % queue.size;
+		--queue.count;
+		pthread_cond_signal(&queue.notfull);
+	}
+	pthread_mutex_unlock(&queue.lock);
+	return game;
+}
+
+static void queue_close(void)
+{
+	pthread_mutex_lock(&queue.lock);
+	queue.closed = 1;
+	pthread_cond_broadcast(&queue.notempty);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+/*
+ * Reads the next tag pair or movetext symbol into token, skipping comments,
+ * variations, NAGs, escaped lines and move number periods
+ * Tag pairs are returned without their brackets
+ */
+static int read_token(FILE *in, char *token)
+{
+	int c;
+	int depth;
+	int quoted;
+	int len = 0;
+	int linestart = 1;
+	for (;;) {
+		c = getc(in);
+		if (c == EOF)
+			return TOKEN_EOF;
+		if ((c == '%') && linestart) {
+			while (((c = getc(in)) != EOF) && (c != '\n'));
+			continue;
+		}
+		linestart = (c == '\n');
+		if (isspace(c) || (c == '.'))
+			continue;
+		if (c == '{') {
+			while (((c = getc(in)) != EOF) && (c != '}'));
+		} else if (c == ';') {
+			while (((c = getc(in)) != EOF) && (c != '\n'));
+			linestart = 1;
+		} else if (c == '(') {
+			for (depth = 1; depth && ((c = getc(in)) != EOF);) {
+				if (c == '(')
+					++depth;
+				else if (c == ')')
+					--depth;
+				else if (c == '{')
+					while (((c = getc(in)) != EOF) && (c != '}'));
+			}
+		} else if (c == '$') {
+			while (isdigit(c = getc(in)));
+			ungetc(c, in);
+		} else if (c == '[') {
+			quoted = 0;
+			while (((c = getc(in)) != EOF) && (quoted || (c != ']'))) {
+				if (c == '\\' && quoted) {
+					if (len < TOKEN_LENGTH - 2)
+						token[len++] = c;
+					c = getc(in);
+				} else if (c == '"') {
+					quoted = !quoted;
+				}
+				if ((c != EOF) && (c != '\n')
+						&& (len < TOKEN_LENGTH - 1))
+					token[len++] = c;
+			}
+			token[len] = '\0';
+			return TOKEN_TAG;
+		} else if (c == '*') {
+			strcpy(token, "*");
+			return TOKEN_SYMBOL;
+		} else if (isalnum(c)) {
+			do {
+				if (len < TOKEN_LENGTH - 1)
+					token[len++] = c;
+				c = getc(in);
+			} while ((c != EOF) && (isalnum(c)
+						|| strchr("_+#=:-/!?", c)));
+			ungetc(c, in);
+			token[len] = '\0';
+			return TOKEN_SYMBOL;
+		}
+	}
+}
+
+static int is_result(const char *token)
+{
+	return !strcmp(token, "1-0") || !strcmp(token, "0-1")
+		|| !strcmp(token, "1/2-1/2") || !strcmp(token, "*");
+}
+
+static struct game_t *new_game(unsigned long number)
+{
+	struct game_t *game = malloc(sizeof(struct game_t));
+	if (game == NULL) {
+		perror("pgn");
+		exit(EXIT_FAILURE);
+	}
+	game->number = number;
+	game->start = START_POSITION;
+	game->tags[0] = '\0';
+	game->taglength = 0;
+	strcpy(game->result, "*");
+	game->plies = 0;
+	return game;
+}
+
+static void add_tag(struct game_t *game, const char *tag)
+{
+	char value[TOKEN_LENGTH];
+	int len = strlen(tag);
+	if (game->taglength + len + 4 < TAG_BUFFER_SIZE)
+		game->taglength += sprintf(game->tags + game->taglength,
+				"[%s]\n", tag);
+	if (sscanf(tag, "FEN \"%255[^\"]\"", value) == 1) {
+		if (!parse_fen(&game->start, value)) {
+			fprintf(stderr, "Game %lu: invalid FEN \"%s\"\n",
+					game->number, value);
+			game->start = START_POSITION;
+		}
+	}
+}
+
+/* Writes a score from white's point of view, in pawns or moves to mate */
+static void format_score(char *str, signed score, int color)
+{
+	int plies;
+	if (color == BLACK)
+		score = -score;
+	if ((score > MATE_SCORE - MAX_PLY) || (score < -MATE_SCORE + MAX_PLY)) {
+		plies = MATE_SCORE - abs(score);
+		sprintf(str, "#%c%d", (score > 0) ? '+' : '-', (plies + 1) / 2);
+		return;
+	}
+	sprintf(str, "%c%d.%02d", (score < 0) ? '-' : '+', abs(score) / 100,
+			abs(score) % 100);
+}
+
+static void write_json(FILE *out, struct game_t *game, int ply,
+		struct position_t *posPtr, const struct search_t *searchPtr)
+{
+	char fen[FEN_LENGTH];
+	char played[MOVE_STRING_LENGTH];
+	char best[MOVE_STRING_LENGTH];
+	write_fen(posPtr, fen);
+	move_to_san(posPtr, game->moves[ply], played);
+	if (searchPtr->bestmove)
+		move_to_san(posPtr, searchPtr->bestmove, best);
+	else
+		best[0] = '\0';
+	fprintf(out, "{\"game\":%lu,\"ply\":%d,\"fen\":\"%s\",\"move\":\"%s\","
+			"\"best\":\"%s\",\"score\":%d,\"depth\":%d,"
+			"\"nodes\":%llu}\n", game->number, ply, fen, played,
+			best, searchPtr->score, searchPtr->depth,
+			searchPtr->nodes);
+}
+
+static void write_pgn_token(FILE *out, const char *token, int *linePtr)
+{
+	int len = strlen(token);
+	if (*linePtr && (*linePtr + len + 1 > PGN_LINE_LENGTH)) {
+		fputc('\n', out);
+		*linePtr = 0;
+	}
+	if (*linePtr) {
+		fputc(' ', out);
+		++*linePtr;
+	}
+	fputs(token, out);
+	*linePtr += len;
+}
+
+static void write_pgn_move(FILE *out, struct game_t *game, int ply,
+		struct position_t *posPtr, const struct search_t *searchPtr,
+		int *linePtr)
+{
+	char token[MOVE_STRING_LENGTH + 16];
+	char san[MOVE_STRING_LENGTH];
+	char score[16];
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	if ((color == WHITE) || (ply == 0)) {
+		sprintf(token, "%d%s", (posPtr->moves / 2) + 1,
+				(color == WHITE) ? "." : "...");
+		write_pgn_token(out, token, linePtr);
+	}
+	move_to_san(posPtr, game->moves[ply], san);
+	write_pgn_token(out, san, linePtr);
+	format_score(score, searchPtr->score, color);
+	sprintf(token, "{%s/%d", score, searchPtr->depth);
+	if (searchPtr->bestmove && (searchPtr->bestmove != game->moves[ply])) {
+		move_to_san(posPtr, searchPtr->bestmove, san);
+		write_pgn_token(out, token, linePtr);
+		sprintf(token, "%s}", san);
+	} else {
+		strcat(token, "}");
+	}
+	write_pgn_token(out, token, linePtr);
+}
+
+static void *worker(void *arg)
+{
+	struct search_t search = { 0 };
+	struct tt_t tt = { 0 };
+	struct game_t *game;
+	struct position_t pos;
+	FILE *out;
+	char *buf;
+	size_t len;
+	int line;
+	(void)arg;
+#ifdef SEARCH_STATS
+	stats_clear(&search.stats);
+#endif
+	if (hash_mb && tt_alloc(&tt, hash_mb, 1))
+		search.tt = &tt;
+	while ((game = queue_pop()) != NULL) {
+		/* build the whole game first so output from threads can't mix */
+		if ((out = open_memstream(&buf, &len)) == NULL) {
+			perror("pgn");
+			exit(EXIT_FAILURE);
+		}
+		if (!json)
+			fprintf(out, "%s\n", game->tags);
+		pos = game->start;
+		line = 0;
+		/* each game is analyzed as if on its own */
+		if (search.tt != NULL)
+			tt_clear(&tt, 1);
+		for (int ply = 0; ply < game->plies; ++ply) {
+			search.maxnodes = maxnodes;
+			search.stop = 0;
+			search_position(&search, &pos, maxdepth);
+			if (json)
+				write_json(out, game, ply, &pos, &search);
+			else
+				write_pgn_move(out, game, ply, &pos, &search,
+						&line);
+			make_move(&pos, game->moves[ply]);
+		}
+		if (!json) {
+			write_pgn_token(out, game->result, &line);
+			fputs("\n\n", out);
+		}
+		fclose(out);
+		pthread_mutex_lock(&output_lock);
+		fwrite(buf, 1, len, stdout);
+		fflush(stdout);
+		pthread_mutex_unlock(&output_lock);
+		free(buf);
+		free(game);
+	}
+#ifdef SEARCH_STATS
+	pthread_mutex_lock(&output_lock);
+	stats_add(&total_stats, &search.stats);
+	pthread_mutex_unlock(&output_lock);
+#endif
+	tt_free(&tt);
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	FILE *in = stdin;
+	char token[TOKEN_LENGTH];
+	struct game_t *game;
+	struct position_t pos;
+	pthread_t *threads;
+	unsigned long number = 1;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int movetext = 0;
+	int skip = 0;
+	int type;
+	int opt;
+	uint16_t mv;
+	while ((opt = getopt(argc, argv, "t:d:n:js:H:")) != -1) {
+		switch (opt) {
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'd':
+			maxdepth = atoi(optarg);
+			break;
+		case 'n':
+			maxnodes = strtoull(optarg, NULL, 10);
+			break;
+		case 'j':
+			json = 1;
+			break;
+		case 's':
+			tb_init(optarg);
+			tb_probe_limit = tb_largest;
+			break;
+		case 'H':
+			hash_mb = strtoull(optarg, NULL, 10);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-t threads] [-d depth] "
+					"[-n nodes] [-j] [-s syzygy path] "
+					"[-H hash] [file]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+	if (maxdepth < 1)
+		maxdepth = 1;
+	if ((optind < argc) && ((in = fopen(argv[optind], "r")) == NULL)) {
+		perror(argv[optind]);
+		return EXIT_FAILURE;
+	}
+	queue.size = 2 * nthreads;
+	queue.games = malloc(queue.size * sizeof(struct game_t *));
+	threads = malloc(nthreads * sizeof(pthread_t));
+	for (int i = 0; i < nthreads; ++i)
+		pthread_create(&threads[i], NULL, worker, NULL);
+	game = new_game(number);
+	pos = game->start;
+	while ((type = read_token(in, token)) != TOKEN_EOF) {
+		/* a tag after movetext starts a game that had no result */
+		if ((type == TOKEN_TAG) && movetext) {
+			queue_push(game);
+			game = new_game(++number);
+			movetext = 0;
+			skip = 0;
+		}
+		if (type == TOKEN_TAG) {
+			add_tag(game, token);
+			pos = game->start;
+			continue;
+		}
+		movetext = 1;
+		if (is_result(token)) {
+			strcpy(game->result, token);
+			queue_push(game);
+			game = new_game(++number);
+			pos = game->start;
+			movetext = 0;
+			skip = 0;
+			continue;
+		}
+		/* move numbers */
+		if (strspn(token, "0123456789") == strlen(token))
+			continue;
+		if (skip)
+			continue;
+		if ((game->plies == MAX_GAME_PLIES)
+				|| !(mv = parse_san(&pos, token))) {
+			fprintf(stderr, "Game %lu: %s \"%s\", ignoring the rest "
+					"of the game\n", game->number,
+					(game->plies == MAX_GAME_PLIES)
+					? "too many moves at" : "illegal move",
+					token);
+			skip = 1;
+			continue;
+		}
+		game->moves[game->plies++] = mv;
+		make_move(&pos, mv);
+	}
+	if (movetext || game->taglength)
+		queue_push(game);
+	else
+		free(game);
+	queue_close();
+	for (int i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	free(queue.games);
+#ifdef SEARCH_STATS
+	stats_print_json(stderr, &total_stats);
+#endif
+	if (in != stdin)
+		fclose(in);
+	tb_free();
+	return 0;
+}
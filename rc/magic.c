@@ -1,29 +1,67 @@
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
 #include <assert.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #if !defined(FIND_ITER)
     #define FIND_ITER 4096
 #endif
 #if !defined(ORDER_ITER)
-    #define ORDER_ITER 65536
+    #define ORDER_ITER 4096
 #endif
+#if !defined(ANNEAL_CHAINS)
+    #define ANNEAL_CHAINS 16
+#endif
+#if !defined(ANNEAL_ITER)
+    #define ANNEAL_ITER 2048
+#endif
+#if !defined(ANNEAL_THRESHOLD)
+    #define ANNEAL_THRESHOLD 4096
+#endif
+#if !defined(MAX_THREADS)
+    #define MAX_THREADS 256
+#endif
+
+/*
+ * Usage: magic [threads] [seed]
+ * The rounds of the magic search (one square and piece type each), the
+ * random orderings and the annealing chains are shared out between the
+ * threads. Each one draws from a generator seeded from the seed and its own
+ * number, and ties are broken by that number, so the tables depend only on
+ * the seed and not on the threads
+ */
+
+/* number of the first ordering, after the FIND_ITER * 64 * 2 search rounds */
+#define ORDER_JOB (FIND_ITER * 64 * 2)
+/* number of the first annealing chain */
+#define ANNEAL_JOB (ORDER_JOB + ORDER_ITER)
+
+uint64_t seed = 1;
+
+/* splitmix64 */
+uint64_t random_u64(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
 
-uint64_t random_u64()
+uint64_t randomfew(uint64_t *state)
 {
-	uint64_t u1, u2, u3, u4;
-	u1 = (uint64_t)(random()) & 0xffff;
-	u2 = (uint64_t)(random()) & 0xffff;
-	u3 = (uint64_t)(random()) & 0xffff;
-	u4 = (uint64_t)(random()) & 0xffff;
-	return u1 | (u2 << 16) | (u3 << 32) | (u4 << 48);
+	return random_u64(state) & random_u64(state) & random_u64(state);
 }
 
-uint64_t randomfew()
+/* Returns the starting generator state of a round or ordering */
+uint64_t job_state(long job)
 {
-	return random_u64() & random_u64() & random_u64();
+	uint64_t state = seed ^ ((uint64_t)job * 0xd1b54a32d192ed03ull);
+	random_u64(&state);
+	return state;
 }
 
 int popcount(uint64_t bb)
@@ -142,21 +180,33 @@ uint64_t batt(int sq, uint64_t block)
 	return result;
 }
 
-uint64_t used[4096];
-uint64_t attacktable[2 * 64 * 4096];
 uint64_t bmagic[64], rmagic[8][64];
 int bcost[64], rcost[8][64];
+long bjob[64], rjob[8][64];
 uint64_t bused[64][4096], rused[8][64][4096];
 typedef struct {
-	int bindex[64];
-	int rindex[64];
+	/* order in which the tables are placed */
+	int rorder[64];
+	int border[64];
+	/* which of the eight rook magics of a square is used */
 	int whichr[64];
+	/* where the tables were placed */
+	int rindex[64];
+	int bindex[64];
 } conf_t;
-conf_t testconf;
+conf_t bestconf, startconf;
+int bestsize = 9999999;
+long bestjob = 0;
+
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+long nextjob = 0;
+int nthreads = 1;
 
-uint64_t find_magic(int sq, int bishop)
+uint64_t find_magic(int sq, int bishop, uint64_t *state, uint64_t *used)
 {
 	uint64_t mask, block[4096], attack[4096], magic;
+	/* round in which a slot was last written, saves clearing used[] */
+	uint32_t seen[4096] = { 0 };
 	unsigned int i, j, k, mbits, fail;
 	mask = bishop? bmask(sq) : rmask(sq);
 	mbits = popcount(mask);
@@ -165,22 +215,27 @@ uint64_t find_magic(int sq, int bishop)
 	for (i = 0; i < (1 << mbits); ++i) 
 		attack[i] = bishop? batt(sq, block[i]) : ratt(sq, block[i]);
 	for (k = 0; k < 100000000; ++k) {
-		magic = randomfew();
+		magic = randomfew(state);
 		fail = 0;
-		for (i = 0; i < 4096; ++i) used[i] = 0ull;
 		for (i = 0; !fail && (i < (1 << mbits)); ++i) {
 			j = (block[i] * magic) >> (bishop? 55 : 52);
-			if (used[j] == 0ull) used[j] = attack[i];
+			if (seen[j] != k + 1) {
+				seen[j] = k + 1;
+				used[j] = attack[i];
+			}
 			else if (used[j] != attack[i]) fail = 1;
 		}
-		if (!fail) 
+		if (!fail) {
+			for (i = 0; i < 4096; ++i)
+				if (seen[i] != k + 1) used[i] = 0ull;
 			return magic;
+		}
 	}
 	fputs("/***Failed***/\n", stderr);
 	return -1;
 }
 
-int calccost()
+int calccost(const uint64_t *used)
 {
 	int gaps = 0, open = 0, length = 0, run = 0;
 	/* gaps - runs of empty indices */
@@ -200,17 +255,32 @@ int calccost()
 	return (2 * length) - open + gaps;
 }
 
-int insertcost(int cost, int sq)
+/* Orders candidates by cost, then by the round that found them */
+int cheaper(int cost, long job, int oldcost, long oldjob)
 {
-	for (int i = 0; i < 8; ++i) {
-		if (rcost[i][sq] > cost) {
-			for (int j = 7; j > i; --j)
-				rcost[j][sq] = rcost[j + 1][sq];
-			rcost[i][sq] = cost;
-			return i;
-		}
+	return (cost < oldcost) || ((cost == oldcost) && (job < oldjob));
+}
+
+/* Keeps the eight cheapest rook magics of a square, returns the place or 8 */
+int insertrook(int sq, int cost, long job, uint64_t magic, const uint64_t *used)
+{
+	int i;
+	for (i = 0; i < 8; ++i)
+		if (cheaper(cost, job, rcost[i][sq], rjob[i][sq]))
+			break;
+	if (i == 8)
+		return 8;
+	for (int j = 7; j > i; --j) {
+		rcost[j][sq] = rcost[j - 1][sq];
+		rjob[j][sq] = rjob[j - 1][sq];
+		rmagic[j][sq] = rmagic[j - 1][sq];
+		memcpy(rused[j][sq], rused[j - 1][sq], sizeof(rused[j][sq]));
 	}
-	return 8;
+	rcost[i][sq] = cost;
+	rjob[i][sq] = job;
+	rmagic[i][sq] = magic;
+	memcpy(rused[i][sq], used, sizeof(rused[i][sq]));
+	return i;
 }
 
 void printbb(uint64_t bb)
@@ -230,18 +300,21 @@ void printtable(char *name, uint64_t *table, int index)
 {
 	puts(name);
 	for (int i = 0; i < index; ++i)
-		printf("\t0x%llx,\n", table[i]);
+		printf("\t0x%llx,\n", (unsigned long long)table[i]);
 	puts("};");
 }
 
-void order()
+void order(conf_t *conf, uint64_t *state)
 {
 	/* select 64 magics and place them in an order */
 	int num = 0;
-	uint64_t rand0 = random_u64();
-	uint64_t rand1 = random_u64();
-	uint64_t rand2 = random_u64();
-	for (int i = 0; i < 64; ++i) testconf.bindex[i] = 0;
+	uint64_t rand0 = random_u64(state);
+	uint64_t rand1 = random_u64(state);
+	uint64_t rand2 = random_u64(state);
+	for (int i = 0; i < 64; ++i) {
+		conf->rorder[i] = -1;
+		conf->border[i] = i;
+	}
 	for (int i = 0; i < 64; ++i) {
 		num = 0;
 		if (rand0 & (1ull << i))
@@ -251,109 +324,274 @@ void order()
 		if (rand2 & (1ull << i))
 			num += 4;
 		while (!rmagic[num][i]) --num; /*no 0s plz :(*/
-		testconf.whichr[i] = num;
+		conf->whichr[i] = num;
 	}
 	for (int i = 0; i < 64; ++i) {
 		do {
-			num = rand() % 64;
-		} while (testconf.bindex[num]);
-		testconf.bindex[num] = i;
-		/* bindex holds the order in which the rook tables will be inserted */
+			num = random_u64(state) % 64;
+		} while (conf->rorder[num] != -1);
+		conf->rorder[num] = i;
 	}
 }
 
-void cpused(int bishop, int sq, int index)
+/* Swaps two squares in one of the orders or changes one rook magic */
+void mutate(conf_t *conf, uint64_t *state)
+{
+	int a = random_u64(state) % 64;
+	int b = random_u64(state) % 64;
+	int tmp;
+	switch (random_u64(state) % 3) {
+	case 0:
+		tmp = conf->rorder[a];
+		conf->rorder[a] = conf->rorder[b];
+		conf->rorder[b] = tmp;
+		break;
+	case 1:
+		tmp = conf->border[a];
+		conf->border[a] = conf->border[b];
+		conf->border[b] = tmp;
+		break;
+	case 2:
+		tmp = random_u64(state) % 8;
+		while (!rmagic[tmp][a]) --tmp;
+		conf->whichr[a] = tmp;
+		break;
+	}
+}
+
+/*
+ * The orderings only need to know which slots of a table are used, these
+ * are kept as bitsets so a placement is tested 64 slots at a time
+ */
+#define TABLE_SLOTS (2 * 64 * 4096)
+#define TABLE_WORDS (TABLE_SLOTS / 64 + 1)
+uint64_t bbits[64][512 / 64], rbits[8][64][4096 / 64];
+
+void build_bits()
 {
-	for (int i = 0; i < 4096; ++i)
-		bishop?
-		(bused[sq][i] = used[i]):
-		(rused[index][sq][i] = used[i]);
+	for (int sq = 0; sq < 64; ++sq) {
+		for (int i = 0; i < 512; ++i)
+			if (bused[sq][i])
+				bbits[sq][i / 64] |= 1ull << (i % 64);
+		for (int j = 0; j < 8; ++j)
+			for (int i = 0; i < 4096; ++i)
+				if (rused[j][sq][i])
+					rbits[j][sq][i / 64] |= 1ull << (i % 64);
+	}
 }
 
-int destructive(int bishop, int sq, int index)
+int destructive(const uint64_t *table, const uint64_t *bits, int words,
+		int index)
 {
-	uint64_t *arr = bishop? bused[sq] : rused[testconf.whichr[sq]][sq];
-	for (int i = 0; i < 4096; ++i)
-		if (attacktable[index + i] && arr[i])
+	int w = index / 64, s = index % 64;
+	uint64_t window;
+	for (int i = 0; i < words; ++i) {
+		window = table[w + i] >> s;
+		if (s)
+			window |= table[w + i + 1] << (64 - s);
+		if (window & bits[i])
 			return 1;
+	}
 	return 0;
 }
 
-int try()
+/* Places a table at the first slot where it fits, returns the slot */
+int place(uint64_t *table, const uint64_t *bits, int words)
 {
 	int index = 127 * 4096;
-	int whichr;
-	for (int i = 0; i < 2 * 64 * 4096; ++i) attacktable[i] = 0;
-	for (int i = 0; i < 64; ++i) {
-		whichr = testconf.whichr[testconf.bindex[i]];
-		for (int k = 0; k < 127 * 4096; ++k) {
-			if (!destructive(0, testconf.bindex[i], k)) {
-				index = k;
-				break;
-			}
+	int w, s;
+	for (int k = 0; k < 127 * 4096; ++k) {
+		if (!destructive(table, bits, words, k)) {
+			index = k;
+			break;
 		}
-		testconf.rindex[testconf.bindex[i]] = index;
-		for (int j = 0; j < 4096; ++j)
-			if (rused[whichr][i][j])
-				attacktable[index + j] = 1;
+	}
+	w = index / 64;
+	s = index % 64;
+	for (int i = 0; i < words; ++i) {
+		table[w + i] |= bits[i] << s;
+		if (s)
+			table[w + i + 1] |= bits[i] >> (64 - s);
+	}
+	return index;
+}
+
+int try(conf_t *conf, uint64_t *table)
+{
+	int index = 0;
+	int sq;
+	for (int i = 0; i < TABLE_WORDS; ++i) table[i] = 0;
+	for (int i = 0; i < 64; ++i) {
+		sq = conf->rorder[i];
+		conf->rindex[sq] = place(table, rbits[conf->whichr[sq]][sq],
+				4096 / 64);
 	}
 	for (int i = 0; i < 64; ++i) {
-		for (int k = 0; k < 127 * 4096; ++k) {
-			if (!destructive(1, i, k)) {
-				index = k;
-				break;
-			}
-		}
-		testconf.bindex[i] = index;
-		for (int j = 0; j < 4096; ++j)
-			if (bused[i][j])
-				attacktable[index + j] = 1;
+		sq = conf->border[i];
+		conf->bindex[sq] = place(table, bbits[sq], 512 / 64);
 	}
-	for (int i = 0; i < 2 * 64 * 4096; ++i)
-		if (attacktable[i])
-			index = i;
+	for (int i = 0; i < TABLE_WORDS; ++i)
+		if (table[i])
+			index = (i * 64) + 63 - __builtin_clzll(table[i]);
 	return index;
 }
 
-int main()
+/* Returns the next round or ordering to work on, -1 when there are none */
+long take_job(long last)
 {
-	int rindex = 0;
+	long job;
+	pthread_mutex_lock(&lock);
+	job = (nextjob < last) ? nextjob++ : -1;
+	pthread_mutex_unlock(&lock);
+	return job;
+}
+
+void *search_worker(void *arg)
+{
+	uint64_t used[4096];
+	uint64_t magic, state;
+	int sq, bishop, cost, num;
+	long job;
+	(void)arg;
+	while ((job = take_job(ORDER_JOB)) >= 0) {
+		bishop = job & 1;
+		sq = (job >> 1) % 64;
+		state = job_state(job);
+		magic = find_magic(sq, bishop, &state, used);
+		cost = calccost(used);
+		pthread_mutex_lock(&lock);
+		if (!bishop && (num = insertrook(sq, cost, job, magic, used)) != 8) {
+			printf(
+	"Improved rook magic \tcost:%-10dsq:%-5di:%ld\n", cost, sq, job >> 7);
+		} else if (bishop && cheaper(cost, job, bcost[sq], bjob[sq])) {
+			bcost[sq] = cost;
+			bjob[sq] = job;
+			bmagic[sq] = magic;
+			memcpy(bused[sq], used, sizeof(bused[sq]));
+			printf(
+	"Improved bishop magic \tcost:%-10dsq:%-5di:%ld\n", cost, sq, job >> 7);
+		}
+		pthread_mutex_unlock(&lock);
+	}
+	return NULL;
+}
+
+void *order_worker(void *arg)
+{
+	uint64_t *table = malloc(TABLE_WORDS * sizeof(uint64_t));
+	uint64_t state;
+	conf_t conf;
 	int num;
-	int bestsize = 9999999;
-	uint64_t magic;
-	conf_t bestconf;
-	for (int i = 0; i < 64; ++i) {
-		bcost[i] = 8193;
-		for (int j = 0; j < 8; ++j)
-			rcost[j][i] = 8193;
+	long job;
+	(void)arg;
+	if (table == NULL) {
+		fputs("/***Out of memory***/\n", stderr);
+		return NULL;
 	}
-	for (int i = 0; i < FIND_ITER; ++i) {
-		for (int sq = 0; sq < 64; ++sq) {
-			magic = find_magic(sq, 0);
-			if ((num = insertcost(calccost(), sq)) != 8) {
-				rmagic[num][sq] = magic;
-				printf(
-	"Improved rook magic \tcost:%-10dsq:%-5di:%d\n", rcost[num][sq], sq, i);
-				cpused(0, sq, num);
-			}
-			magic = find_magic(sq, 1);
-			if ((num = calccost()) < bcost[sq]) {
-				bcost[sq] = num;
-				bmagic[sq] = magic;
-				printf(
-	"Improved bishop magic \tcost:%-10dsq:%-5di:%d\n", num, sq, i);
-				cpused(1, sq, 0);
+	while ((job = take_job(ANNEAL_JOB)) >= 0) {
+		state = job_state(job);
+		order(&conf, &state);
+		num = try(&conf, table);
+		pthread_mutex_lock(&lock);
+		if (cheaper(num, job, bestsize, bestjob)) {
+			printf("Improved size from %-8d to %-8d i:%ld\n", bestsize,
+					num, job - ORDER_JOB);
+			bestsize = num;
+			bestjob = job;
+			bestconf = conf;
+		}
+		pthread_mutex_unlock(&lock);
+	}
+	free(table);
+	return NULL;
+}
+
+/*
+ * Threshold accepting from the best ordering: a mutation is kept unless it
+ * grows the table by more than a threshold that falls linearly to zero over
+ * the chain, the smallest table seen is reported at the end
+ */
+void *anneal_worker(void *arg)
+{
+	uint64_t *table = malloc(TABLE_WORDS * sizeof(uint64_t));
+	uint64_t state;
+	conf_t conf, next, best;
+	int size, cursize, bestsize_chain;
+	long threshold;
+	long job;
+	(void)arg;
+	if (table == NULL) {
+		fputs("/***Out of memory***/\n", stderr);
+		return NULL;
+	}
+	while ((job = take_job(ANNEAL_JOB + ANNEAL_CHAINS)) >= 0) {
+		state = job_state(job);
+		conf = startconf;
+		best = conf;
+		cursize = bestsize_chain = try(&conf, table);
+		for (long i = 0; i < ANNEAL_ITER; ++i) {
+			threshold = (long)ANNEAL_THRESHOLD * (ANNEAL_ITER - i)
+				/ ANNEAL_ITER;
+			next = conf;
+			mutate(&next, &state);
+			size = try(&next, table);
+			if (size > cursize + threshold)
+				continue;
+			conf = next;
+			cursize = size;
+			if (size < bestsize_chain) {
+				bestsize_chain = size;
+				best = next;
 			}
 		}
+		pthread_mutex_lock(&lock);
+		if (cheaper(bestsize_chain, job, bestsize, bestjob)) {
+			printf("Improved size from %-8d to %-8d chain:%ld\n",
+					bestsize, bestsize_chain, job - ANNEAL_JOB);
+			bestsize = bestsize_chain;
+			bestjob = job;
+			bestconf = best;
+		}
+		pthread_mutex_unlock(&lock);
 	}
-	for (int i = 0; i < ORDER_ITER; ++i) {
-		order();
-		if ((num = try()) < bestsize) {
-			printf("Improved size from %-8d to %-8d i:%d\n", bestsize, num, i);
-			bestsize = num;
-			bestconf = testconf;
+	free(table);
+	return NULL;
+}
+
+void run_workers(void *(*worker)(void *))
+{
+	pthread_t threads[MAX_THREADS];
+	for (int i = 0; i < nthreads; ++i)
+		pthread_create(&threads[i], NULL, worker, NULL);
+	for (int i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+}
+
+int main(int argc, char **argv)
+{
+	nthreads = (argc > 1) ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > MAX_THREADS)
+		nthreads = MAX_THREADS;
+	if (argc > 2)
+		seed = strtoull(argv[2], NULL, 0);
+	for (int i = 0; i < 64; ++i) {
+		bcost[i] = 8193;
+		bjob[i] = ORDER_JOB;
+		for (int j = 0; j < 8; ++j) {
+			rcost[j][i] = 8193;
+			rjob[j][i] = ORDER_JOB;
 		}
 	}
+	run_workers(search_worker);
+	build_bits();
+	nextjob = ORDER_JOB;
+	bestjob = ANNEAL_JOB;
+	run_workers(order_worker);
+	startconf = bestconf;
+	nextjob = ANNEAL_JOB;
+	run_workers(anneal_worker);
 	for (int i = 0; i < 64; ++i)
 		rmagic[0][i] = rmagic[bestconf.whichr[i]][i];
 	printf("Best table size: %d KiB\n", bestsize * 8 / 1024);
@@ -1,13 +1,55 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "headers/chess.h"
 #include "headers/search.h"
+#include "headers/tbprobe.h"
+#include "headers/timeman.h"
+
+/*
+ * Move ordering scores, quiet moves are ordered by history which stays
+ * within +-HISTORY_MAX
+ */
+#define ORDER_FIRST 0x7fffffff
+#define ORDER_CAPTURE 0x200000
+#define ORDER_PROMOTION 0x100000
+#define HISTORY_MAX 0x4000
+
+/*
+ * Selective search limits, depths are the deepest (or for null move and late
+ * move reductions the shallowest) remaining depth the technique is used at,
+ * margins are in centipawns per ply of remaining depth
+ */
+#define NULL_MOVE_DEPTH 3
+#define NULL_MOVE_REDUCTION 2
+#define LMR_DEPTH 3
+#define LMR_MOVES 3
+#define REVERSE_FUTILITY_DEPTH 3
+#define REVERSE_FUTILITY_MARGIN 120
+#define FUTILITY_DEPTH 2
+#define FUTILITY_MARGIN 150
+#define RAZOR_DEPTH 2
+#define RAZOR_MARGIN 300
+
+/*
+ * Iterations from ASPIRATION_DEPTH on search a window of +-ASPIRATION_WINDOW
+ * around the last score, doubling the side that fails until it passes
+ * ASPIRATION_MAX
+ */
+#define ASPIRATION_DEPTH 4
+#define ASPIRATION_WINDOW 25
+#define ASPIRATION_MAX 1000
 
 unsigned long long perft(struct position_t *posPtr, int depth)
 {
 	uint16_t movelist[MAX_MOVES + 1];
 	unsigned long long total = 0;
 	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	/* the last ply is counted, not played */
+	if (depth == 1)
+		return was_legal(posPtr) ? count_moves(posPtr) : 0;
 	movelist[0] = 0;
-	generate_moves(*posPtr, movelist);
+	generate_moves(posPtr, movelist);
 	for (int i = 1; i <= movelist[0]; i++) 
 		if (((movelist[i] & END_SQUARE) >> 6) 
 				== posPtr->kingpos[BLACK - color])
@@ -21,3 +63,608 @@ unsigned long long perft(struct position_t *posPtr, int depth)
 	}
 	return total;
 }
+
+unsigned long long get_time_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((unsigned long long)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+/*
+ * Moves mate and tablebase scores one ply closer to zero, so that shorter
+ * wins and longer losses are preferred
+ */
+static signed age_score(signed score)
+{
+	if (score > TB_WIN_SCORE - MAX_PLY)
+		return score - 1;
+	if (score < -(TB_WIN_SCORE - MAX_PLY))
+		return score + 1;
+	return score;
+}
+
+/* Sets the stop flag once the node or time limit is reached */
+static int limit_reached(struct search_t *searchPtr)
+{
+	if (searchPtr->stop)
+		return 1;
+	if ((searchPtr->maxnodes != 0)
+			&& (searchPtr->nodes >= searchPtr->maxnodes)) {
+		searchPtr->stop = 1;
+		return 1;
+	}
+	/* reading the clock is slow, only check it every 1024 nodes */
+	if ((searchPtr->deadline != 0) && !(searchPtr->nodes & 1023)
+			&& (get_time_ms() >= searchPtr->deadline)) {
+		searchPtr->stop = 1;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Returns non-zero if a position in the search is a draw, the fifty move rule
+ * gives way to a checkmate on the hundredth halfmove
+ */
+static int is_draw(struct position_t *posPtr, int ply)
+{
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	if (posPtr->fiftymove >= 100)
+		return !(posPtr->flags & (color ? BLACK_CHECK : WHITE_CHECK))
+			|| count_moves(posPtr);
+	return is_repetition(posPtr, ply) || insufficient_material(posPtr);
+}
+
+/* Captures and promotions are searched by the quiescence search */
+static int is_quiet(uint16_t mv)
+{
+	return !(mv & (CAPTURE_MOVE | KNIGHT_PROMOTION));
+}
+
+static int piece_on(const struct position_t *posPtr, int color, int sq)
+{
+	for (int i = PAWN; i <= KING; ++i)
+		if (posPtr->pieces[color][i] & (1ull << sq))
+			return i;
+	return 0;
+}
+
+/*
+ * Gives each move of a list an ordering score: first the move from the
+ * previous iteration, then captures by most valuable victim and least
+ * valuable attacker, then promotions, then quiet moves by their history
+ */
+static void score_moves(const struct search_t *searchPtr,
+		const struct position_t *posPtr, const uint16_t *movelist,
+		int *scores, uint16_t first)
+{
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	int start;
+	int end;
+	int victim;
+	uint16_t mv;
+	for (int i = 1; i <= movelist[0]; ++i) {
+		mv = movelist[i];
+		start = mv & START_SQUARE;
+		end = (mv & END_SQUARE) >> 6;
+		if (mv == first) {
+			scores[i] = ORDER_FIRST;
+		} else if (mv & CAPTURE_MOVE) {
+			victim = ((mv & QUEEN_CAPTURE_PROMOTION) == EP_CAPTURE)
+				? PAWN : piece_on(posPtr, BLACK - color, end);
+			scores[i] = ORDER_CAPTURE + (victim * 8)
+				- piece_on(posPtr, color, start);
+		} else if (mv & KNIGHT_PROMOTION) {
+			scores[i] = ORDER_PROMOTION + ((mv >> 12) & 3);
+		} else {
+			scores[i] = searchPtr->history[color][start][end];
+		}
+	}
+}
+
+/* Returns non-zero if a root move is left out of the search */
+static int is_excluded(const struct search_t *searchPtr, uint16_t mv)
+{
+	for (int i = 1; i <= searchPtr->excluded[0]; ++i)
+		if (searchPtr->excluded[i] == mv)
+			return 1;
+	return 0;
+}
+
+/* Selection sort step, moves the best scored move left to index i */
+static uint16_t next_move(uint16_t *movelist, int *scores, int i)
+{
+	int best = i;
+	int tmp;
+	uint16_t mv;
+	for (int j = i + 1; j <= movelist[0]; ++j)
+		if (scores[j] > scores[best])
+			best = j;
+	mv = movelist[best];
+	movelist[best] = movelist[i];
+	movelist[i] = mv;
+	tmp = scores[best];
+	scores[best] = scores[i];
+	scores[i] = tmp;
+	return mv;
+}
+
+/* Moves the history of a move towards bonus, keeping it within HISTORY_MAX */
+static void add_history(struct search_t *searchPtr, int color, uint16_t mv,
+		int bonus)
+{
+	int *h = &searchPtr->history[color][mv & START_SQUARE]
+		[(mv & END_SQUARE) >> 6];
+	*h += bonus - ((*h) * abs(bonus) / HISTORY_MAX);
+}
+
+/* Makes mv followed by the line of the child node the line of ply */
+static void update_pv(struct search_t *searchPtr, int ply, uint16_t mv)
+{
+	uint16_t *row = searchPtr->pvtable[ply];
+	const uint16_t *child = searchPtr->pvtable[ply + 1];
+	int length = searchPtr->pvlength[ply + 1];
+	row[ply] = mv;
+	for (int i = ply + 1; i < length; ++i)
+		row[i] = child[i];
+	searchPtr->pvlength[ply] = (length > ply + 1) ? length : (ply + 1);
+}
+
+static int non_pawn_material(const struct position_t *posPtr, int color)
+{
+	return (posPtr->pieces[color][KNIGHT] | posPtr->pieces[color][BISHOP]
+			| posPtr->pieces[color][ROOK]
+			| posPtr->pieces[color][QUEEN]) != 0;
+}
+
+static signed quiesce(struct search_t *searchPtr, struct position_t *posPtr,
+		int ply, signed alpha, signed beta)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	int scores[MAX_MOVES + 1];
+	struct check_info_t ci;
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	int incheck = posPtr->flags & (color ? BLACK_CHECK : WHITE_CHECK);
+	int legal = 0;
+	signed score;
+	uint16_t mv;
+	searchPtr->pvlength[ply] = ply;
+	if (limit_reached(searchPtr))
+		return 0;
+	++searchPtr->nodes;
+	STATS_INC(searchPtr, qnodes);
+	if (ply >= MAX_PLY - 1)
+		return evaluate(posPtr);
+	/* the side to move can usually do at least as well as standing pat */
+	if (!incheck) {
+		score = evaluate(posPtr);
+		if (score >= beta)
+			return beta;
+		if (score > alpha)
+			alpha = score;
+	}
+	movelist[0] = 0;
+	generate_moves(posPtr, movelist);
+	get_check_info(posPtr, &ci);
+	score_moves(searchPtr, posPtr, movelist, scores, 0);
+	for (int i = 1; i <= movelist[0]; ++i) {
+		mv = next_move(movelist, scores, i);
+		/* quiet moves are sorted last, only check evasions need them */
+		if (!incheck && is_quiet(mv))
+			break;
+		if (!is_legal(posPtr, &ci, mv))
+			continue;
+		++legal;
+		make_move(posPtr, mv);
+		score = age_score(-quiesce(searchPtr, posPtr, ply + 1, -beta,
+					-alpha));
+		unmake_move(posPtr, mv);
+		if (searchPtr->stop)
+			return 0;
+		if (score >= beta)
+			return beta;
+		if (score > alpha)
+			alpha = score;
+	}
+	if (incheck && (legal == 0))
+		return -MATE_SCORE;
+	return alpha;
+}
+
+signed negamax(struct search_t *searchPtr, struct position_t *posPtr,
+		int depth, int ply, signed alpha, signed beta)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	int scores[MAX_MOVES + 1];
+	uint16_t quiets[MAX_MOVES];
+	struct check_info_t ci;
+	struct tt_hit_t hit;
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	int incheck = posPtr->flags & (color ? BLACK_CHECK : WHITE_CHECK);
+	int nquiets = 0;
+	int legal = 0;
+	int futile = 0;
+	int givescheck;
+	int reduction;
+	int success;
+	signed eval;
+	signed score;
+	uint16_t ttmove = 0;
+	uint16_t best = 0;
+	uint16_t mv;
+	searchPtr->pvlength[ply] = ply;
+	if (is_draw(posPtr, ply)) {
+		STATS_INC(searchPtr, draws);
+		return 0;
+	}
+	if (depth <= 0)
+		return quiesce(searchPtr, posPtr, ply, alpha, beta);
+	if (limit_reached(searchPtr))
+		return 0;
+	++searchPtr->nodes;
+	if (searchPtr->tt != NULL) {
+		STATS_INC(searchPtr, tt_probes);
+		if (tt_probe(searchPtr->tt, posPtr->hash, &hit)) {
+			STATS_INC(searchPtr, tt_hits);
+			ttmove = hit.move;
+			/* an exact score inside the window would cut the pv short */
+			if ((hit.depth >= depth) && (((hit.bound & TT_LOWER)
+						&& (hit.score >= beta))
+					|| ((hit.bound & TT_UPPER)
+						&& (hit.score <= alpha)))) {
+				STATS_INC(searchPtr, tt_cutoffs);
+				return (hit.score >= beta) ? beta : alpha;
+			}
+		}
+	}
+	/* WDL values assume the fifty move counter was just reset */
+	if ((tb_largest != 0) && (posPtr->fiftymove == 0)
+			&& !(posPtr->flags & BOTH_BOTH_CASTLE)
+			&& (popcount(posPtr->occupied) <= tb_probe_limit)) {
+		score = tb_probe_wdl(posPtr, &success);
+		if (success) {
+			if (score == TB_WIN)
+				return TB_WIN_SCORE;
+			if (score == TB_LOSS)
+				return -TB_WIN_SCORE;
+			/* cursed wins and blessed losses are draws */
+			return score;
+		}
+	}
+	if (ply >= MAX_PLY - 1)
+		return evaluate(posPtr);
+	eval = evaluate(posPtr);
+	/* pruning is unsound near mate scores and when in check */
+	if (!incheck && (abs(beta) < TB_WIN_SCORE - MAX_PLY)) {
+		if (!(searchPtr->disabled & PRUNE_REVERSE_FUTILITY)
+				&& (depth <= REVERSE_FUTILITY_DEPTH)
+				&& (eval - (REVERSE_FUTILITY_MARGIN * depth)
+					>= beta))
+			return eval;
+		if (!(searchPtr->disabled & PRUNE_RAZORING)
+				&& (depth <= RAZOR_DEPTH)
+				&& (eval + (RAZOR_MARGIN * depth) < alpha)) {
+			score = quiesce(searchPtr, posPtr, ply, alpha, beta);
+			if (searchPtr->stop)
+				return 0;
+			if (score <= alpha)
+				return score;
+		}
+		/*
+		 * Passing is only allowed once in a row, and not without
+		 * pieces where zugzwang is common
+		 */
+		if (!(searchPtr->disabled & PRUNE_NULL_MOVE)
+				&& (depth >= NULL_MOVE_DEPTH) && (eval >= beta)
+				&& (ply > 0) && searchPtr->line[ply - 1]
+				&& non_pawn_material(posPtr, color)) {
+			STATS_INC(searchPtr, null_tries);
+			searchPtr->line[ply] = 0;
+			make_null_move(posPtr);
+			score = -negamax(searchPtr, posPtr, depth - 1
+					- NULL_MOVE_REDUCTION - (depth >= 6),
+					ply + 1, -beta, -beta + 1);
+			unmake_null_move(posPtr);
+			if (searchPtr->stop)
+				return 0;
+			if (score >= beta) {
+				STATS_INC(searchPtr, null_cutoffs);
+				if (searchPtr->tt != NULL)
+					tt_store(searchPtr->tt, posPtr->hash, 0,
+							beta, depth, TT_LOWER);
+				return beta;
+			}
+		}
+		futile = !(searchPtr->disabled & PRUNE_FUTILITY)
+			&& (depth <= FUTILITY_DEPTH)
+			&& (abs(alpha) < TB_WIN_SCORE - MAX_PLY)
+			&& (eval + (FUTILITY_MARGIN * depth) <= alpha);
+	}
+	movelist[0] = 0;
+	generate_moves(posPtr, movelist);
+	get_check_info(posPtr, &ci);
+	score_moves(searchPtr, posPtr, movelist, scores, ttmove);
+	for (int i = 1; i <= movelist[0]; ++i) {
+		mv = next_move(movelist, scores, i);
+		if (!is_legal(posPtr, &ci, mv))
+			continue;
+		++legal;
+		givescheck = gives_check(posPtr, &ci, mv);
+		/* quiet moves can't raise a hopeless score near the leaves */
+		if (futile && (legal > 1) && is_quiet(mv) && !givescheck)
+			continue;
+		make_move(posPtr, mv);
+		searchPtr->line[ply] = mv;
+		reduction = 0;
+		if (!(searchPtr->disabled & PRUNE_LMR) && (depth >= LMR_DEPTH)
+				&& (legal > LMR_MOVES) && !incheck
+				&& !givescheck && is_quiet(mv)) {
+			reduction = 1 + (legal > 3 * LMR_MOVES) + (depth >= 6);
+			if (scores[i] > HISTORY_MAX / 2)
+				--reduction;
+			else if (scores[i] < 0)
+				++reduction;
+			if (reduction > depth - 2)
+				reduction = depth - 2;
+		}
+		/* a reduced move that beats alpha is searched again in full */
+		score = alpha + 1;
+		if (reduction > 0)
+			score = age_score(-negamax(searchPtr, posPtr,
+						depth - 1 - reduction, ply + 1,
+						-alpha - 1, -alpha));
+		if (score > alpha)
+			score = age_score(-negamax(searchPtr, posPtr, depth - 1,
+						ply + 1, -beta, -alpha));
+		unmake_move(posPtr, mv);
+		if (searchPtr->stop)
+			return 0;
+		if (score >= beta) {
+			STATS_INC(searchPtr, beta_cutoffs);
+			if (legal == 1)
+				STATS_INC(searchPtr, first_move_cutoffs);
+			if (is_quiet(mv)) {
+				add_history(searchPtr, color, mv, depth * depth);
+				for (int j = 0; j < nquiets; ++j)
+					add_history(searchPtr, color, quiets[j],
+							-depth * depth);
+			}
+			if (searchPtr->tt != NULL)
+				tt_store(searchPtr->tt, posPtr->hash, mv, beta,
+						depth, TT_LOWER);
+			return beta;
+		}
+		if (is_quiet(mv))
+			quiets[nquiets++] = mv;
+		if (score > alpha) {
+			alpha = score;
+			best = mv;
+			update_pv(searchPtr, ply, mv);
+		}
+	}
+	if (legal == 0)
+		alpha = incheck ? -MATE_SCORE : 0;
+	if (searchPtr->tt != NULL)
+		tt_store(searchPtr->tt, posPtr->hash, best, alpha, depth,
+				(best || (legal == 0)) ? TT_EXACT : TT_UPPER);
+	return alpha;
+}
+
+uint16_t search_root(struct search_t *searchPtr, struct position_t *posPtr,
+		int depth, signed alpha, signed beta, signed *scorePtr)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	int scores[MAX_MOVES + 1];
+	struct check_info_t ci;
+	uint16_t best = 0;
+	signed tbscore;
+	signed score;
+	int tbhit;
+	int legal = 0;
+	uint16_t mv;
+	searchPtr->pvlength[0] = 0;
+	movelist[0] = 0;
+	generate_moves(posPtr, movelist);
+	/* only search the moves that keep the tablebase result */
+	tbhit = (tb_largest != 0) && tb_root_filter(posPtr, movelist, &tbscore);
+	get_check_info(posPtr, &ci);
+	score_moves(searchPtr, posPtr, movelist, scores, 0);
+	for (int i = 1; i <= movelist[0]; ++i)
+		for (int j = 0; j < searchPtr->nlines; ++j)
+			if (movelist[i] == searchPtr->lines[j].move)
+				scores[i] = ORDER_FIRST - j;
+	for (int i = 1; i <= movelist[0]; ++i) {
+		mv = next_move(movelist, scores, i);
+		if (is_excluded(searchPtr, mv) || !is_legal(posPtr, &ci, mv))
+			continue;
+		++legal;
+		make_move(posPtr, mv);
+		searchPtr->line[0] = mv;
+		score = age_score(-negamax(searchPtr, posPtr, depth - 1, 1,
+					-beta, -alpha));
+		unmake_move(posPtr, mv);
+		if (searchPtr->stop)
+			return 0;
+		if (score >= beta) {
+			*scorePtr = beta;
+			return mv;
+		}
+		if (score > alpha) {
+			alpha = score;
+			best = mv;
+			update_pv(searchPtr, 0, mv);
+		}
+	}
+	if (legal == 0) {
+		*scorePtr = ci.checkers ? -MATE_SCORE : 0;
+		return 0;
+	}
+	if (tbhit && best && (alpha < MATE_SCORE - MAX_PLY)
+			&& (alpha > -MATE_SCORE + MAX_PLY))
+		alpha = tbscore;
+	*scorePtr = alpha;
+	return best;
+}
+
+/*
+ * Searches the best root move not excluded yet to a depth, within a window
+ * around the score last had by the line, which widens until the score fits
+ */
+static uint16_t search_line(struct search_t *searchPtr,
+		struct position_t *posPtr, int depth, signed last,
+		signed *scorePtr)
+{
+	signed alpha = -MATE_SCORE - 1;
+	signed beta = MATE_SCORE + 1;
+	signed delta = ASPIRATION_WINDOW;
+	uint16_t mv;
+	if ((depth >= ASPIRATION_DEPTH)
+			&& (abs(last) < TB_WIN_SCORE - MAX_PLY)) {
+		alpha = last - delta;
+		beta = last + delta;
+	}
+	for (;;) {
+		mv = search_root(searchPtr, posPtr, depth, alpha, beta,
+				scorePtr);
+		if (searchPtr->stop)
+			return 0;
+		if ((*scorePtr > alpha) && (*scorePtr < beta))
+			return mv;
+		/* a window of the whole score range can't fail */
+		if ((alpha < -MATE_SCORE) && (beta > MATE_SCORE))
+			return mv;
+		STATS_INC(searchPtr, aspiration_fails);
+		delta *= 2;
+		if (*scorePtr <= alpha)
+			alpha = (delta > ASPIRATION_MAX) ? (-MATE_SCORE - 1)
+				: (*scorePtr - delta);
+		else
+			beta = (delta > ASPIRATION_MAX) ? (MATE_SCORE + 1)
+				: (*scorePtr + delta);
+	}
+}
+
+uint16_t search_position(struct search_t *searchPtr,
+		struct position_t *posPtr, int maxdepth)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	struct pv_line_t found[MAX_MULTIPV];
+	struct pv_line_t tmp;
+	struct check_info_t ci;
+	unsigned long long nodes;
+	unsigned long long now;
+	int stable = 0;
+	int wanted;
+	int nfound;
+	int j;
+	searchPtr->nodes = 0;
+	searchPtr->overshoot = 0;
+	searchPtr->starttime = get_time_ms();
+	searchPtr->depth = 0;
+	searchPtr->bestmove = 0;
+	searchPtr->score = 0;
+	searchPtr->pvsize = 0;
+	searchPtr->nlines = 0;
+	searchPtr->excluded[0] = 0;
+	memset(searchPtr->history, 0, sizeof(searchPtr->history));
+	if (searchPtr->tt != NULL)
+		tt_new_search(searchPtr->tt);
+	STATS_INC(searchPtr, searches);
+	wanted = (searchPtr->multipv > MAX_MULTIPV) ? MAX_MULTIPV
+		: searchPtr->multipv;
+	if ((wanted > 1) && (count_moves(posPtr) < wanted))
+		wanted = count_moves(posPtr);
+	else if (wanted < 1)
+		wanted = 1;
+	/* without legal moves one line still finds mate or stalemate */
+	if (wanted == 0)
+		wanted = 1;
+	for (int depth = 1; depth <= maxdepth; ++depth) {
+		nodes = searchPtr->nodes;
+		/*
+		 * Each line leaves out the moves of the lines before it, the
+		 * table entries of one line order the moves of the next
+		 */
+		for (nfound = 0; nfound < wanted; ++nfound) {
+			found[nfound].move = search_line(searchPtr, posPtr, depth,
+					(nfound < searchPtr->nlines)
+					? searchPtr->lines[nfound].score : 0,
+					&found[nfound].score);
+			if (searchPtr->stop)
+				break;
+			/* the tablebases can leave fewer moves to search */
+			if ((found[nfound].move == 0) && (nfound > 0))
+				break;
+			found[nfound].pvsize = searchPtr->pvlength[0];
+			memcpy(found[nfound].pv, searchPtr->pvtable[0],
+					found[nfound].pvsize * sizeof(uint16_t));
+			searchPtr->excluded[++searchPtr->excluded[0]]
+				= found[nfound].move;
+		}
+		searchPtr->excluded[0] = 0;
+		/* an aborted iteration only searched some of the moves */
+		if (searchPtr->stop)
+			break;
+		if (depth < STATS_MAX_DEPTH) {
+			STATS_INC(searchPtr, iterations[depth]);
+			STATS_ADD(searchPtr, depth_nodes[depth],
+					searchPtr->nodes - nodes);
+		}
+		/* a later line can score better than an earlier one */
+		for (int i = 1; i < nfound; ++i) {
+			tmp = found[i];
+			for (j = i; (j > 0) && (found[j - 1].score < tmp.score);
+					--j)
+				found[j] = found[j - 1];
+			found[j] = tmp;
+		}
+		memcpy(searchPtr->lines, found, nfound * sizeof(found[0]));
+		searchPtr->nlines = nfound;
+		stable = (found[0].move == searchPtr->bestmove)
+			? (stable + 1) : 0;
+		searchPtr->depth = depth;
+		searchPtr->bestmove = found[0].move;
+		searchPtr->score = found[0].score;
+		searchPtr->pvsize = found[0].pvsize;
+		memcpy(searchPtr->pv, found[0].pv,
+				searchPtr->pvsize * sizeof(uint16_t));
+		if (searchPtr->report)
+			searchPtr->report(searchPtr);
+		if ((found[0].move == 0) || time_soft_expired(searchPtr, stable))
+			break;
+	}
+	STATS_ADD(searchPtr, nodes, searchPtr->nodes);
+	/* a search stopped during its first iteration still needs a move */
+	if ((searchPtr->bestmove == 0) && (searchPtr->depth == 0)) {
+		movelist[0] = 0;
+		generate_moves(posPtr, movelist);
+		get_check_info(posPtr, &ci);
+		for (int i = 1; i <= movelist[0]; ++i) {
+			if (is_legal(posPtr, &ci, movelist[i])) {
+				searchPtr->bestmove = movelist[i];
+				searchPtr->score = evaluate(posPtr);
+				break;
+			}
+		}
+	}
+	now = get_time_ms();
+	if (searchPtr->deadline && (now > searchPtr->deadline))
+		searchPtr->overshoot = now - searchPtr->deadline;
+	return searchPtr->bestmove;
+}
+
+void update_game_status(struct position_t *posPtr)
+{
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	posPtr->flags &= ~(GAME_OVER | GAME_DRAWN);
+	if (!count_moves(posPtr)) {
+		posPtr->flags |= GAME_OVER;
+		if (!(posPtr->flags & (color ? BLACK_CHECK : WHITE_CHECK)))
+			posPtr->flags |= GAME_DRAWN;
+	} else if ((posPtr->fiftymove >= 100)
+			|| is_repetition(posPtr, 0)
+			|| insufficient_material(posPtr)) {
+		posPtr->flags |= GAME_OVER | GAME_DRAWN;
+	}
+}
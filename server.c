@@ -0,0 +1,754 @@
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "headers/chess.h"
+#include "headers/engine.h"
+#include "headers/notation.h"
+#include "headers/search.h"
+#include "headers/tt.h"
+
+/*
+ * Local analysis server
+ * usage: server [-w workers] [-q queue] [-H hash] [-s socket]
+ * 	-w - number of worker threads, defaults to the number of cores
+ * 	-q - most requests waiting at once, rounded up to a power of two,
+ * 	     defaults to 1024
+ * 	-H - megabytes of the hash table the workers share, defaults to
+ * 	     TT_DEFAULT_MB
+ * 	-s - path of the Unix domain socket, defaults to DEFAULT_SOCKET
+ * Clients send one JSON object per line, every field but id is optional:
+ * 	{"id":1,"fen":"...","moves":"e2e4 e7e5","depth":12,"nodes":100000,
+ * 	 "movetime":500,"deadline":2000,"multipv":3}
+ * 	fen - position, defaults to the start position
+ * 	moves - moves played from it in coordinate notation
+ * 	depth, nodes, movetime - limits, with none the search stops at depth
+ * 	                         DEFAULT_DEPTH
+ * 	deadline - milliseconds from when the request is read until its answer
+ * 	           is due, a request still queued then is dropped and a search
+ * 	           is cut short to meet it
+ * 	multipv - number of lines
+ * A line may also be a JSON array of such objects, a batch that is queued at
+ * once and answered one request at a time
+ * 	{"cancel":1} - drops the request of the client with that id, or stops
+ * 	               its search
+ * 	{"stats":1} - answers with the number of requests answered and the
+ * 	              50th, 90th, 99th percentile and largest latency in ms
+ * Answers are one line each, in the order they finish:
+ * 	{"id":1,"bestmove":"e2e4","depth":12,"score":{"cp":25},"nodes":123456,
+ * 	 "time":412,"pv":["e2e4","e7e5"],"lines":[{"score":...,"pv":[...]}]}
+ * with lines only for multipv above 1, or {"id":1,"error":"..."}
+ * Latency is measured from reading the request to writing its answer, and is
+ * written to stderr on exit (SIGINT or SIGTERM)
+ */
+
+#define DEFAULT_SOCKET "/tmp/chess-engine.sock"
+#define DEFAULT_QUEUE 1024
+#define DEFAULT_DEPTH 8
+#define MAX_CLIENTS 256
+#define LINE_LENGTH 8192
+#define ID_LENGTH 64
+#define MOVES_LENGTH 4096
+/* cancelled ids remembered per client until a worker takes the request */
+#define MAX_CANCELLED 16
+/* latencies are counted in 1 ms buckets, the last holds everything longer */
+#define LATENCY_BUCKETS 10001
+/* milliseconds between checks for searches to stop */
+#define TICK_MS 5
+
+/*
+ * struct client_t
+ * 	fd: socket of the client, closed once refs drops to 0
+ * 	refs: requests of the client not answered yet, plus one while it is
+ * 	      connected
+ * 	buffer: bytes read that don't yet make a line, length of them
+ * 	lock: guards writes to fd and cancelled
+ * 	cancelled: ids of cancelled requests, ncancelled of them
+ */
+struct client_t {
+	int fd;
+	int refs;
+	char buffer[LINE_LENGTH];
+	int length;
+	pthread_mutex_t lock;
+	char cancelled[MAX_CANCELLED][ID_LENGTH];
+	int ncancelled;
+};
+
+/*
+ * struct request_t
+ * 	id: id of the request as it was written, a JSON number or string
+ * 	received: get_time_ms() when the request was read
+ * 	deadline: get_time_ms() when the answer is due, 0 for none
+ * 	cancelled: set by the main thread to stop the search of the request
+ */
+struct request_t {
+	struct client_t *client;
+	char id[ID_LENGTH];
+	char fen[FEN_LENGTH];
+	char moves[MOVES_LENGTH];
+	int startpos;
+	struct engine_limits_t limits;
+	unsigned long long received;
+	unsigned long long deadline;
+	volatile int cancelled;
+};
+
+/*
+ * struct worker_t
+ * 	current: request being searched, NULL between requests, guarded by lock
+ * 	latency: number of requests answered in each LATENCY_BUCKETS bucket
+ */
+struct worker_t {
+	pthread_t thread;
+	struct engine_t *engine;
+	pthread_mutex_t lock;
+	struct request_t *current;
+	unsigned long latency[LATENCY_BUCKETS];
+	unsigned long long maxlatency;
+};
+
+/*
+ * struct queue_t
+ * Bounded lock-free queue of requests, any thread may push or pop
+ * Slot i holds a request once its sequence number is one past the position
+ * it was pushed at, and is free again once it is the position it will next
+ * be pushed at (Vyukov's bounded MPMC queue)
+ * 	ready: counts the requests in the queue, waited on by idle workers
+ */
+struct slot_t {
+	unsigned long seq;
+	struct request_t *request;
+};
+
+struct queue_t {
+	struct slot_t *slots;
+	unsigned long mask;
+	unsigned long head __attribute__((aligned(CACHE_LINE_SIZE)));
+	unsigned long tail __attribute__((aligned(CACHE_LINE_SIZE)));
+	sem_t ready;
+};
+
+static struct queue_t queue;
+static struct worker_t *workers;
+static int nworkers;
+static volatile sig_atomic_t quitting = 0;
+
+static int queue_init(unsigned long size)
+{
+	unsigned long n = 1;
+	while (n < size)
+		n *= 2;
+	if ((queue.slots = malloc(n * sizeof(struct slot_t))) == NULL)
+		return 0;
+	for (unsigned long i = 0; i < n; ++i)
+		queue.slots[i].seq = i;
+	queue.mask = n - 1;
+	queue.head = 0;
+	queue.tail = 0;
+	return !sem_init(&queue.ready, 0, 0);
+}
+
+/* Returns 0 if the queue is full */
+static int queue_push(struct request_t *requestPtr)
+{
+	unsigned long pos = __atomic_load_n(&queue.tail, __ATOMIC_RELAXED);
+	struct slot_t *slotPtr;
+	long dif;
+	for (;;) {
+		slotPtr = &queue.slots[pos & queue.mask];
+		dif = (long)(__atomic_load_n(&slotPtr->seq, __ATOMIC_ACQUIRE)
+				- pos);
+		if ((dif == 0) && __atomic_compare_exchange_n(&queue.tail,
+					&pos, pos + 1, 1, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED))
+			break;
+		if (dif < 0)
+			return 0;
+		if (dif > 0)
+			pos = __atomic_load_n(&queue.tail, __ATOMIC_RELAXED);
+	}
+	slotPtr->request = requestPtr;
+	__atomic_store_n(&slotPtr->seq, pos + 1, __ATOMIC_RELEASE);
+	sem_post(&queue.ready);
+	return 1;
+}
+
+/* Waits for a request, returns NULL once the server is quitting */
+static struct request_t *queue_pop(void)
+{
+	unsigned long pos;
+	struct slot_t *slotPtr;
+	struct request_t *requestPtr;
+	long dif;
+	while (sem_wait(&queue.ready) && (errno == EINTR))
+		;
+	if (quitting)
+		return NULL;
+	/* the semaphore promises a request, only other poppers can delay it */
+	pos = __atomic_load_n(&queue.head, __ATOMIC_RELAXED);
+	for (;;) {
+		slotPtr = &queue.slots[pos & queue.mask];
+		dif = (long)(__atomic_load_n(&slotPtr->seq, __ATOMIC_ACQUIRE)
+				- (pos + 1));
+		if ((dif == 0) && __atomic_compare_exchange_n(&queue.head,
+					&pos, pos + 1, 1, __ATOMIC_RELAXED,
+					__ATOMIC_RELAXED))
+			break;
+		if (dif != 0)
+			pos = __atomic_load_n(&queue.head, __ATOMIC_RELAXED);
+	}
+	requestPtr = slotPtr->request;
+	__atomic_store_n(&slotPtr->seq, pos + queue.mask + 1, __ATOMIC_RELEASE);
+	return requestPtr;
+}
+
+static void client_release(struct client_t *clientPtr)
+{
+	if (__atomic_sub_fetch(&clientPtr->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	close(clientPtr->fd);
+	pthread_mutex_destroy(&clientPtr->lock);
+	free(clientPtr);
+}
+
+/* Writes a whole line to a client, a client that went away is ignored */
+static void client_write(struct client_t *clientPtr, const char *line,
+		size_t length)
+{
+	ssize_t n;
+	pthread_mutex_lock(&clientPtr->lock);
+	while (length > 0) {
+		n = send(clientPtr->fd, line, length, MSG_NOSIGNAL);
+		if ((n < 0) && (errno == EINTR))
+			continue;
+		if (n <= 0)
+			break;
+		line += n;
+		length -= n;
+	}
+	pthread_mutex_unlock(&clientPtr->lock);
+}
+
+static void write_error(struct client_t *clientPtr, const char *id,
+		const char *error)
+{
+	char line[ID_LENGTH + 64];
+	int n = snprintf(line, sizeof(line), "{\"id\":%s,\"error\":\"%s\"}\n",
+			*id ? id : "null", error);
+	client_write(clientPtr, line, n);
+}
+
+/* Returns non-zero, forgetting the id, if the client cancelled a request */
+static int take_cancelled(struct client_t *clientPtr, const char *id)
+{
+	int found = 0;
+	pthread_mutex_lock(&clientPtr->lock);
+	for (int i = 0; i < clientPtr->ncancelled; ++i) {
+		if (strcmp(clientPtr->cancelled[i], id))
+			continue;
+		strcpy(clientPtr->cancelled[i],
+				clientPtr->cancelled[--clientPtr->ncancelled]);
+		found = 1;
+		break;
+	}
+	pthread_mutex_unlock(&clientPtr->lock);
+	return found;
+}
+
+static void write_score(FILE *out, signed score)
+{
+	if (score > MATE_SCORE - MAX_PLY)
+		fprintf(out, "{\"mate\":%d}", (MATE_SCORE - score + 1) / 2);
+	else if (score < -MATE_SCORE + MAX_PLY)
+		fprintf(out, "{\"mate\":-%d}", (MATE_SCORE + score) / 2);
+	else
+		fprintf(out, "{\"cp\":%d}", score);
+}
+
+static void write_pv(FILE *out, const uint16_t *pv, int pvsize)
+{
+	char mv[MOVE_STRING_LENGTH];
+	fprintf(out, "[");
+	for (int i = 0; i < pvsize; ++i) {
+		move_to_coord(pv[i], mv);
+		fprintf(out, "%s\"%s\"", i ? "," : "", mv);
+	}
+	fprintf(out, "]");
+}
+
+static void write_result(struct client_t *clientPtr, const char *id,
+		const struct search_t *searchPtr, unsigned long long elapsed)
+{
+	char mv[MOVE_STRING_LENGTH];
+	char *line = NULL;
+	size_t length = 0;
+	FILE *out = open_memstream(&line, &length);
+	if (out == NULL)
+		return;
+	move_to_coord(searchPtr->bestmove, mv);
+	fprintf(out, "{\"id\":%s,\"bestmove\":\"%s\",\"depth\":%d,\"score\":",
+			*id ? id : "null", searchPtr->bestmove ? mv : "0000",
+			searchPtr->depth);
+	write_score(out, searchPtr->score);
+	fprintf(out, ",\"nodes\":%llu,\"time\":%llu,\"pv\":",
+			searchPtr->nodes, elapsed);
+	write_pv(out, searchPtr->pv, searchPtr->pvsize);
+	if (searchPtr->nlines > 1) {
+		fprintf(out, ",\"lines\":[");
+		for (int i = 0; i < searchPtr->nlines; ++i) {
+			fprintf(out, "%s{\"score\":", i ? "," : "");
+			write_score(out, searchPtr->lines[i].score);
+			fprintf(out, ",\"pv\":");
+			write_pv(out, searchPtr->lines[i].pv,
+					searchPtr->lines[i].pvsize);
+			fprintf(out, "}");
+		}
+		fprintf(out, "]");
+	}
+	fprintf(out, "}\n");
+	fclose(out);
+	client_write(clientPtr, line, length);
+	free(line);
+}
+
+static void serve(struct worker_t *workerPtr, struct request_t *requestPtr)
+{
+	struct engine_limits_t limits = requestPtr->limits;
+	unsigned long long now = get_time_ms();
+	int cancelled;
+	if (requestPtr->deadline && (now >= requestPtr->deadline)) {
+		write_error(requestPtr->client, requestPtr->id, "expired");
+		return;
+	}
+	if (!engine_set_position(workerPtr->engine, requestPtr->startpos
+				? NULL : requestPtr->fen, requestPtr->moves)) {
+		write_error(requestPtr->client, requestPtr->id,
+				"invalid position");
+		return;
+	}
+	if (requestPtr->deadline && (!limits.movetime
+				|| (limits.movetime > requestPtr->deadline - now)))
+		limits.movetime = requestPtr->deadline - now;
+	pthread_mutex_lock(&workerPtr->lock);
+	workerPtr->current = requestPtr;
+	pthread_mutex_unlock(&workerPtr->lock);
+	/*
+	 * With current published first, a cancel either left its id before
+	 * this check or finds the search and stops it
+	 */
+	cancelled = take_cancelled(requestPtr->client, requestPtr->id);
+	if (!cancelled)
+		engine_search(workerPtr->engine, &limits, NULL);
+	pthread_mutex_lock(&workerPtr->lock);
+	workerPtr->current = NULL;
+	cancelled |= requestPtr->cancelled;
+	pthread_mutex_unlock(&workerPtr->lock);
+	if (cancelled) {
+		/* a cancel that found the search left its id behind as well */
+		take_cancelled(requestPtr->client, requestPtr->id);
+		write_error(requestPtr->client, requestPtr->id, "cancelled");
+	} else {
+		write_result(requestPtr->client, requestPtr->id,
+				engine_result(workerPtr->engine),
+				get_time_ms() - now);
+	}
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker_t *workerPtr = arg;
+	struct request_t *requestPtr;
+	unsigned long long latency;
+	while ((requestPtr = queue_pop()) != NULL) {
+		serve(workerPtr, requestPtr);
+		latency = get_time_ms() - requestPtr->received;
+		/* only this thread writes its counters */
+		__atomic_add_fetch(&workerPtr->latency[(latency
+					< LATENCY_BUCKETS - 1) ? latency
+				: (LATENCY_BUCKETS - 1)], 1, __ATOMIC_RELAXED);
+		if (latency > workerPtr->maxlatency)
+			__atomic_store_n(&workerPtr->maxlatency, latency,
+					__ATOMIC_RELAXED);
+		client_release(requestPtr->client);
+		free(requestPtr);
+	}
+	return NULL;
+}
+
+/*
+ * Returns the value of a key of a flat JSON object, NULL if it has none
+ * Keys are only looked for outside of strings
+ */
+static const char *json_value(const char *obj, const char *end,
+		const char *key)
+{
+	size_t keylength = strlen(key);
+	int instring = 0;
+	for (const char *p = obj; p < end; ++p) {
+		if (instring) {
+			if (*p == '\\')
+				++p;
+			else if (*p == '"')
+				instring = 0;
+			continue;
+		}
+		if (*p != '"')
+			continue;
+		if ((p + keylength + 1 < end) && !strncmp(p + 1, key, keylength)
+				&& (p[keylength + 1] == '"')) {
+			p += keylength + 2;
+			p += strspn(p, " \t");
+			if (*p != ':')
+				return NULL;
+			++p;
+			return p + strspn(p, " \t");
+		}
+		instring = 1;
+	}
+	return NULL;
+}
+
+/* Copies a JSON string value without its quotes, returns 0 if it isn't one */
+static int json_string(const char *value, char *str, size_t size)
+{
+	size_t n = 0;
+	if ((value == NULL) || (*value++ != '"'))
+		return 0;
+	for (; *value && (*value != '"'); ++value) {
+		if ((*value == '\\') && value[1])
+			++value;
+		if (n + 1 < size)
+			str[n++] = *value;
+	}
+	str[n] = '\0';
+	return *value == '"';
+}
+
+/* Copies a JSON number or string as it is written, quotes included */
+static void json_token(const char *value, char *str, size_t size)
+{
+	size_t n = 0;
+	int quoted = (value != NULL) && (*value == '"');
+	if (value == NULL) {
+		*str = '\0';
+		return;
+	}
+	if (quoted)
+		str[n++] = *value++;
+	for (; *value && (n + 2 < size); ++value) {
+		if (quoted ? (*value == '"') : !strchr("-+.eE0123456789",
+					*value))
+			break;
+		if (quoted && (*value == '\\') && value[1])
+			str[n++] = *value++;
+		str[n++] = *value;
+	}
+	if (quoted)
+		str[n++] = '"';
+	str[n] = '\0';
+}
+
+static unsigned long long json_number(const char *value)
+{
+	return value ? strtoull(value, NULL, 10) : 0;
+}
+
+static void write_stats(struct client_t *clientPtr)
+{
+	static const int percentiles[3] = { 50, 90, 99 };
+	unsigned long long counts[LATENCY_BUCKETS] = { 0 };
+	unsigned long long total = 0;
+	unsigned long long seen = 0;
+	unsigned long long maxlatency = 0;
+	char line[256];
+	int n;
+	int next = 0;
+	int values[3] = { 0, 0, 0 };
+	for (int w = 0; w < nworkers; ++w) {
+		for (int i = 0; i < LATENCY_BUCKETS; ++i)
+			counts[i] += __atomic_load_n(&workers[w].latency[i],
+					__ATOMIC_RELAXED);
+		if (workers[w].maxlatency > maxlatency)
+			maxlatency = workers[w].maxlatency;
+	}
+	for (int i = 0; i < LATENCY_BUCKETS; ++i)
+		total += counts[i];
+	for (int i = 0; (i < LATENCY_BUCKETS) && (next < 3); ++i) {
+		seen += counts[i];
+		while ((next < 3) && total
+				&& (seen * 100 >= total * percentiles[next]))
+			values[next++] = i;
+	}
+	n = snprintf(line, sizeof(line), "{\"answered\":%llu,\"p50\":%d,"
+			"\"p90\":%d,\"p99\":%d,\"max\":%llu}\n", total,
+			values[0], values[1], values[2], maxlatency);
+	if (clientPtr != NULL)
+		client_write(clientPtr, line, n);
+	else
+		fputs(line, stderr);
+}
+
+/* Stops the search of a request of a client, or the one that has an id */
+static void stop_searches(const struct client_t *clientPtr, const char *id)
+{
+	struct request_t *requestPtr;
+	unsigned long long now = get_time_ms();
+	for (int w = 0; w < nworkers; ++w) {
+		pthread_mutex_lock(&workers[w].lock);
+		requestPtr = workers[w].current;
+		if ((requestPtr != NULL) && (id != NULL)
+				&& (requestPtr->client == clientPtr)
+				&& !strcmp(requestPtr->id, id))
+			requestPtr->cancelled = 1;
+		/*
+		 * Checked every tick, a stop made just before the search
+		 * started is made again
+		 */
+		if ((requestPtr != NULL) && (requestPtr->cancelled
+					|| (requestPtr->deadline
+						&& (now >= requestPtr->deadline))))
+			engine_stop(workers[w].engine);
+		pthread_mutex_unlock(&workers[w].lock);
+	}
+}
+
+/* Queues one request object of a line, or answers it if it isn't a search */
+static void handle_object(struct client_t *clientPtr, const char *obj,
+		const char *end)
+{
+	struct request_t *requestPtr;
+	char id[ID_LENGTH];
+	const char *value;
+	if ((value = json_value(obj, end, "cancel")) != NULL) {
+		json_token(value, id, sizeof(id));
+		pthread_mutex_lock(&clientPtr->lock);
+		/* the oldest id is forgotten when the list is full */
+		if (clientPtr->ncancelled == MAX_CANCELLED)
+			memmove(clientPtr->cancelled[0],
+					clientPtr->cancelled[1],
+					(MAX_CANCELLED - 1) * ID_LENGTH);
+		else
+			++clientPtr->ncancelled;
+		strcpy(clientPtr->cancelled[clientPtr->ncancelled - 1], id);
+		pthread_mutex_unlock(&clientPtr->lock);
+		stop_searches(clientPtr, id);
+		return;
+	}
+	if (json_value(obj, end, "stats") != NULL) {
+		write_stats(clientPtr);
+		return;
+	}
+	if ((requestPtr = calloc(1, sizeof(struct request_t))) == NULL) {
+		write_error(clientPtr, "", "out of memory");
+		return;
+	}
+	requestPtr->client = clientPtr;
+	requestPtr->received = get_time_ms();
+	json_token(json_value(obj, end, "id"), requestPtr->id, ID_LENGTH);
+	requestPtr->startpos = !json_string(json_value(obj, end, "fen"),
+			requestPtr->fen, FEN_LENGTH);
+	json_string(json_value(obj, end, "moves"), requestPtr->moves,
+			MOVES_LENGTH);
+	requestPtr->limits.depth = json_number(json_value(obj, end, "depth"));
+	requestPtr->limits.nodes = json_number(json_value(obj, end, "nodes"));
+	requestPtr->limits.movetime = json_number(json_value(obj, end,
+				"movetime"));
+	requestPtr->limits.multipv = json_number(json_value(obj, end,
+				"multipv"));
+	if (!requestPtr->limits.depth && !requestPtr->limits.nodes
+			&& !requestPtr->limits.movetime)
+		requestPtr->limits.depth = DEFAULT_DEPTH;
+	if ((value = json_value(obj, end, "deadline")) != NULL)
+		requestPtr->deadline = requestPtr->received
+			+ json_number(value);
+	__atomic_add_fetch(&clientPtr->refs, 1, __ATOMIC_RELAXED);
+	if (!queue_push(requestPtr)) {
+		write_error(clientPtr, requestPtr->id, "queue full");
+		client_release(clientPtr);
+		free(requestPtr);
+	}
+}
+
+/* Splits a line into its objects, one or a batch in an array */
+static void handle_line(struct client_t *clientPtr, const char *line)
+{
+	const char *start = NULL;
+	int depth = 0;
+	int instring = 0;
+	for (const char *p = line; *p; ++p) {
+		if (instring) {
+			if ((*p == '\\') && p[1])
+				++p;
+			else if (*p == '"')
+				instring = 0;
+		} else if (*p == '"') {
+			instring = 1;
+		} else if (*p == '{') {
+			if (depth++ == 0)
+				start = p;
+		} else if ((*p == '}') && (depth > 0) && (--depth == 0)) {
+			handle_object(clientPtr, start, p + 1);
+		}
+	}
+}
+
+/* Reads what a client sent, returns 0 once it has gone away */
+static int client_read(struct client_t *clientPtr)
+{
+	char *line;
+	char *newline;
+	ssize_t n = read(clientPtr->fd, clientPtr->buffer + clientPtr->length,
+			LINE_LENGTH - 1 - clientPtr->length);
+	if (n <= 0)
+		return (n < 0) && (errno == EINTR);
+	clientPtr->length += n;
+	clientPtr->buffer[clientPtr->length] = '\0';
+	line = clientPtr->buffer;
+	while ((newline = strchr(line, '\n')) != NULL) {
+		*newline = '\0';
+		handle_line(clientPtr, line);
+		line = newline + 1;
+	}
+	clientPtr->length -= line - clientPtr->buffer;
+	memmove(clientPtr->buffer, line, clientPtr->length);
+	if (clientPtr->length == LINE_LENGTH - 1) {
+		write_error(clientPtr, "", "line too long");
+		clientPtr->length = 0;
+	}
+	return 1;
+}
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	quitting = 1;
+}
+
+static int listen_on(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd;
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	unlink(path);
+	if (((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+			|| bind(fd, (struct sockaddr *)&addr, sizeof(addr))
+			|| listen(fd, SOMAXCONN)) {
+		perror(path);
+		return -1;
+	}
+	return fd;
+}
+
+int main(int argc, char *argv[])
+{
+	struct pollfd fds[MAX_CLIENTS + 1];
+	struct client_t *clients[MAX_CLIENTS + 1];
+	struct engine_options_t options = { .hash_mb = TT_DEFAULT_MB };
+	const char *path = DEFAULT_SOCKET;
+	unsigned long queuesize = DEFAULT_QUEUE;
+	int nclients = 0;
+	int opt;
+	int fd;
+	nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "w:q:H:s:")) != -1) {
+		switch (opt) {
+		case 'w':
+			nworkers = atoi(optarg);
+			break;
+		case 'q':
+			queuesize = strtoul(optarg, NULL, 10);
+			break;
+		case 'H':
+			options.hash_mb = strtoull(optarg, NULL, 10);
+			break;
+		case 's':
+			path = optarg;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-w workers] [-q queue] "
+					"[-H hash] [-s socket]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (nworkers < 1)
+		nworkers = 1;
+	if ((queuesize < 1) || !queue_init(queuesize)
+			|| ((workers = calloc(nworkers,
+						sizeof(struct worker_t))) == NULL)
+			|| ((fds[0].fd = listen_on(path)) < 0))
+		return EXIT_FAILURE;
+	fds[0].events = POLLIN;
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	/* the first worker owns the table, the others share it */
+	for (int w = 0; w < nworkers; ++w) {
+		workers[w].engine = engine_create(&options);
+		if (workers[w].engine == NULL) {
+			fprintf(stderr, "Not enough memory for %d workers\n",
+					nworkers);
+			return EXIT_FAILURE;
+		}
+		options.shared_tt = engine_tt(workers[0].engine);
+		pthread_mutex_init(&workers[w].lock, NULL);
+		pthread_create(&workers[w].thread, NULL, worker_main,
+				&workers[w]);
+	}
+	while (!quitting) {
+		if ((poll(fds, nclients + 1, TICK_MS) < 0) && (errno != EINTR))
+			break;
+		stop_searches(NULL, NULL);
+		for (int i = nclients; i >= 1; --i) {
+			if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+					|| client_read(clients[i]))
+				continue;
+			/* requests in flight keep the client until answered */
+			shutdown(fds[i].fd, SHUT_RDWR);
+			client_release(clients[i]);
+			fds[i] = fds[nclients];
+			clients[i] = clients[nclients--];
+		}
+		if (!(fds[0].revents & POLLIN)
+				|| ((fd = accept(fds[0].fd, NULL, NULL)) < 0))
+			continue;
+		if ((nclients == MAX_CLIENTS) || ((clients[nclients + 1]
+					= calloc(1, sizeof(struct client_t)))
+				== NULL)) {
+			close(fd);
+			continue;
+		}
+		++nclients;
+		clients[nclients]->fd = fd;
+		clients[nclients]->refs = 1;
+		pthread_mutex_init(&clients[nclients]->lock, NULL);
+		fds[nclients].fd = fd;
+		fds[nclients].events = POLLIN;
+		fds[nclients].revents = 0;
+	}
+	/* searches in progress are stopped, queued requests are dropped */
+	for (int w = 0; w < nworkers; ++w) {
+		engine_stop(workers[w].engine);
+		sem_post(&queue.ready);
+	}
+	for (int w = 0; w < nworkers; ++w)
+		pthread_join(workers[w].thread, NULL);
+	write_stats(NULL);
+	for (int i = 1; i <= nclients; ++i)
+		client_release(clients[i]);
+	for (int w = nworkers - 1; w >= 0; --w)
+		engine_destroy(workers[w].engine);
+	close(fds[0].fd);
+	unlink(path);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <string.h>
+#include "headers/stats.h"
+
+void stats_clear(struct search_stats_t *statsPtr)
+{
+	memset(statsPtr, 0, sizeof(struct search_stats_t));
+}
+
+void stats_add(struct search_stats_t *totalPtr,
+		const struct search_stats_t *statsPtr)
+{
+	totalPtr->searches += statsPtr->searches;
+	totalPtr->nodes += statsPtr->nodes;
+	totalPtr->qnodes += statsPtr->qnodes;
+	totalPtr->tt_probes += statsPtr->tt_probes;
+	totalPtr->tt_hits += statsPtr->tt_hits;
+	totalPtr->tt_cutoffs += statsPtr->tt_cutoffs;
+	totalPtr->beta_cutoffs += statsPtr->beta_cutoffs;
+	totalPtr->first_move_cutoffs += statsPtr->first_move_cutoffs;
+	totalPtr->null_tries += statsPtr->null_tries;
+	totalPtr->null_cutoffs += statsPtr->null_cutoffs;
+	totalPtr->aspiration_fails += statsPtr->aspiration_fails;
+	totalPtr->draws += statsPtr->draws;
+	for (int i = 0; i < STATS_MAX_DEPTH; ++i) {
+		totalPtr->iterations[i] += statsPtr->iterations[i];
+		totalPtr->depth_nodes[i] += statsPtr->depth_nodes[i];
+	}
+}
+
+static double percent(unsigned long long part, unsigned long long whole)
+{
+	return whole ? (100.0 * part / whole) : 0.0;
+}
+
+/*
+ * Ratio of the average size of the iterations at a depth to those one ply
+ * shallower, 0 if either depth was never completed
+ */
+static double branching_factor(const struct search_stats_t *statsPtr,
+		int depth)
+{
+	double prev;
+	if ((depth < 2) || !statsPtr->iterations[depth]
+			|| !statsPtr->iterations[depth - 1]
+			|| !statsPtr->depth_nodes[depth - 1])
+		return 0.0;
+	prev = (double)statsPtr->depth_nodes[depth - 1]
+		/ statsPtr->iterations[depth - 1];
+	return ((double)statsPtr->depth_nodes[depth]
+			/ statsPtr->iterations[depth]) / prev;
+}
+
+void stats_print_info(FILE *out, const struct search_stats_t *statsPtr)
+{
+	fprintf(out, "info string searches %llu nodes %llu qnodes %llu "
+			"(%.1f%%)\n", statsPtr->searches, statsPtr->nodes,
+			statsPtr->qnodes, percent(statsPtr->qnodes,
+				statsPtr->nodes));
+	fprintf(out, "info string tt probes %llu hits %llu (%.1f%%) "
+			"cutoffs %llu (%.1f%%)\n", statsPtr->tt_probes,
+			statsPtr->tt_hits, percent(statsPtr->tt_hits,
+				statsPtr->tt_probes), statsPtr->tt_cutoffs,
+			percent(statsPtr->tt_cutoffs, statsPtr->tt_probes));
+	fprintf(out, "info string beta cutoffs %llu first move %.1f%% "
+			"null moves %llu cutoffs %llu (%.1f%%)\n",
+			statsPtr->beta_cutoffs,
+			percent(statsPtr->first_move_cutoffs,
+				statsPtr->beta_cutoffs), statsPtr->null_tries,
+			statsPtr->null_cutoffs, percent(statsPtr->null_cutoffs,
+				statsPtr->null_tries));
+	fprintf(out, "info string aspiration fails %llu draws %llu\n",
+			statsPtr->aspiration_fails, statsPtr->draws);
+	fprintf(out, "info string branching factor");
+	for (int i = 2; (i < STATS_MAX_DEPTH) && statsPtr->iterations[i]; ++i)
+		fprintf(out, " %d:%.2f", i, branching_factor(statsPtr, i));
+	fprintf(out, "\n");
+}
+
+void stats_print_json(FILE *out, const struct search_stats_t *statsPtr)
+{
+	int last = 0;
+	for (int i = 0; i < STATS_MAX_DEPTH; ++i)
+		if (statsPtr->iterations[i])
+			last = i;
+	fprintf(out, "{\"searches\":%llu,\"nodes\":%llu,\"qnodes\":%llu,"
+			"\"tt_probes\":%llu,\"tt_hits\":%llu,"
+			"\"tt_cutoffs\":%llu,\"beta_cutoffs\":%llu,"
+			"\"first_move_cutoffs\":%llu,\"null_tries\":%llu,"
+			"\"null_cutoffs\":%llu,\"aspiration_fails\":%llu,"
+			"\"draws\":%llu,\"depths\":[",
+			statsPtr->searches, statsPtr->nodes, statsPtr->qnodes,
+			statsPtr->tt_probes, statsPtr->tt_hits,
+			statsPtr->tt_cutoffs, statsPtr->beta_cutoffs,
+			statsPtr->first_move_cutoffs, statsPtr->null_tries,
+			statsPtr->null_cutoffs, statsPtr->aspiration_fails,
+			statsPtr->draws);
+	for (int i = 1; i <= last; ++i)
+		fprintf(out, "%s{\"depth\":%d,\"iterations\":%llu,"
+				"\"nodes\":%llu,\"branching_factor\":%.3f}",
+				(i == 1) ? "" : ",", i,
+				statsPtr->iterations[i],
+				statsPtr->depth_nodes[i],
+				branching_factor(statsPtr, i));
+	fprintf(out, "]}\n");
+}
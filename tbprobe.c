@@ -0,0 +1,1162 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "headers/chess.h"
+#include "headers/search.h"
+#include "headers/tbprobe.h"
+
+/*
+ * Probing code follows the layout of the Syzygy table files as documented by
+ * their generator (github.com/syzygy1/tb), tables are indexed by a material
+ * key and mapped read-only so the kernel pages them in on demand
+ */
+
+#define TB_HASH_BITS 13
+#define TB_HASH_SIZE (1 << TB_HASH_BITS)
+
+/* Table flags, stored in the first byte of each pairs header */
+#define TB_STM 0x01u
+#define TB_MAPPED 0x02u
+#define TB_WIN_PLIES 0x04u
+#define TB_LOSS_PLIES 0x08u
+#define TB_WIDE 0x10u
+#define TB_SINGLE_VALUE 0x80u
+
+/* Probe states */
+#define PROBE_CHANGE_STM -1
+#define PROBE_FAIL 0
+#define PROBE_OK 1
+#define PROBE_ZEROING 2
+
+/*
+ * struct pairs_t
+ * Decoding information for one sub-table (side to move and leading file)
+ * 	lowestsym: lowest symbol of each code length, little endian uint16s
+ * 	btree: pair of symbols each symbol expands to, 3 bytes per symbol
+ * 	blocklength: number of values (minus one) in each block
+ * 	sparseindex: block and offset of every span'th value, 6 bytes each
+ * 	base64: lowest code of each length, left justified
+ * 	symlen: number of values (minus one) each symbol expands to
+ * 	pieces: piece codes in encoding order
+ * 	groupidx: multiplier of each group of like pieces in the index
+ * 	grouplen: number of pieces in each group, zero terminated
+ * 	mapidx: DTZ value map offsets by WDL
+ */
+struct pairs_t {
+	uint8_t flags;
+	uint8_t maxsymlen;
+	uint8_t minsymlen;
+	uint32_t numblocks;
+	uint64_t blocksize;
+	uint64_t span;
+	const uint8_t *lowestsym;
+	const uint8_t *btree;
+	const uint8_t *blocklength;
+	uint32_t blocklengthsize;
+	const uint8_t *sparseindex;
+	uint64_t sparseindexsize;
+	const uint8_t *data;
+	uint64_t *base64;
+	uint8_t *symlen;
+	uint8_t pieces[TB_MAX_PIECES];
+	uint64_t groupidx[TB_MAX_PIECES + 1];
+	int grouplen[TB_MAX_PIECES + 1];
+	uint16_t mapidx[4];
+};
+
+/*
+ * struct tbtable_t
+ * 	base, size: file mapping
+ * 	map: DTZ value map
+ * 	key: material key with the first side of the file name as white
+ * 	key2: material key with the colors swapped
+ * 	pawncount: pawns of the leading color, pawns of the other color
+ * 	items: sub-tables, index by side to move and leading file
+ */
+struct tbtable_t {
+	void *base;
+	size_t size;
+	const uint8_t *map;
+	uint64_t key;
+	uint64_t key2;
+	int dtz;
+	int piececount;
+	int haspawns;
+	int hasunique;
+	int pawncount[2];
+	struct pairs_t items[2][4];
+};
+
+struct tbentry_t {
+	uint64_t key;
+	struct tbtable_t *wdl;
+	struct tbtable_t *dtz;
+};
+
+int tb_largest = 0;
+
+int tb_probe_limit = TB_MAX_PIECES;
+
+static struct tbentry_t tbhash[TB_HASH_SIZE];
+
+static int map_pawns[64];
+static int map_b1h1h7[64];
+static int map_a1d1d4[64];
+static int map_kk[10][64];
+static uint64_t binomial[6][64];
+static uint64_t lead_pawn_idx[6][64];
+static uint64_t lead_pawns_size[6][4];
+
+static const uint8_t wdl_magic[4] = { 0x71, 0xe8, 0x23, 0x5d };
+static const uint8_t dtz_magic[4] = { 0xd7, 0x66, 0x0c, 0xa5 };
+
+static int off_a1h8(int sq)
+{
+	return (sq / 8) - (sq % 8);
+}
+
+static uint16_t read_le16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t read_le32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t read_be32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static uint64_t read_be64(const uint8_t *p)
+{
+	return ((uint64_t)read_be32(p) << 32) | read_be32(p + 4);
+}
+
+static int btree_left(const struct pairs_t *d, int sym)
+{
+	const uint8_t *lr = d->btree + 3 * sym;
+	return ((lr[1] & 0xf) << 8) | lr[0];
+}
+
+static int btree_right(const struct pairs_t *d, int sym)
+{
+	const uint8_t *lr = d->btree + 3 * sym;
+	return (lr[2] << 4) | (lr[1] >> 4);
+}
+
+static void init_indices(void)
+{
+	static const int triangle[16] = {
+		S_A1, S_B1, S_C1, S_D1,
+		S_A2, S_B2, S_C2, S_D2,
+		S_A3, S_B3, S_C3, S_D3,
+		S_A4, S_B4, S_C4, S_D4
+	};
+	int diagonal[4];
+	int ndiag = 0;
+	int both[64][2];
+	int nboth = 0;
+	int code = 0;
+	int avail = 47;
+	uint64_t idx;
+	int sq;
+	for (sq = 0; sq < 64; ++sq)
+		if (off_a1h8(sq) < 0)
+			map_b1h1h7[sq] = code++;
+	code = 0;
+	for (int i = 0; i < 16; ++i) {
+		if (off_a1h8(triangle[i]) < 0)
+			map_a1d1d4[triangle[i]] = code++;
+		else if (!off_a1h8(triangle[i]))
+			diagonal[ndiag++] = triangle[i];
+	}
+	for (int i = 0; i < ndiag; ++i)
+		map_a1d1d4[diagonal[i]] = code++;
+	/* 462 ways to place two kings with the first in the a1-d1-d4 triangle */
+	code = 0;
+	for (int i = 0; i < 10; ++i) {
+		for (int s1 = S_A1; s1 <= S_D4; ++s1) {
+			if ((map_a1d1d4[s1] != i) || (!i && (s1 != S_B1)))
+				continue;
+			for (int s2 = S_A1; s2 <= S_H8; ++s2) {
+				if ((king_attack_lookups[s1] | (1ull << s1))
+						& (1ull << s2))
+					continue;
+				else if (!off_a1h8(s1) && (off_a1h8(s2) > 0))
+					continue;
+				else if (!off_a1h8(s1) && !off_a1h8(s2)) {
+					both[nboth][0] = i;
+					both[nboth++][1] = s2;
+				} else {
+					map_kk[i][s2] = code++;
+				}
+			}
+		}
+	}
+	for (int i = 0; i < nboth; ++i)
+		map_kk[both[i][0]][both[i][1]] = code++;
+	binomial[0][0] = 1;
+	for (int n = 1; n < 64; ++n)
+		for (int k = 0; (k < 6) && (k <= n); ++k)
+			binomial[k][n] = ((k > 0) ? binomial[k - 1][n - 1] : 0)
+				+ ((k < n) ? binomial[k][n - 1] : 0);
+	/* the leading pawn is the one with the highest map_pawns[] value */
+	for (int cnt = 1; cnt <= 5; ++cnt) {
+		for (int f = A_FILE; f <= D_FILE; ++f) {
+			idx = 0;
+			for (int r = RANK_2; r <= RANK_7; ++r) {
+				sq = (r * 8) + f;
+				if (cnt == 1) {
+					map_pawns[sq] = avail--;
+					map_pawns[sq ^ 7] = avail--;
+				}
+				lead_pawn_idx[cnt][sq] = idx;
+				idx += binomial[cnt - 1][map_pawns[sq]];
+			}
+			lead_pawns_size[cnt][f] = idx;
+		}
+	}
+}
+
+static uint64_t material_key(const struct position_t *posPtr)
+{
+	uint64_t key = 0;
+	for (int i = PAWN; i <= KING; ++i) {
+		key += (uint64_t)popcount(posPtr->pieces[WHITE][i])
+			<< (4 * (i - 1));
+		key += (uint64_t)popcount(posPtr->pieces[BLACK][i])
+			<< (4 * (i + 5));
+	}
+	return key;
+}
+
+/* Number of pieces of a type, of both colors, in a material key */
+static int key_count(uint64_t key, int type)
+{
+	return ((key >> (4 * (type - 1))) & 0xf)
+		+ ((key >> (4 * (type + 5))) & 0xf);
+}
+
+static int piece_on(const struct position_t *posPtr, int sq)
+{
+	uint64_t bb = 1ull << sq;
+	int color = (posPtr->pieces[WHITE][0] & bb) ? WHITE : BLACK;
+	for (int i = PAWN; i <= KING; ++i)
+		if (posPtr->pieces[color][i] & bb)
+			return i | (color << 3);
+	return 0;
+}
+
+static struct tbentry_t *find_entry(uint64_t key, int insert)
+{
+	uint64_t i = (key * 0x9e3779b97f4a7c15ull) >> (64 - TB_HASH_BITS);
+	while (tbhash[i].key != 0) {
+		if (tbhash[i].key == key)
+			return &tbhash[i];
+		i = (i + 1) & (TB_HASH_SIZE - 1);
+	}
+	if (!insert)
+		return NULL;
+	tbhash[i].key = key;
+	return &tbhash[i];
+}
+
+/* Advances data by size bytes, returns NULL if that goes past end */
+static const uint8_t *skip(const uint8_t *data, uint64_t size,
+		const uint8_t *end)
+{
+	if ((data == NULL) || ((uint64_t)(end - data) < size))
+		return NULL;
+	return data + size;
+}
+
+/* Returns 0 if the order of the groups can't be right */
+static int set_groups(struct tbtable_t *e, struct pairs_t *d, int order[2],
+		int f)
+{
+	int n = 0;
+	int firstlen = e->haspawns ? 0 : (e->hasunique ? 3 : 2);
+	int pp = e->haspawns && e->pawncount[1];
+	int next = pp ? 2 : 1;
+	int freesq;
+	uint64_t idx = 1;
+	d->grouplen[n] = 1;
+	for (int i = 1; i < e->piececount; ++i) {
+		if ((--firstlen > 0) || (d->pieces[i] == d->pieces[i - 1]))
+			++d->grouplen[n];
+		else
+			d->grouplen[++n] = 1;
+	}
+	d->grouplen[++n] = 0;
+	if ((order[0] >= n) || (pp && ((order[1] >= n)
+					|| (order[1] == order[0]))))
+		return 0;
+	freesq = 64 - d->grouplen[0] - (pp ? d->grouplen[1] : 0);
+	/* groups are not necessarily encoded in the order of pieces[] */
+	for (int k = 0; (next < n) || (k == order[0]) || (k == order[1]); ++k) {
+		if (k == order[0]) {
+			d->groupidx[0] = idx;
+			idx *= e->haspawns ? lead_pawns_size[d->grouplen[0]][f]
+				: (e->hasunique ? 31332 : 462);
+		} else if (k == order[1]) {
+			d->groupidx[1] = idx;
+			idx *= binomial[d->grouplen[1]][48 - d->grouplen[0]];
+		} else {
+			d->groupidx[next] = idx;
+			idx *= binomial[d->grouplen[next]][freesq];
+			freesq -= d->grouplen[next++];
+		}
+	}
+	d->groupidx[n] = idx;
+	return 1;
+}
+
+static uint8_t set_symlen(struct pairs_t *d, int sym, uint8_t *visited)
+{
+	int sl, sr;
+	visited[sym] = 1;
+	sr = btree_right(d, sym);
+	if (sr == 0xfff)
+		return 0;
+	sl = btree_left(d, sym);
+	if (!visited[sl])
+		d->symlen[sl] = set_symlen(d, sl, visited);
+	if (!visited[sr])
+		d->symlen[sr] = set_symlen(d, sr, visited);
+	return d->symlen[sl] + d->symlen[sr] + 1;
+}
+
+/* Returns the data after the sizes, NULL if they don't fit the file */
+static const uint8_t *set_sizes(struct pairs_t *d, const uint8_t *data,
+		const uint8_t *end)
+{
+	uint64_t tbsize;
+	int padding;
+	int nbase;
+	int nsym;
+	uint8_t *visited;
+	int i;
+	if (skip(data, 2, end) == NULL)
+		return NULL;
+	d->flags = *data++;
+	if (d->flags & TB_SINGLE_VALUE) {
+		d->numblocks = 0;
+		d->span = 0;
+		d->blocklengthsize = 0;
+		d->sparseindexsize = 0;
+		/* the single value is stored in place of the symbol length */
+		d->minsymlen = *data++;
+		return data;
+	}
+	if ((skip(data, 9, end) == NULL) || (data[0] > 31) || (data[1] > 31))
+		return NULL;
+	for (i = 0; d->grouplen[i]; ++i)
+		;
+	tbsize = d->groupidx[i];
+	d->blocksize = 1ull << *data++;
+	d->span = 1ull << *data++;
+	d->sparseindexsize = (tbsize + d->span - 1) / d->span;
+	padding = *data++;
+	d->numblocks = read_le32(data);
+	data += 4;
+	d->blocklengthsize = d->numblocks + padding;
+	d->maxsymlen = *data++;
+	d->minsymlen = *data++;
+	d->lowestsym = data;
+	/* codes are read 32 bits at a time */
+	if ((d->minsymlen == 0) || (d->maxsymlen < d->minsymlen)
+			|| (d->maxsymlen > 32))
+		return NULL;
+	nbase = d->maxsymlen - d->minsymlen + 1;
+	if (skip(data, (nbase * 2) + 2, end) == NULL)
+		return NULL;
+	d->base64 = calloc(nbase, sizeof(uint64_t));
+	/* canonical huffman codes: longer codes have lower values */
+	for (i = nbase - 2; i >= 0; --i)
+		d->base64[i] = (d->base64[i + 1]
+				+ read_le16(d->lowestsym + (2 * i))
+				- read_le16(d->lowestsym + (2 * (i + 1)))) / 2;
+	for (i = 0; i < nbase; ++i)
+		d->base64[i] <<= 64 - i - d->minsymlen;
+	data += nbase * 2;
+	nsym = read_le16(data);
+	data += 2;
+	d->btree = data;
+	if ((nsym == 0) || (nsym > 0xfff)
+			|| (skip(data, (nsym * 3) + (nsym & 1), end) == NULL))
+		return NULL;
+	for (i = 0; i < nsym; ++i)
+		if ((btree_right(d, i) != 0xfff) && ((btree_left(d, i) >= nsym)
+					|| (btree_right(d, i) >= nsym)))
+			return NULL;
+	d->symlen = calloc(nsym, 1);
+	visited = calloc(nsym, 1);
+	for (i = 0; i < nsym; ++i)
+		if (!visited[i])
+			d->symlen[i] = set_symlen(d, i, visited);
+	free(visited);
+	return data + (nsym * 3) + (nsym & 1);
+}
+
+/* Returns the data after the map, NULL if it doesn't fit the file */
+static const uint8_t *set_dtz_map(struct tbtable_t *e, const uint8_t *data,
+		const uint8_t *end, int maxfile)
+{
+	struct pairs_t *d;
+	e->map = data;
+	for (int f = A_FILE; f <= maxfile; ++f) {
+		d = &e->items[0][f];
+		if (!(d->flags & TB_MAPPED))
+			continue;
+		if (d->flags & TB_WIDE) {
+			data = skip(data, (uintptr_t)data & 1, end);
+			for (int i = 0; i < 4; ++i) {
+				if (skip(data, 2, end) == NULL)
+					return NULL;
+				d->mapidx[i] = ((data - e->map) / 2) + 1;
+				data = skip(data, (2 * read_le16(data)) + 2,
+						end);
+			}
+		} else {
+			for (int i = 0; i < 4; ++i) {
+				if (skip(data, 1, end) == NULL)
+					return NULL;
+				d->mapidx[i] = (data - e->map) + 1;
+				data = skip(data, *data + 1, end);
+			}
+		}
+	}
+	return skip(data, (uintptr_t)data & 1, end);
+}
+
+/*
+ * Sets up a table from the file after its magic, returns 0 if the file is
+ * corrupt or isn't the table its name says
+ */
+static int init_table(struct tbtable_t *e, const uint8_t *data,
+		const uint8_t *end)
+{
+	int sides = (!e->dtz && (e->key != e->key2)) ? 2 : 1;
+	int maxfile = e->haspawns ? D_FILE : A_FILE;
+	int pp = e->haspawns && e->pawncount[1];
+	int order[2][2];
+	int counts[8];
+	struct pairs_t *d;
+	if ((e->haspawns != !!(*data & 2))
+			|| ((e->key != e->key2) != !!(*data & 1)))
+		return 0;
+	++data;
+	for (int f = A_FILE; f <= maxfile; ++f) {
+		if (skip(data, 1 + pp + e->piececount, end) == NULL)
+			return 0;
+		order[0][0] = *data & 0xf;
+		order[0][1] = pp ? (*(data + 1) & 0xf) : 0xf;
+		order[1][0] = *data >> 4;
+		order[1][1] = pp ? (*(data + 1) >> 4) : 0xf;
+		data += 1 + pp;
+		for (int k = 0; k < e->piececount; ++k, ++data)
+			for (int i = 0; i < sides; ++i)
+				e->items[i][f].pieces[k] = i ? (*data >> 4)
+					: (*data & 0xf);
+		for (int i = 0; i < sides; ++i) {
+			/* the pieces have to be those of the material key */
+			memset(counts, 0, sizeof(counts));
+			for (int k = 0; k < e->piececount; ++k)
+				++counts[e->items[i][f].pieces[k] & 7];
+			for (int j = PAWN; j <= KING; ++j)
+				if (counts[j] != key_count(e->key, j))
+					return 0;
+			if (!set_groups(e, &e->items[i][f], order[i], f))
+				return 0;
+		}
+	}
+	data = skip(data, (uintptr_t)data & 1, end);
+	for (int f = A_FILE; f <= maxfile; ++f)
+		for (int i = 0; (i < sides) && data; ++i)
+			data = set_sizes(&e->items[i][f], data, end);
+	if (e->dtz && data)
+		data = set_dtz_map(e, data, end, maxfile);
+	for (int f = A_FILE; f <= maxfile; ++f) {
+		for (int i = 0; i < sides; ++i) {
+			d = &e->items[i][f];
+			d->sparseindex = data;
+			data = skip(data, d->sparseindexsize * 6, end);
+		}
+	}
+	for (int f = A_FILE; f <= maxfile; ++f) {
+		for (int i = 0; i < sides; ++i) {
+			d = &e->items[i][f];
+			d->blocklength = data;
+			data = skip(data, d->blocklengthsize * 2, end);
+		}
+	}
+	for (int f = A_FILE; f <= maxfile; ++f) {
+		for (int i = 0; i < sides; ++i) {
+			data = skip(data, -(uintptr_t)data & 0x3f, end);
+			d = &e->items[i][f];
+			d->data = data;
+			data = skip(data, d->numblocks * d->blocksize, end);
+		}
+	}
+	return data != NULL;
+}
+
+/*
+ * Parses a table name such as "KRPvKR" into piece counts, index by COLORS and
+ * PIECETYPES, returns the number of pieces or 0 if the name is not a table
+ */
+static int parse_name(const char *name, int len, int counts[2][7])
+{
+	static const char letters[] = " PNBRQK";
+	int color = WHITE;
+	int total = 0;
+	const char *p;
+	memset(counts, 0, sizeof(int) * 14);
+	for (int i = 0; i < len; ++i) {
+		if (name[i] == 'v') {
+			if (color == BLACK)
+				return 0;
+			color = BLACK;
+			continue;
+		}
+		if (!name[i] || !(p = strchr(letters + 1, name[i])))
+			return 0;
+		++counts[color][p - letters];
+		++total;
+	}
+	if ((color != BLACK) || (counts[WHITE][KING] != 1)
+			|| (counts[BLACK][KING] != 1) || (total > TB_MAX_PIECES))
+		return 0;
+	return total;
+}
+
+static void free_table(struct tbtable_t *e)
+{
+	for (int i = 0; i < 2; ++i) {
+		for (int f = 0; f < 4; ++f) {
+			free(e->items[i][f].base64);
+			free(e->items[i][f].symlen);
+		}
+	}
+	munmap(e->base, e->size);
+	free(e);
+}
+
+static void add_table(const char *path, const char *file)
+{
+	int len = strlen(file);
+	int counts[2][7];
+	int dtz;
+	int fd;
+	int lead;
+	char *fname;
+	struct stat st;
+	struct tbtable_t *e;
+	struct tbentry_t *ent;
+	uint8_t *data;
+	if (len < 6)
+		return;
+	if (!strcmp(file + len - 5, ".rtbw"))
+		dtz = 0;
+	else if (!strcmp(file + len - 5, ".rtbz"))
+		dtz = 1;
+	else
+		return;
+	if (!parse_name(file, len - 5, counts))
+		return;
+	fname = malloc(strlen(path) + len + 2);
+	sprintf(fname, "%s/%s", path, file);
+	fd = open(fname, O_RDONLY);
+	free(fname);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) || ((st.st_size % 64) != 16)) {
+		fprintf(stderr, "Corrupt tablebase file %s\n", file);
+		close(fd);
+		return;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return;
+	if (memcmp(data, dtz ? dtz_magic : wdl_magic, 4)) {
+		fprintf(stderr, "Corrupt tablebase file %s\n", file);
+		munmap(data, st.st_size);
+		return;
+	}
+	madvise(data, st.st_size, MADV_RANDOM);
+	e = calloc(1, sizeof(struct tbtable_t));
+	e->base = data;
+	e->size = st.st_size;
+	e->dtz = dtz;
+	for (int i = PAWN; i <= KING; ++i) {
+		e->key += (uint64_t)counts[WHITE][i] << (4 * (i - 1));
+		e->key += (uint64_t)counts[BLACK][i] << (4 * (i + 5));
+		e->key2 += (uint64_t)counts[BLACK][i] << (4 * (i - 1));
+		e->key2 += (uint64_t)counts[WHITE][i] << (4 * (i + 5));
+		e->piececount += counts[WHITE][i] + counts[BLACK][i];
+		if ((i != KING) && ((counts[WHITE][i] == 1)
+					|| (counts[BLACK][i] == 1)))
+			e->hasunique = 1;
+	}
+	e->haspawns = counts[WHITE][PAWN] || counts[BLACK][PAWN];
+	/* the leading color is the one with fewer pawns, white on a tie */
+	lead = (!counts[BLACK][PAWN] || (counts[WHITE][PAWN]
+				&& (counts[BLACK][PAWN] >= counts[WHITE][PAWN])))
+		? WHITE : BLACK;
+	e->pawncount[0] = counts[lead][PAWN];
+	e->pawncount[1] = counts[BLACK - lead][PAWN];
+	if (!init_table(e, data + 4, data + st.st_size)) {
+		fprintf(stderr, "Corrupt tablebase file %s\n", file);
+		free_table(e);
+		return;
+	}
+	ent = find_entry(e->key, 1);
+	if (dtz)
+		ent->dtz = e;
+	else
+		ent->wdl = e;
+	ent = find_entry(e->key2, 1);
+	if (dtz)
+		ent->dtz = e;
+	else
+		ent->wdl = e;
+	if (e->piececount > tb_largest)
+		tb_largest = e->piececount;
+}
+
+void tb_free(void)
+{
+	struct tbtable_t *e;
+	for (int i = 0; i < TB_HASH_SIZE; ++i) {
+		/* each table is in the hash under both keys */
+		if ((e = tbhash[i].wdl) && (e->key == tbhash[i].key))
+			free_table(e);
+		if ((e = tbhash[i].dtz) && (e->key == tbhash[i].key))
+			free_table(e);
+	}
+	memset(tbhash, 0, sizeof(tbhash));
+	tb_largest = 0;
+}
+
+int tb_init(const char *path)
+{
+	static int initialized = 0;
+	DIR *dir;
+	struct dirent *ent;
+	int n = 0;
+	if (!initialized) {
+		init_indices();
+		initialized = 1;
+	}
+	tb_free();
+	if (!path || !*path)
+		return 0;
+	if (!(dir = opendir(path)))
+		return 0;
+	while ((ent = readdir(dir)))
+		add_table(path, ent->d_name);
+	closedir(dir);
+	for (int i = 0; i < TB_HASH_SIZE; ++i)
+		if (tbhash[i].wdl && (tbhash[i].wdl->key == tbhash[i].key))
+			++n;
+	return n;
+}
+
+static int decompress_pairs(const struct pairs_t *d, uint64_t idx)
+{
+	uint32_t k;
+	uint32_t block;
+	int offset;
+	const uint8_t *ptr;
+	uint64_t buf64;
+	int buf64size = 64;
+	int sym, left, len;
+	if (d->flags & TB_SINGLE_VALUE)
+		return d->minsymlen;
+	/* sparseindex[k] points at value k * span + span / 2 */
+	k = idx / d->span;
+	block = read_le32(d->sparseindex + (6 * k));
+	offset = read_le16(d->sparseindex + (6 * k) + 4);
+	offset += (int)(idx % d->span) - (int)(d->span / 2);
+	while (offset < 0)
+		offset += read_le16(d->blocklength + (2 * --block)) + 1;
+	while (offset > read_le16(d->blocklength + (2 * block)))
+		offset -= read_le16(d->blocklength + (2 * block++)) + 1;
+	ptr = d->data + ((uint64_t)block * d->blocksize);
+	buf64 = read_be64(ptr);
+	ptr += 8;
+	for (;;) {
+		len = 0;
+		while (buf64 < d->base64[len])
+			++len;
+		sym = (buf64 - d->base64[len]) >> (64 - len - d->minsymlen);
+		sym += read_le16(d->lowestsym + (2 * len));
+		if (offset < d->symlen[sym] + 1)
+			break;
+		offset -= d->symlen[sym] + 1;
+		len += d->minsymlen;
+		buf64 <<= len;
+		buf64size -= len;
+		if (buf64size <= 32) {
+			buf64size += 32;
+			buf64 |= (uint64_t)read_be32(ptr) << (64 - buf64size);
+			ptr += 4;
+		}
+	}
+	/* expand the symbol until the offset lands on a single value */
+	while (d->symlen[sym]) {
+		left = btree_left(d, sym);
+		if (offset < d->symlen[left] + 1) {
+			sym = left;
+		} else {
+			offset -= d->symlen[left] + 1;
+			sym = btree_right(d, sym);
+		}
+	}
+	return btree_left(d, sym);
+}
+
+static void sort_squares(int *sq, int n, const int *map)
+{
+	int tmp;
+	int j;
+	for (int i = 1; i < n; ++i) {
+		tmp = sq[i];
+		for (j = i; (j > 0) && ((map ? map[sq[j - 1]] : sq[j - 1])
+					> (map ? map[tmp] : tmp)); --j)
+			sq[j] = sq[j - 1];
+		sq[j] = tmp;
+	}
+}
+
+static int map_score(const struct tbtable_t *e, int f, int value, int wdl)
+{
+	static const int wdlmap[5] = { 1, 3, 0, 2, 0 };
+	const struct pairs_t *d = &e->items[0][f];
+	if (!e->dtz)
+		return value - 2;
+	if (d->flags & TB_MAPPED) {
+		if (d->flags & TB_WIDE)
+			value = read_le16(e->map
+				+ (2 * (d->mapidx[wdlmap[wdl + 2]] + value)));
+		else
+			value = e->map[d->mapidx[wdlmap[wdl + 2]] + value];
+	}
+	/* values are stored in full moves unless the table says plies */
+	if (((wdl == TB_WIN) && !(d->flags & TB_WIN_PLIES))
+			|| ((wdl == TB_LOSS) && !(d->flags & TB_LOSS_PLIES))
+			|| (wdl == TB_CURSED_WIN) || (wdl == TB_BLESSED_LOSS))
+		value *= 2;
+	return value + 1;
+}
+
+static int probe_table(const struct position_t *posPtr, int dtz, int wdl,
+		int *result)
+{
+	int squares[TB_MAX_PIECES];
+	int pieces[TB_MAX_PIECES];
+	int size = 0;
+	int leadcnt = 0;
+	int next = 0;
+	unsigned stm = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	int tbfile = A_FILE;
+	int flipcolor, flipsq, symm, bstrong;
+	int remaining, adjust, adjust1, adjust2, tmp, best;
+	int *groupsq;
+	uint64_t key = material_key(posPtr);
+	uint64_t idx, n;
+	uint64_t bb;
+	uint64_t leadpawns = 0;
+	struct tbentry_t *ent;
+	const struct tbtable_t *e;
+	const struct pairs_t *d;
+	if (popcount(posPtr->occupied) == 2)
+		return 0;
+	ent = find_entry(key, 0);
+	e = ent ? (dtz ? ent->dtz : ent->wdl) : NULL;
+	if (!e) {
+		*result = PROBE_FAIL;
+		return 0;
+	}
+	/*
+	 * Tables are stored with the first side of the file name as white,
+	 * and symmetric tables only with white to move, so flip the position
+	 * when it doesn't match
+	 */
+	symm = (e->key == e->key2) && (stm == BLACK);
+	bstrong = (key != e->key);
+	flipcolor = (symm || bstrong) * 8;
+	flipsq = (symm || bstrong) * 56;
+	stm ^= symm || bstrong;
+	if (e->haspawns) {
+		/* the leading pawns are listed first in every sub-table */
+		tmp = (e->items[0][0].pieces[0] ^ flipcolor) >> 3;
+		leadpawns = bb = posPtr->pieces[tmp][PAWN];
+		do {
+			squares[size++] = ls1bindice(bb) ^ flipsq;
+			bb &= bb - 1;
+		} while (bb);
+		leadcnt = size;
+		best = 0;
+		for (int i = 1; i < leadcnt; ++i)
+			if (map_pawns[squares[i]] > map_pawns[squares[best]])
+				best = i;
+		tmp = squares[0];
+		squares[0] = squares[best];
+		squares[best] = tmp;
+		tbfile = squares[0] % 8;
+		if (tbfile > D_FILE)
+			tbfile = H_FILE - tbfile;
+	}
+	/* DTZ tables only store one side to move */
+	if (e->dtz && ((e->items[0][tbfile].flags & TB_STM) != stm)
+			&& ((e->key != e->key2) || e->haspawns)) {
+		*result = PROBE_CHANGE_STM;
+		return 0;
+	}
+	bb = posPtr->occupied ^ leadpawns;
+	do {
+		tmp = ls1bindice(bb);
+		squares[size] = tmp ^ flipsq;
+		pieces[size++] = piece_on(posPtr, tmp) ^ flipcolor;
+		bb &= bb - 1;
+	} while (bb);
+	d = &e->items[e->dtz ? 0 : stm][e->haspawns ? tbfile : 0];
+	/* put the pieces in the same order as the table */
+	for (int i = leadcnt; i < size - 1; ++i) {
+		for (int j = i + 1; j < size; ++j) {
+			if (d->pieces[i] == pieces[j]) {
+				tmp = pieces[i];
+				pieces[i] = pieces[j];
+				pieces[j] = tmp;
+				tmp = squares[i];
+				squares[i] = squares[j];
+				squares[j] = tmp;
+				break;
+			}
+		}
+	}
+	/* mirror so the leading piece is on files a-d */
+	if ((squares[0] % 8) > D_FILE)
+		for (int i = 0; i < size; ++i)
+			squares[i] ^= 7;
+	if (e->haspawns) {
+		idx = lead_pawn_idx[leadcnt][squares[0]];
+		sort_squares(squares + 1, leadcnt - 1, map_pawns);
+		for (int i = 1; i < leadcnt; ++i)
+			idx += binomial[i][map_pawns[squares[i]]];
+		goto encode_remaining;
+	}
+	/* without pawns, also mirror so the leading piece is on ranks 1-4 */
+	if ((squares[0] / 8) > RANK_4)
+		for (int i = 0; i < size; ++i)
+			squares[i] ^= 56;
+	/* and below the a1-h8 diagonal */
+	for (int i = 0; i < d->grouplen[0]; ++i) {
+		if (!off_a1h8(squares[i]))
+			continue;
+		if (off_a1h8(squares[i]) > 0)
+			for (int j = i; j < size; ++j)
+				squares[j] = ((squares[j] >> 3)
+						| (squares[j] << 3)) & 63;
+		break;
+	}
+	if (e->hasunique) {
+		adjust1 = squares[1] > squares[0];
+		adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+		if (off_a1h8(squares[0]))
+			idx = (((uint64_t)map_a1d1d4[squares[0]] * 63
+					+ (squares[1] - adjust1)) * 62)
+				+ squares[2] - adjust2;
+		else if (off_a1h8(squares[1]))
+			idx = ((6 * 63 + ((squares[0] / 8) * 28)
+					+ map_b1h1h7[squares[1]]) * 62)
+				+ squares[2] - adjust2;
+		else if (off_a1h8(squares[2]))
+			idx = (6 * 63 * 62) + (4 * 28 * 62)
+				+ ((squares[0] / 8) * 7 * 28)
+				+ (((squares[1] / 8) - adjust1) * 28)
+				+ map_b1h1h7[squares[2]];
+		else
+			idx = (6 * 63 * 62) + (4 * 28 * 62) + (4 * 7 * 28)
+				+ ((squares[0] / 8) * 7 * 6)
+				+ (((squares[1] / 8) - adjust1) * 6)
+				+ ((squares[2] / 8) - adjust2);
+	} else {
+		idx = map_kk[map_a1d1d4[squares[0]]][squares[1]];
+	}
+encode_remaining:
+	idx *= d->groupidx[0];
+	groupsq = squares + d->grouplen[0];
+	remaining = e->haspawns && e->pawncount[1];
+	while (d->grouplen[++next]) {
+		sort_squares(groupsq, d->grouplen[next], NULL);
+		n = 0;
+		for (int i = 0; i < d->grouplen[next]; ++i) {
+			adjust = 0;
+			for (int *s = squares; s < groupsq; ++s)
+				adjust += groupsq[i] > *s;
+			n += binomial[i + 1][groupsq[i] - adjust
+				- (8 * remaining)];
+		}
+		remaining = 0;
+		idx += n * d->groupidx[next];
+		groupsq += d->grouplen[next];
+	}
+	return map_score(e, tbfile, decompress_pairs(d, idx), wdl);
+}
+
+static int is_zeroing(const struct position_t *posPtr, uint16_t mv)
+{
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	return (mv & CAPTURE_MOVE)
+		|| (posPtr->pieces[color][PAWN] & (1ull << (mv & START_SQUARE)));
+}
+
+static int is_mate(struct position_t *posPtr)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	int legal;
+	if (!(posPtr->flags & (color ? BLACK_CHECK : WHITE_CHECK)))
+		return 0;
+	movelist[0] = 0;
+	generate_moves(posPtr, movelist);
+	for (int i = 1; i <= movelist[0]; ++i) {
+		make_move(posPtr, movelist[i]);
+		legal = was_legal(posPtr);
+		unmake_move(posPtr, movelist[i]);
+		if (legal)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Tables store "don't care" values where the side to move has a winning
+ * capture, so captures (and for DTZ, pawn moves) have to be searched and the
+ * best of them and the stored value is the result
+ */
+static int probe_ab(struct position_t *posPtr, int zeroing, int *result)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	int best = TB_LOSS;
+	int value;
+	int total = 0;
+	int count = 0;
+	int nomoves;
+	int zero;
+	movelist[0] = 0;
+	generate_moves(posPtr, movelist);
+	for (int i = 1; i <= movelist[0]; ++i) {
+		zero = (movelist[i] & CAPTURE_MOVE)
+			|| (zeroing && is_zeroing(posPtr, movelist[i]));
+		make_move(posPtr, movelist[i]);
+		if (!was_legal(posPtr)) {
+			unmake_move(posPtr, movelist[i]);
+			continue;
+		}
+		++total;
+		if (!zero) {
+			unmake_move(posPtr, movelist[i]);
+			continue;
+		}
+		++count;
+		value = -probe_ab(posPtr, 0, result);
+		unmake_move(posPtr, movelist[i]);
+		if (*result == PROBE_FAIL)
+			return TB_DRAW;
+		if (value > best) {
+			best = value;
+			if (value >= TB_WIN) {
+				*result = PROBE_ZEROING;
+				return value;
+			}
+		}
+	}
+	/* stored values are wrong when every move was a capture, or e.p. */
+	nomoves = count && (count == total);
+	if (nomoves) {
+		value = best;
+	} else {
+		value = probe_table(posPtr, 0, TB_DRAW, result);
+		if (*result == PROBE_FAIL)
+			return TB_DRAW;
+	}
+	if (best >= value) {
+		*result = ((best > TB_DRAW) || nomoves) ? PROBE_ZEROING
+			: PROBE_OK;
+		return best;
+	}
+	*result = PROBE_OK;
+	return value;
+}
+
+static int dtz_before_zeroing(int wdl)
+{
+	switch (wdl) {
+	case TB_WIN:
+		return 1;
+	case TB_CURSED_WIN:
+		return 101;
+	case TB_BLESSED_LOSS:
+		return -101;
+	case TB_LOSS:
+		return -1;
+	}
+	return 0;
+}
+
+static int probe_dtz(struct position_t *posPtr, int *result)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	int wdl;
+	int dtz;
+	int mindtz = 0xffff;
+	int zeroing;
+	*result = PROBE_OK;
+	wdl = probe_ab(posPtr, 1, result);
+	if ((*result == PROBE_FAIL) || (wdl == TB_DRAW))
+		return 0;
+	if (*result == PROBE_ZEROING)
+		return dtz_before_zeroing(wdl);
+	dtz = probe_table(posPtr, 1, wdl, result);
+	if (*result == PROBE_FAIL)
+		return 0;
+	if (*result != PROBE_CHANGE_STM) {
+		if ((wdl == TB_BLESSED_LOSS) || (wdl == TB_CURSED_WIN))
+			dtz += 100;
+		return (wdl > 0) ? dtz : -dtz;
+	}
+	/* the table is for the other side, do a 1-ply search */
+	movelist[0] = 0;
+	generate_moves(posPtr, movelist);
+	for (int i = 1; i <= movelist[0]; ++i) {
+		zeroing = is_zeroing(posPtr, movelist[i]);
+		make_move(posPtr, movelist[i]);
+		if (!was_legal(posPtr)) {
+			unmake_move(posPtr, movelist[i]);
+			continue;
+		}
+		if (zeroing) {
+			*result = PROBE_OK;
+			dtz = -dtz_before_zeroing(probe_ab(posPtr, 0, result));
+		} else {
+			dtz = -probe_dtz(posPtr, result);
+		}
+		if ((dtz == 1) && is_mate(posPtr))
+			mindtz = 1;
+		if (!zeroing)
+			dtz += (dtz > 0) - (dtz < 0);
+		if ((dtz < mindtz) && (dtz != 0) && ((dtz > 0) == (wdl > 0)))
+			mindtz = dtz;
+		unmake_move(posPtr, movelist[i]);
+		if (*result == PROBE_FAIL)
+			return 0;
+	}
+	return (mindtz == 0xffff) ? -1 : mindtz;
+}
+
+static int can_probe(const struct position_t *posPtr)
+{
+	return tb_largest && !(posPtr->flags & BOTH_BOTH_CASTLE)
+		&& (popcount(posPtr->occupied) <= tb_largest);
+}
+
+int tb_probe_wdl(struct position_t *posPtr, int *success)
+{
+	int result = PROBE_OK;
+	int wdl;
+	if (!can_probe(posPtr)) {
+		*success = 0;
+		return TB_DRAW;
+	}
+	wdl = probe_ab(posPtr, 0, &result);
+	*success = result != PROBE_FAIL;
+	return wdl;
+}
+
+int tb_probe_dtz(struct position_t *posPtr, int *success)
+{
+	int result = PROBE_OK;
+	int dtz;
+	if (!can_probe(posPtr)) {
+		*success = 0;
+		return 0;
+	}
+	dtz = probe_dtz(posPtr, &result);
+	*success = result != PROBE_FAIL;
+	return dtz;
+}
+
+int tb_root_filter(struct position_t *posPtr, uint16_t *lsPtr,
+		signed *scorePtr)
+{
+	int rank[MAX_MOVES + 1];
+	int result = PROBE_OK;
+	int fifty = posPtr->fiftymove;
+	int best = -0xffff;
+	int length = 0;
+	int zeroing;
+	int dtz;
+	if (!can_probe(posPtr))
+		return 0;
+	for (int i = 1; i <= lsPtr[0]; ++i) {
+		zeroing = is_zeroing(posPtr, lsPtr[i]);
+		make_move(posPtr, lsPtr[i]);
+		if (!was_legal(posPtr)) {
+			unmake_move(posPtr, lsPtr[i]);
+			rank[i] = -0x10000;
+			continue;
+		}
+		/* dtz counted from the root position */
+		if (zeroing) {
+			result = PROBE_OK;
+			dtz = dtz_before_zeroing(-probe_ab(posPtr, 0, &result));
+		} else {
+			dtz = -probe_dtz(posPtr, &result);
+			dtz += (dtz > 0) - (dtz < 0);
+		}
+		if ((dtz == 2) && is_mate(posPtr))
+			dtz = 1;
+		unmake_move(posPtr, lsPtr[i]);
+		if (result == PROBE_FAIL)
+			return 0;
+		/* wins within the fifty move rule rank equally */
+		if (dtz > 0)
+			rank[i] = ((dtz + fifty) <= 99) ? 1000
+				: 1000 - (dtz + fifty);
+		else if (dtz < 0)
+			rank[i] = (((-dtz * 2) + fifty) < 100) ? -1000
+				: -1000 + (-dtz + fifty);
+		else
+			rank[i] = 0;
+		if (rank[i] > best)
+			best = rank[i];
+	}
+	for (int i = 1; i <= lsPtr[0]; ++i)
+		if (rank[i] == best)
+			lsPtr[++length] = lsPtr[i];
+	lsPtr[0] = length;
+	if (best >= 1000)
+		*scorePtr = TB_WIN_SCORE;
+	else if (best > 0)
+		*scorePtr = 1;
+	else if (best == 0)
+		*scorePtr = 0;
+	else if (best > -1000)
+		*scorePtr = -1;
+	else
+		*scorePtr = -TB_WIN_SCORE;
+	return 1;
+}
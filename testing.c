@@ -1,142 +1,434 @@
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "headers/chess.h"
 #include "headers/search.h"
+#include "headers/notation.h"
+#include "headers/tbprobe.h"
 #include "headers/testpos.h"
 
-const char files[8] = { 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h' };
+/*
+ * Perft regression suite
+ * Usage: testing [threads] [budget] [syzygy path]
+ * Runs the positions of perft_suite in parallel, each one depth after depth
+ * until the next depth is expected to overrun its time budget in
+ * milliseconds. When a count is wrong the tree is bisected against a slow
+ * reference move generator down to the first position where the two
+ * disagree. Given a directory of Syzygy tables, the positions of tb_suite are
+ * probed too, those with more pieces than the largest table are skipped. The
+ * exit status is the number of failures
+ */
 
-char getpiece(const struct position_t, int, int);
+#define PERFT_BUDGET 2000
+#define MAX_THREADS 64
+#define REPORT_LENGTH 1024
+/* pseudo-legal moves of the reference generator */
+#define REF_MOVES 256
 
-void printpos(struct position_t);
+struct result_t {
+	int depth;
+	unsigned long long nodes;
+	unsigned long long time;
+	int failed;
+	char report[REPORT_LENGTH];
+};
 
-unsigned long long dperft(struct position_t *posPtr, int depth, int indent);
+static struct result_t results[PERFT_SUITE_SIZE];
+static unsigned long long budget = PERFT_BUDGET;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned next_test = 0;
 
-int main(void)
+/*
+ * Reference move generator, plain steps on a mailbox board with the pieces
+ * as PIECETYPES, negative for black
+ * It shares only make_move() and unmake_move() with the engine
+ */
+static const int knight_steps[8][2] = {
+	{ 1, 2 }, { 2, 1 }, { 2, -1 }, { 1, -2 },
+	{ -1, -2 }, { -2, -1 }, { -2, 1 }, { -1, 2 }
+};
+/* even directions are straight, odd ones diagonal */
+static const int king_steps[8][2] = {
+	{ 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 },
+	{ -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 }
+};
+
+static void fill_board(const struct position_t *posPtr, int board[64])
 {
-	struct position_t testpos = START_POSITION;
-	uint16_t movelist[MAX_MOVES + 1] = { 0 };
-	int start;
-	int end;
-	int depth = 7;
-	printf("%s", "Starting perft tests\n");
-	while ((depth < 1) || (depth > 6)) {
-		printf("%s", "depth(1-6): ");
-		scanf("%d", &depth);
+	for (int sq = 0; sq < 64; ++sq) {
+		board[sq] = 0;
+		for (int pt = PAWN; pt <= KING; ++pt) {
+			if (posPtr->pieces[WHITE][pt] & (1ull << sq))
+				board[sq] = pt;
+			else if (posPtr->pieces[BLACK][pt] & (1ull << sq))
+				board[sq] = -pt;
+		}
 	}
-	printpos(testpos);
-	for (int i = 1; i <= depth; ++i) 
-		printf("%s%d%s%-15d%s%d\n", "Perft(", i,
-				") Expected value ", start_position_expected[i],
-				" Actual value ", perft(&testpos, i));
-	testpos = perft1;
-	printf("%s", "Perft test position 1:\n");
-	printpos(perft1);
-	for (int i = 1; i <= depth; ++i) 
-		printf("%s%d%s%-15d%s%d\n", "Perft(", i,
-				") Expected value ", perft1_expected[i],
-				" Actual value ", perft(&testpos, i));
-	testpos = perft1;
-	generate_moves(testpos, movelist);
-	for (int i = 1; i <= movelist[0]; ++i) {
-		start = movelist[i] & START_SQUARE;
-		end = (movelist[i] & END_SQUARE) >> 6;
-		make_move(&testpos, movelist[i]);
-		printf( "%c%d%c%d", files[start % 8], (start / 8) + 1,
-				files[end % 8], (end / 8) + 1);
-		printf( "%s%d\n", " ", perft(&testpos, depth - 1));
-		unmake_move(&testpos, movelist[i]);
+}
+
+/* Returns the square a step away, -1 if it is off the board */
+static int step(int sq, int dr, int df)
+{
+	int r = (sq / 8) + dr;
+	int f = (sq % 8) + df;
+	return ((r < 0) || (r > 7) || (f < 0) || (f > 7)) ? -1 : (r * 8) + f;
+}
+
+static int ref_attacked(const int board[64], int sq, int color)
+{
+	int sign = color ? -1 : 1;
+	int to;
+	for (int i = 0; i < 8; ++i) {
+		to = step(sq, knight_steps[i][0], knight_steps[i][1]);
+		if ((to >= 0) && (board[to] == sign * KNIGHT))
+			return 1;
+		to = step(sq, king_steps[i][0], king_steps[i][1]);
+		if ((to >= 0) && (board[to] == sign * KING))
+			return 1;
+		to = sq;
+		while ((to = step(to, king_steps[i][0], king_steps[i][1])) >= 0) {
+			if (board[to] == 0)
+				continue;
+			if ((board[to] == sign * QUEEN) || (board[to]
+					== sign * ((i & 1) ? BISHOP : ROOK)))
+				return 1;
+			break;
+		}
+	}
+	/* pawns attack from one rank behind the square */
+	for (int df = -1; df <= 1; df += 2) {
+		to = step(sq, color ? 1 : -1, df);
+		if ((to >= 0) && (board[to] == sign * PAWN))
+			return 1;
 	}
 	return 0;
 }
 
-unsigned long long dperft(struct position_t *posPtr, int depth, int indent)
+static void add_move(uint16_t *lsPtr, int start, int end, uint16_t flags)
+{
+	lsPtr[++lsPtr[0]] = start | (end << 6) | flags;
+}
+
+static void add_pawn_move(uint16_t *lsPtr, int start, int end, uint16_t flags)
+{
+	if ((end / 8 == RANK_1) || (end / 8 == RANK_8)) {
+		add_move(lsPtr, start, end, flags | KNIGHT_PROMOTION);
+		add_move(lsPtr, start, end, flags | BISHOP_PROMOTION);
+		add_move(lsPtr, start, end, flags | ROOK_PROMOTION);
+		add_move(lsPtr, start, end, flags | QUEEN_PROMOTION);
+	} else {
+		add_move(lsPtr, start, end, flags);
+	}
+}
+
+static void ref_pseudo_moves(const struct position_t *posPtr,
+		const int board[64], uint16_t *lsPtr)
 {
-	uint16_t movelist[MAX_MOVES + 1];
-	uint64_t total = 0;
-	uint64_t tmp;
-	int start, end;
 	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
-	movelist[0] = 0;
-	generate_moves(*posPtr, movelist);
-	for (int i = 1; i <= movelist[0]; ++i) 
-		if (((movelist[i] & END_SQUARE) >> 6) 
-				== posPtr->kingpos[BLACK - color]) 
-			return 0;
+	int sign = color ? -1 : 1;
+	int forward = color ? -1 : 1;
+	int ep = (posPtr->flags & EN_PASSANT) ? (int)(posPtr->flags & EP_SQUARE)
+		: -1;
+	int home = color ? S_E8 : S_E1;
+	int pt, to;
+	for (int sq = 0; sq < 64; ++sq) {
+		if (board[sq] * sign <= 0)
+			continue;
+		pt = board[sq] * sign;
+		if (pt == PAWN) {
+			to = step(sq, forward, 0);
+			if (!board[to]) {
+				add_pawn_move(lsPtr, sq, to, 0);
+				if ((sq / 8 == (color ? RANK_7 : RANK_2))
+						&& !board[to + (8 * forward)])
+					add_move(lsPtr, sq, to + (8 * forward),
+							DOUBLE_PAWN_PUSH);
+			}
+			for (int df = -1; df <= 1; df += 2) {
+				if ((to = step(sq, forward, df)) < 0)
+					continue;
+				if (board[to] * sign < 0)
+					add_pawn_move(lsPtr, sq, to, CAPTURE_MOVE);
+				else if (to == ep)
+					add_move(lsPtr, sq, to, EP_CAPTURE);
+			}
+			continue;
+		}
+		for (int i = 0; i < 8; ++i) {
+			if (((pt == BISHOP) && !(i & 1))
+					|| ((pt == ROOK) && (i & 1)))
+				continue;
+			to = sq;
+			do {
+				to = (pt == KNIGHT) ? step(to, knight_steps[i][0],
+						knight_steps[i][1]) : step(to,
+						king_steps[i][0], king_steps[i][1]);
+				if ((to < 0) || (board[to] * sign > 0))
+					break;
+				add_move(lsPtr, sq, to, board[to] ? CAPTURE_MOVE
+						: 0);
+			} while (!board[to] && (pt != KNIGHT) && (pt != KING));
+		}
+	}
+	if ((board[home] != sign * KING) || ref_attacked(board, home, !color))
+		return;
+	if ((posPtr->flags & (color ? BLACK_KINGSIDE_CASTLE
+					: WHITE_KINGSIDE_CASTLE))
+			&& (board[home + 3] == sign * ROOK)
+			&& !board[home + 1] && !board[home + 2]
+			&& !ref_attacked(board, home + 1, !color))
+		add_move(lsPtr, home, home + 2, KINGSIDE_CASTLE);
+	if ((posPtr->flags & (color ? BLACK_QUEENSIDE_CASTLE
+					: WHITE_QUEENSIDE_CASTLE))
+			&& (board[home - 4] == sign * ROOK)
+			&& !board[home - 1] && !board[home - 2]
+			&& !board[home - 3]
+			&& !ref_attacked(board, home - 1, !color))
+		add_move(lsPtr, home, home - 2, QUEENSIDE_CASTLE);
+}
+
+static void ref_moves(struct position_t *posPtr, uint16_t *lsPtr)
+{
+	uint16_t pseudo[REF_MOVES + 1];
+	int board[64];
+	int color = (posPtr->flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	int king = color ? -KING : KING;
+	int sq;
+	fill_board(posPtr, board);
+	pseudo[0] = 0;
+	ref_pseudo_moves(posPtr, board, pseudo);
+	lsPtr[0] = 0;
+	for (int i = 1; i <= pseudo[0]; ++i) {
+		make_move(posPtr, pseudo[i]);
+		fill_board(posPtr, board);
+		for (sq = 0; board[sq] != king; ++sq)
+			;
+		if (!ref_attacked(board, sq, !color))
+			lsPtr[++lsPtr[0]] = pseudo[i];
+		unmake_move(posPtr, pseudo[i]);
+	}
+}
+
+static unsigned long long ref_perft(struct position_t *posPtr, int depth)
+{
+	uint16_t movelist[MAX_MOVES + 1];
+	unsigned long long total = 0;
 	if (depth == 0)
 		return 1;
+	ref_moves(posPtr, movelist);
+	if (depth == 1)
+		return movelist[0];
 	for (int i = 1; i <= movelist[0]; ++i) {
-		start = movelist[i] & START_SQUARE;
-		end = (movelist[i] & END_SQUARE) >> 6;
 		make_move(posPtr, movelist[i]);
-		tmp = dperft(posPtr, depth - 1, indent + 1);
-		if (!tmp) {
-			unmake_move(posPtr, movelist[i]);
-			continue;
-		}
-		total += tmp;
-		putchar('\n');
-		for (int j = 0; j < indent; ++j)
-			putchar('\t');
-		printf("%c%d%c%d%s%d", files[start % 8], (start / 8) + 1,
-				files[end % 8], (end / 8) + 1, "  ", tmp);
+		total += ref_perft(posPtr, depth - 1);
 		unmake_move(posPtr, movelist[i]);
 	}
 	return total;
 }
-void printpos(struct position_t pos)
-{
-	char display[10][19] = {
-		"#################\n",
-		"#% % % % % % % %#\n",
-		"#% % % % % % % %#\n",
-		"#% % % % % % % %#\n",
-		"#% % % % % % % %#\n",
-		"#% % % % % % % %#\n",
-		"#% % % % % % % %#\n",
-		"#% % % % % % % %#\n",
-		"#% % % % % % % %#\n",
-		"#################\n"
-	};
-	uint64_t bb = 0;
-	for (signed i = 7; i >= 0; --i) {
-		for (int j = 0; j < 8; ++j) {
-			bb = (1ull << ((i * 8) + j));
-			display[8 - i][1 + (2 * j)] = getpiece(pos, i, j);
-		}
+
+/* The legal moves of the engine, as perft() counts them */
+static void engine_moves(struct position_t *posPtr, uint16_t *lsPtr)
+{
+	uint16_t pseudo[MAX_MOVES + 1];
+	pseudo[0] = 0;
+	generate_moves(posPtr, pseudo);
+	lsPtr[0] = 0;
+	for (int i = 1; i <= pseudo[0]; ++i) {
+		make_move(posPtr, pseudo[i]);
+		if (was_legal(posPtr))
+			lsPtr[++lsPtr[0]] = pseudo[i];
+		unmake_move(posPtr, pseudo[i]);
 	}
-	for (int i = 0; i < 10; ++i)
-		printf("%s", display[i]);
 }
 
-char getpiece(const struct position_t pos, int i, int j)
+/* Returns the first move of a list not in another one, 0 if there is none */
+static uint16_t missing_move(const uint16_t *lsPtr, const uint16_t *fromPtr)
 {
-	char whitepieces[7] = { '%', 'P', 'N', 'B', 'R', 'Q', 'K' };
-	char blackpieces[7] = { '%', 'p', 'n', 'b', 'r', 'q', 'k' };
-	uint64_t bb = 0;
-	bb = 1ull << ((i * 8) + j);
-	if (pos.occupied & bb) {
-		if (pos.pieces[WHITE][0] & bb) {
-			for (int k = PAWN; k <= KING; ++k) {
-				if (pos.pieces[WHITE][k] & bb)
-					return whitepieces[k];
-			}
-			return '%';
-		} else if (pos.pieces[BLACK][0] & bb) {
-			for (int k = PAWN; k <= KING; ++k) {
-				if (pos.pieces[BLACK][k] & bb)
-					return blackpieces[k];
+	int j;
+	for (int i = 1; i <= fromPtr[0]; ++i) {
+		for (j = 1; (j <= lsPtr[0]) && (lsPtr[j] != fromPtr[i]); ++j)
+			;
+		if (j > lsPtr[0])
+			return fromPtr[i];
+	}
+	return 0;
+}
+
+/*
+ * Follows the move whose subtree counts differ between perft() and the
+ * reference until the two disagree on the moves of a position
+ */
+static void bisect(struct position_t pos, int depth, char *str, size_t size)
+{
+	uint16_t engine[MAX_MOVES + 1];
+	uint16_t ref[MAX_MOVES + 1];
+	char mv[MOVE_STRING_LENGTH];
+	char fen[FEN_LENGTH];
+	int length = snprintf(str, size, "\tline:");
+	uint16_t diverging;
+	const char *what;
+	for (;;) {
+		engine_moves(&pos, engine);
+		ref_moves(&pos, ref);
+		if ((diverging = missing_move(engine, ref))) {
+			what = "engine misses";
+			break;
+		}
+		if ((diverging = missing_move(ref, engine))) {
+			what = "engine allows illegal";
+			break;
+		}
+		for (int i = 1; (i <= ref[0]) && (depth > 1); ++i) {
+			make_move(&pos, ref[i]);
+			if (perft(&pos, depth - 1) != ref_perft(&pos, depth - 1)) {
+				diverging = ref[i];
+				break;
 			}
-			return '%';
+			unmake_move(&pos, ref[i]);
+		}
+		if (!diverging) {
+			snprintf(str + length, size - length, " none, engine "
+					"agrees with the reference, check the "
+					"expected count\n");
+			return;
 		}
-		return '%';
+		move_to_coord(diverging, mv);
+		length += snprintf(str + length, size - length, " %s", mv);
+		--depth;
 	}
-	for (int k = 0; k <= KING; ++k) {
-		if (pos.pieces[WHITE][0] & bb)
-			return '%';
+	move_to_coord(diverging, mv);
+	write_fen(&pos, fen);
+	snprintf(str + length, size - length, "\n\t%s %s in %s\n", what, mv,
+			fen);
+}
+
+static void run_test(unsigned index)
+{
+	const struct perft_test_t *test = &perft_suite[index];
+	struct result_t *resPtr = &results[index];
+	struct position_t pos;
+	unsigned long long start;
+	unsigned long long elapsed = 0;
+	parse_fen(&pos, test->fen);
+	for (int d = 1; (d <= PERFT_SUITE_DEPTH) && test->nodes[d]; ++d) {
+		/* expect the next depth to take as much longer as it has nodes */
+		if ((d > 1) && (resPtr->time + (elapsed * test->nodes[d]
+						/ test->nodes[d - 1]) > budget))
+			break;
+		start = get_time_ms();
+		resPtr->nodes = perft(&pos, d);
+		elapsed = get_time_ms() - start;
+		resPtr->time += elapsed;
+		resPtr->depth = d;
+		if (resPtr->nodes != test->nodes[d]) {
+			resPtr->failed = 1;
+			bisect(pos, d, resPtr->report, REPORT_LENGTH);
+			return;
+		}
 	}
-	for (int k = 0; k <= KING; ++k) {
-		if (pos.pieces[BLACK][0] & bb)
-			return '%';
+}
+
+static int dtz_matches(int dtz, int expected)
+{
+	if (expected == 0)
+		return dtz == 0;
+	if (expected < 0)
+		return dtz_matches(-dtz, -expected);
+	if (expected == TB_ANY_DTZ)
+		return dtz > 0;
+	return (dtz == expected) || (dtz == expected + 1);
+}
+
+/* Probes the positions of tb_suite, returns the number of failures */
+static int run_tb_tests(const char *path)
+{
+	const struct tb_test_t *test;
+	struct position_t pos;
+	int failures = 0;
+	int skipped = 0;
+	int wdlok;
+	int dtzok;
+	int wdl;
+	int dtz;
+	if (tb_init(path) == 0) {
+		printf("No tablebases in %s\n", path);
+		return 1;
+	}
+	for (unsigned i = 0; i < TB_SUITE_SIZE; ++i) {
+		test = &tb_suite[i];
+		parse_fen(&pos, test->fen);
+		if (popcount(pos.occupied) > tb_largest) {
+			printf("%-34s skip\n", test->name);
+			++skipped;
+			continue;
+		}
+		wdl = tb_probe_wdl(&pos, &wdlok);
+		dtz = tb_probe_dtz(&pos, &dtzok);
+		if (wdlok && dtzok && (wdl == test->wdl)
+				&& dtz_matches(dtz, test->dtz)) {
+			printf("%-34s pass wdl %2d dtz %4d\n", test->name, wdl,
+					dtz);
+			continue;
+		}
+		printf("%-34s FAIL wdl %2d dtz %4d\n\texpected wdl %d dtz %d"
+				"\n\t%s\n", test->name, wdlok ? wdl : 0,
+				dtzok ? dtz : 0, test->wdl, test->dtz,
+				test->fen);
+		++failures;
+	}
+	printf("%d of %d tablebase probes passed, %d skipped\n",
+			(int)TB_SUITE_SIZE - failures - skipped,
+			(int)TB_SUITE_SIZE, skipped);
+	tb_free();
+	return failures;
+}
+
+static void *worker(void *arg)
+{
+	unsigned index;
+	(void)arg;
+	for (;;) {
+		pthread_mutex_lock(&lock);
+		index = next_test++;
+		pthread_mutex_unlock(&lock);
+		if (index >= PERFT_SUITE_SIZE)
+			return NULL;
+		run_test(index);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t threads[MAX_THREADS];
+	int nthreads = (argc > 1) ? atoi(argv[1]) : sysconf(_SC_NPROCESSORS_ONLN);
+	int failures = 0;
+	unsigned long long start = get_time_ms();
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > MAX_THREADS)
+		nthreads = MAX_THREADS;
+	if (argc > 2)
+		budget = strtoull(argv[2], NULL, 10);
+	for (int i = 0; i < nthreads; ++i)
+		pthread_create(&threads[i], NULL, worker, NULL);
+	for (int i = 0; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+	for (unsigned i = 0; i < PERFT_SUITE_SIZE; ++i) {
+		printf("%-34s %s perft(%d) = %-11llu %6llu ms\n",
+				perft_suite[i].name, results[i].failed ? "FAIL"
+				: "pass", results[i].depth, results[i].nodes,
+				results[i].time);
+		if (results[i].failed) {
+			printf("\texpected %llu\n%s", perft_suite[i].nodes[
+					results[i].depth], results[i].report);
+			++failures;
+		}
 	}
-	return '.';
+	printf("%d of %d passed in %llu ms\n", (int)PERFT_SUITE_SIZE - failures,
+			(int)PERFT_SUITE_SIZE, get_time_ms() - start);
+	if (argc > 3)
+		failures += run_tb_tests(argv[3]);
+	return failures;
 }
@@ -0,0 +1,55 @@
+#include "headers/chess.h"
+#include "headers/search.h"
+#include "headers/timeman.h"
+
+/*
+ * Percentage of the soft limit used, by the number of iterations in a row the
+ * best move has been the same
+ */
+static const int stability_scale[5] = { 150, 110, 90, 75, 60 };
+
+void time_allocate(struct search_t *searchPtr, unsigned long long time,
+		unsigned long long increment, int movestogo,
+		unsigned long long overhead)
+{
+	unsigned long long now = get_time_ms();
+	unsigned long long left;
+	unsigned long long soft;
+	unsigned long long hard;
+	int moves;
+	if (time == 0) {
+		searchPtr->softlimit = 0;
+		searchPtr->deadline = 0;
+		return;
+	}
+	moves = ((movestogo > 0) && (movestogo < TIME_MOVES))
+		? movestogo : TIME_MOVES;
+	left = (time > overhead) ? (time - overhead) : 1;
+	soft = (left / moves) + ((increment * 3) / 4);
+	/* the last move before the time control may use all of the clock */
+	if (moves == 1)
+		hard = left;
+	else
+		hard = (soft * HARD_RATIO < left / 2) ? (soft * HARD_RATIO)
+			: (left / 2);
+	if (hard == 0)
+		hard = 1;
+	if (soft > hard)
+		soft = hard;
+	searchPtr->softlimit = now + soft;
+	searchPtr->deadline = now + hard;
+}
+
+int time_soft_expired(const struct search_t *searchPtr, int stable)
+{
+	unsigned long long budget;
+	if (searchPtr->softlimit == 0)
+		return 0;
+	if (searchPtr->softlimit <= searchPtr->starttime)
+		return 1;
+	if (stable > 4)
+		stable = 4;
+	budget = ((searchPtr->softlimit - searchPtr->starttime)
+			* stability_scale[stable]) / 100;
+	return get_time_ms() >= searchPtr->starttime + budget;
+}
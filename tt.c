@@ -0,0 +1,337 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "headers/chess.h"
+#include "headers/tt.h"
+
+#define AGE_MASK 0x3fu
+
+/* Slice of the table cleared by one thread */
+struct clear_job_t {
+	char *start;
+	size_t size;
+};
+
+static uint64_t pack(uint16_t move, signed score, int depth, int bound,
+		unsigned age)
+{
+	return (uint64_t)move | ((uint64_t)(uint16_t)score << 16)
+		| ((uint64_t)(uint8_t)depth << 32) | ((uint64_t)bound << 40)
+		| ((uint64_t)(age & AGE_MASK) << 42);
+}
+
+static int entry_depth(uint64_t data)
+{
+	return (data >> 32) & 0xff;
+}
+
+static unsigned entry_age(uint64_t data)
+{
+	return (data >> 42) & AGE_MASK;
+}
+
+/* Checksum of everything a saved table depends on besides its size */
+static uint64_t scheme_checksum(void)
+{
+	const unsigned char *bytes = (const unsigned char *)polyglot_random;
+	uint64_t sum = 0xcbf29ce484222325ull;
+	uint64_t layout[3] = { TT_FILE_VERSION, TT_BUCKET_SIZE,
+		sizeof(struct tt_entry_t) };
+	/* FNV-1a */
+	for (size_t i = 0; i < sizeof(polyglot_random); ++i)
+		sum = (sum ^ bytes[i]) * 0x100000001b3ull;
+	bytes = (const unsigned char *)layout;
+	for (size_t i = 0; i < sizeof(layout); ++i)
+		sum = (sum ^ bytes[i]) * 0x100000001b3ull;
+	return sum;
+}
+
+/* Largest power of two number of buckets in mb megabytes, at least a page */
+static uint64_t bucket_count(size_t mb)
+{
+	uint64_t count = 1;
+	while ((count * 2 * sizeof(struct tt_bucket_t)) <= (mb << 20))
+		count *= 2;
+	/* a mapping from the reserved pages has to be a whole number of them */
+	if (count * sizeof(struct tt_bucket_t) < HUGE_PAGE_SIZE)
+		count = HUGE_PAGE_SIZE / sizeof(struct tt_bucket_t);
+	return count;
+}
+
+static void *clear_slice(void *arg)
+{
+	struct clear_job_t *jobPtr = arg;
+	memset(jobPtr->start, 0, jobPtr->size);
+	return NULL;
+}
+
+/*
+ * Maps size bytes aligned to a huge page, from the reserved huge pages if
+ * there are enough, otherwise as normal memory advised to use transparent
+ * huge pages
+ */
+static void *map_table(size_t size, int *hugetlbPtr)
+{
+	char *p;
+	size_t head;
+	*hugetlbPtr = 0;
+#ifdef MAP_HUGETLB
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED) {
+		*hugetlbPtr = 1;
+		return p;
+	}
+#endif
+	/* transparent huge pages need a 2 MB aligned address */
+	p = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	head = (HUGE_PAGE_SIZE - ((uintptr_t)p % HUGE_PAGE_SIZE))
+		% HUGE_PAGE_SIZE;
+	if (head)
+		munmap(p, head);
+	munmap(p + head + size, HUGE_PAGE_SIZE - head);
+	p += head;
+#ifdef MADV_HUGEPAGE
+	madvise(p, size, MADV_HUGEPAGE);
+#endif
+	return p;
+}
+
+int tt_alloc(struct tt_t *ttPtr, size_t mb, int threads)
+{
+	uint64_t count = bucket_count(mb);
+	tt_free(ttPtr);
+	if (mb == 0)
+		return 0;
+	ttPtr->size = count * sizeof(struct tt_bucket_t);
+	ttPtr->buckets = map_table(ttPtr->size, &ttPtr->hugetlb);
+	if (ttPtr->buckets == NULL) {
+		ttPtr->size = 0;
+		return 0;
+	}
+	ttPtr->mask = count - 1;
+	ttPtr->age = 0;
+	tt_clear(ttPtr, threads);
+	return 1;
+}
+
+int tt_map_file(struct tt_t *ttPtr, const char *path, size_t mb,
+		int threads)
+{
+	struct tt_file_header_t header;
+	struct stat st;
+	uint64_t count = bucket_count(mb);
+	size_t size = count * sizeof(struct tt_bucket_t);
+	static const char unfinished[8] = { 0 };
+	int loaded;
+	int ours;
+	char *p;
+	int fd;
+	tt_free(ttPtr);
+	if ((mb == 0) || ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0))
+		return TT_FILE_FAILED;
+	if (fstat(fd, &st)) {
+		close(fd);
+		return TT_FILE_FAILED;
+	}
+	/* a new file, a table file or one whose creation was cut short */
+	ours = (st.st_size == 0);
+	if (!ours && (read(fd, &header, sizeof(header)) == sizeof(header)))
+		ours = !memcmp(header.magic, TT_FILE_MAGIC,
+				sizeof(header.magic))
+			|| (!memcmp(header.magic, unfinished,
+					sizeof(header.magic))
+				&& (header.version == TT_FILE_VERSION));
+	if (!ours) {
+		close(fd);
+		return TT_FILE_FAILED;
+	}
+	loaded = (st.st_size != 0)
+		&& !memcmp(header.magic, TT_FILE_MAGIC, sizeof(header.magic))
+		&& (header.version == TT_FILE_VERSION)
+		&& (header.entries == TT_BUCKET_SIZE)
+		&& (header.size == size)
+		&& (header.scheme == scheme_checksum())
+		&& ((size_t)st.st_size == TT_FILE_OFFSET + size);
+	/* any other table of ours is thrown away */
+	if (!loaded && (ftruncate(fd, 0)
+				|| ftruncate(fd, TT_FILE_OFFSET + size))) {
+		close(fd);
+		return TT_FILE_FAILED;
+	}
+	p = mmap(NULL, TT_FILE_OFFSET + size, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED)
+		return TT_FILE_FAILED;
+	ttPtr->header = (struct tt_file_header_t *)p;
+	ttPtr->buckets = (struct tt_bucket_t *)(p + TT_FILE_OFFSET);
+	ttPtr->mask = count - 1;
+	ttPtr->size = size;
+	ttPtr->hugetlb = 0;
+	if (loaded) {
+		ttPtr->age = header.age & AGE_MASK;
+		return TT_FILE_LOADED;
+	}
+	tt_clear(ttPtr, threads);
+	header.version = TT_FILE_VERSION;
+	header.entries = TT_BUCKET_SIZE;
+	header.size = size;
+	header.scheme = scheme_checksum();
+	header.age = 0;
+	memset(header.magic, 0, sizeof(header.magic));
+	*ttPtr->header = header;
+	/* the cleared table is on disk before the file is marked valid */
+	tt_sync(ttPtr);
+	memcpy(ttPtr->header->magic, TT_FILE_MAGIC, sizeof(header.magic));
+	return TT_FILE_NEW;
+}
+
+void tt_sync(struct tt_t *ttPtr)
+{
+	if (ttPtr->header == NULL)
+		return;
+	ttPtr->header->age = ttPtr->age;
+	msync(ttPtr->header, TT_FILE_OFFSET + ttPtr->size, MS_SYNC);
+}
+
+void tt_free(struct tt_t *ttPtr)
+{
+	if (ttPtr->header != NULL) {
+		tt_sync(ttPtr);
+		munmap(ttPtr->header, TT_FILE_OFFSET + ttPtr->size);
+	} else if (ttPtr->buckets != NULL) {
+		munmap(ttPtr->buckets, ttPtr->size);
+	}
+	ttPtr->buckets = NULL;
+	ttPtr->header = NULL;
+	ttPtr->mask = 0;
+	ttPtr->size = 0;
+	ttPtr->hugetlb = 0;
+}
+
+void tt_clear(struct tt_t *ttPtr, int threads)
+{
+	pthread_t tids[threads > 0 ? threads : 1];
+	struct clear_job_t jobs[threads > 0 ? threads : 1];
+	size_t pages = (ttPtr->size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE;
+	size_t offset = 0;
+	int started = 0;
+	if (ttPtr->buckets == NULL)
+		return;
+	if (threads < 1)
+		threads = 1;
+	if ((size_t)threads > pages)
+		threads = pages;
+	/* whole huge pages per thread, the first threads get one extra */
+	for (int i = 0; i < threads; ++i) {
+		jobs[i].start = (char *)ttPtr->buckets + offset;
+		jobs[i].size = ((pages / threads) + ((size_t)i < pages % threads))
+			* HUGE_PAGE_SIZE;
+		if (offset + jobs[i].size > ttPtr->size)
+			jobs[i].size = ttPtr->size - offset;
+		offset += jobs[i].size;
+	}
+	for (int i = 1; i < threads; ++i) {
+		if (pthread_create(&tids[i], NULL, clear_slice, &jobs[i]))
+			break;
+		++started;
+	}
+	clear_slice(&jobs[0]);
+	for (int i = 1; i <= started; ++i)
+		pthread_join(tids[i], NULL);
+	/* slices left over when a thread could not be started */
+	for (int i = started + 1; i < threads; ++i)
+		clear_slice(&jobs[i]);
+	ttPtr->age = 0;
+}
+
+size_t tt_huge_bytes(const struct tt_t *ttPtr)
+{
+	char line[256];
+	unsigned long start;
+	unsigned long end;
+	size_t kb;
+	int inside = 0;
+	FILE *smaps;
+	if (ttPtr->buckets == NULL)
+		return 0;
+	if (ttPtr->hugetlb)
+		return ttPtr->size;
+	/* transparent huge pages are counted per mapping by the kernel */
+	if ((smaps = fopen("/proc/self/smaps", "r")) == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), smaps)) {
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+			inside = ((uintptr_t)ttPtr->buckets >= start)
+				&& ((uintptr_t)ttPtr->buckets < end);
+		} else if (inside && (sscanf(line, "AnonHugePages: %zu kB",
+						&kb) == 1)) {
+			fclose(smaps);
+			return ((kb << 10) > ttPtr->size) ? ttPtr->size
+				: (kb << 10);
+		}
+	}
+	fclose(smaps);
+	return 0;
+}
+
+void tt_new_search(struct tt_t *ttPtr)
+{
+	ttPtr->age = (ttPtr->age + 1) & AGE_MASK;
+}
+
+int tt_probe(const struct tt_t *ttPtr, uint64_t key, struct tt_hit_t *hitPtr)
+{
+	const struct tt_entry_t *entries
+		= ttPtr->buckets[key & ttPtr->mask].entries;
+	uint64_t data;
+	for (int i = 0; i < TT_BUCKET_SIZE; ++i) {
+		data = entries[i].data;
+		if ((entries[i].check ^ data) != key)
+			continue;
+		hitPtr->move = data & 0xffff;
+		hitPtr->score = (int16_t)(data >> 16);
+		hitPtr->depth = entry_depth(data);
+		hitPtr->bound = (data >> 40) & 3;
+		return 1;
+	}
+	return 0;
+}
+
+void tt_store(struct tt_t *ttPtr, uint64_t key, uint16_t move, signed score,
+		int depth, int bound)
+{
+	struct tt_entry_t *entries = ttPtr->buckets[key & ttPtr->mask].entries;
+	struct tt_entry_t *victim = &entries[0];
+	int worth;
+	int least = 0x7fffffff;
+	uint64_t data;
+	for (int i = 0; i < TT_BUCKET_SIZE; ++i) {
+		data = entries[i].data;
+		if ((entries[i].check ^ data) == key) {
+			victim = &entries[i];
+			if (move == 0)
+				move = data & 0xffff;
+			break;
+		}
+		/* every search an entry is older costs it as much as 8 plies */
+		worth = entry_depth(data) - (8 * ((ttPtr->age - entry_age(data))
+					& AGE_MASK));
+		if (worth < least) {
+			least = worth;
+			victim = &entries[i];
+		}
+	}
+	data = pack(move, score, depth, bound, ttPtr->age);
+	victim->check = key ^ data;
+	victim->data = data;
+}
@@ -0,0 +1,442 @@
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "headers/archive.h"
+#include "headers/chess.h"
+#include "headers/notation.h"
+#include "headers/pack.h"
+#include "headers/search.h"
+
+/*
+ * Texel tuner of the evaluation tables
+ * usage: tune [-t threads] [-e epochs] [-r rate] [-k scale] [-l lambda]
+ *             [-o output] data...
+ * 	-t - number of threads, defaults to the number of cores
+ * 	-e - number of epochs, defaults to 500
+ * 	-r - learning rate of Adam in centipawns, defaults to 1
+ * 	-k - scale of the sigmoid, found by a line search if not given
+ * 	-l - weight of the search score against the game result in the target,
+ * 	     defaults to 0 (result only)
+ * 	-o - file to write the tuned tables to, defaults to stdout
+ * Data files are archives (archive.h) or text files of lines
+ * 	<fen> | <score> | <result>
+ * as written by datagen, the score in centipawns and the result (1, 0.5 or 0)
+ * both for white
+ * The evaluation is linear in piece_values and piece_square_tables, so each
+ * position is loaded once as the list of table entries it adds or subtracts.
+ * Each epoch evaluates every position with the current tables, and the
+ * gradient of the mean squared error between sigmoid(scale * eval / 400)
+ * and the target is summed by all threads at once, then Adam takes one step.
+ * The tables are written as source in the layout of eval.c, on SIGINT after
+ * the epoch in progress
+ */
+
+#define DEFAULT_EPOCHS 500
+#define REPORT_EPOCHS 10
+#define LINE_LENGTH 512
+/* feature of a piece: 64 * (piecetype - 1) + square, plus FEATURES for black */
+#define FEATURES 384
+#define ADAM_BETA1 0.9
+#define ADAM_BETA2 0.999
+#define ADAM_EPSILON 1e-8
+
+/*
+ * struct dataset_t
+ * Positions as a structure of arrays
+ * 	count: number of pieces of each position
+ * 	features: features of each position in turn, the pieces of position i
+ * 	          follow those of position i - 1
+ * 	target: expected score of each position for white, first the result
+ * 	score: score of the search of each position for white
+ */
+struct dataset_t {
+	size_t size;
+	size_t nfeatures;
+	uint8_t *count;
+	uint16_t *features;
+	float *target;
+	int16_t *score;
+	size_t capacity;
+	size_t fcapacity;
+};
+
+/*
+ * struct slice_t
+ * Positions handled by one thread each epoch
+ * 	start, end: positions of the slice
+ * 	feature: first feature of the slice
+ * 	gradient: sum of the gradient over the slice, one per signed feature
+ * 	error: sum of the squared error over the slice
+ */
+struct slice_t {
+	size_t start;
+	size_t end;
+	size_t feature;
+	double gradient[2 * FEATURES];
+	double error;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+static struct dataset_t data = { 0 };
+/* value of each signed feature in centipawns, black features negated */
+static float weights[2 * FEATURES];
+static double scale = 0.0;
+static volatile sig_atomic_t quitting = 0;
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	quitting = 1;
+}
+
+static void add_position(const struct packed_position_t *packedPtr)
+{
+	uint64_t bb = packedPtr->occupied;
+	int code;
+	int n = 0;
+	if (data.size == data.capacity) {
+		data.capacity = data.capacity ? (2 * data.capacity) : (1 << 20);
+		data.count = realloc(data.count, data.capacity);
+		data.target = realloc(data.target,
+				data.capacity * sizeof(float));
+		data.score = realloc(data.score,
+				data.capacity * sizeof(int16_t));
+	}
+	if (data.nfeatures + 32 > data.fcapacity) {
+		data.fcapacity = data.fcapacity ? (2 * data.fcapacity)
+			: (32 << 20);
+		data.features = realloc(data.features,
+				data.fcapacity * sizeof(uint16_t));
+	}
+	if (!data.count || !data.target || !data.score || !data.features) {
+		fprintf(stderr, "Not enough memory for %zu positions\n",
+				data.size);
+		exit(EXIT_FAILURE);
+	}
+	for (; bb && (n < 32); bb &= bb - 1, ++n) {
+		code = (packedPtr->pieces[n / 2] >> (4 * (n % 2))) & 0xf;
+		/* black squares are mirrored, as in evaluate() */
+		data.features[data.nfeatures++] = (code % 2)
+			? (FEATURES + (64 * ((code / 2) - 1))
+					+ (ls1bindice(bb) ^ 56))
+			: ((64 * ((code / 2) - 1)) + ls1bindice(bb));
+	}
+	data.count[data.size] = n;
+	data.target[data.size] = packedPtr->result / 2.0f;
+	data.score[data.size++] = packedPtr->score;
+}
+
+static int load_archive(const char *path)
+{
+	static struct archive_t archive;
+	static struct packed_position_t chunk[ARCHIVE_CHUNK_RECORDS];
+	int n;
+	if (!archive_open(&archive, path))
+		return 0;
+	for (uint64_t i = 0; i < archive.header->chunks; ++i) {
+		n = archive_read_chunk(&archive, i, chunk);
+		for (int j = 0; j < n; ++j)
+			add_position(&chunk[j]);
+	}
+	archive_close(&archive);
+	return 1;
+}
+
+static void load_text(const char *path)
+{
+	struct position_t pos;
+	struct packed_position_t packed;
+	char line[LINE_LENGTH];
+	const char *p;
+	double result;
+	int score;
+	FILE *in = fopen(path, "r");
+	if (in == NULL) {
+		perror(path);
+		exit(EXIT_FAILURE);
+	}
+	while (fgets(line, sizeof(line), in)) {
+		if (!parse_fen(&pos, line) || ((p = strchr(line, '|')) == NULL)
+				|| (sscanf(p, "| %d | %lf", &score, &result) != 2))
+			continue;
+		pack_position(&pos, &packed);
+		packed.score = score;
+		packed.result = (result > 0.75) ? PACKED_WIN
+			: ((result < 0.25) ? PACKED_LOSS : PACKED_DRAW);
+		add_position(&packed);
+	}
+	fclose(in);
+}
+
+static void set_weights(const double *values, const double *psts)
+{
+	for (int i = 0; i < FEATURES; ++i) {
+		weights[i] = values[(i / 64) + 1] + psts[i];
+		weights[FEATURES + i] = -weights[i];
+	}
+}
+
+static double sigmoid(double eval)
+{
+	return 1.0 / (1.0 + pow(10.0, -scale * eval / 400.0));
+}
+
+/* Adds up the error and its gradient over a slice */
+static void *slice_gradient(void *arg)
+{
+	struct slice_t *slicePtr = arg;
+	const uint16_t *f = data.features + slicePtr->feature;
+	/* 10^x = e^(x ln 10) */
+	const float k = -scale * M_LN10 / 400.0;
+	float eval;
+	float s;
+	float d;
+	int n;
+	memset(slicePtr->gradient, 0, sizeof(slicePtr->gradient));
+	slicePtr->error = 0.0;
+	for (size_t i = slicePtr->start; i < slicePtr->end; ++i) {
+		n = data.count[i];
+		eval = 0.0f;
+		for (int j = 0; j < n; ++j)
+			eval += weights[f[j]];
+		s = 1.0f / (1.0f + expf(k * eval));
+		d = s - data.target[i];
+		slicePtr->error += d * d;
+		/* d(error)/d(eval), the constant factors are applied once */
+		d *= s * (1.0f - s);
+		for (int j = 0; j < n; ++j)
+			slicePtr->gradient[f[j]] += d;
+		f += n;
+	}
+	return NULL;
+}
+
+/* Returns the mean squared error, gradient is set for each feature */
+static double run_epoch(struct slice_t *slices, int nthreads,
+		double *gradient)
+{
+	pthread_t tids[nthreads];
+	double error = 0.0;
+	int started = 0;
+	for (int i = 1; i < nthreads; ++i) {
+		if (pthread_create(&tids[i], NULL, slice_gradient, &slices[i]))
+			break;
+		++started;
+	}
+	slice_gradient(&slices[0]);
+	for (int i = 1; i <= started; ++i)
+		pthread_join(tids[i], NULL);
+	for (int i = started + 1; i < nthreads; ++i)
+		slice_gradient(&slices[i]);
+	memset(gradient, 0, FEATURES * sizeof(double));
+	for (int t = 0; t < nthreads; ++t) {
+		error += slices[t].error;
+		for (int i = 0; i < FEATURES; ++i)
+			gradient[i] += slices[t].gradient[i]
+				- slices[t].gradient[FEATURES + i];
+	}
+	for (int i = 0; i < FEATURES; ++i)
+		gradient[i] *= 2.0 * scale * M_LN10 / 400.0 / data.size;
+	return error / data.size;
+}
+
+/* Scale of the sigmoid that fits the current tables to the targets best */
+static void find_scale(struct slice_t *slices, int nthreads)
+{
+	double gradient[FEATURES];
+	double low = 0.0;
+	double high = 10.0;
+	double a;
+	double b;
+	double ea;
+	double eb;
+	/* golden section search */
+	for (int i = 0; i < 40; ++i) {
+		a = high - (0.618034 * (high - low));
+		b = low + (0.618034 * (high - low));
+		scale = a;
+		ea = run_epoch(slices, nthreads, gradient);
+		scale = b;
+		eb = run_epoch(slices, nthreads, gradient);
+		if (ea < eb)
+			high = b;
+		else
+			low = a;
+	}
+	scale = (low + high) / 2.0;
+}
+
+static void write_tables(FILE *out, const double *values, const double *psts)
+{
+	static const char *names[7] = { "", "Pawn", "Knight", "Bishop",
+		"Rook", "Queen", "King" };
+	fprintf(out, "const int16_t piece_values[7] = { 0");
+	for (int i = PAWN; i < KING; ++i)
+		fprintf(out, ", %d", (int)lround(values[i]));
+	fprintf(out, ", 0 };\n\n/*\n"
+			" * Tables are from white's point of view, a1 first "
+			"(same order as SQUARES)\n"
+			" * Black looks up the vertically mirrored square "
+			"(sq ^ 56)\n */\n"
+			"const int16_t piece_square_tables[7][64] = {\n"
+			"\t{ 0 },\n");
+	for (int pt = PAWN; pt <= KING; ++pt) {
+		fprintf(out, "\t{\n\t\t/* %s */\n", names[pt]);
+		for (int sq = 0; sq < 64; ++sq)
+			fprintf(out, "%s%3ld%s", (sq % 8) ? " " : "\t\t",
+					lround(psts[(64 * (pt - 1)) + sq]),
+					(sq == 63) ? "\n" : ((sq % 8) == 7)
+					? ",\n" : ",");
+		fprintf(out, "\t}%s\n", (pt == KING) ? "" : ",");
+	}
+	fprintf(out, "};\n");
+}
+
+int main(int argc, char **argv)
+{
+	struct slice_t *slices;
+	double values[7];
+	double psts[FEATURES];
+	double gradient[FEATURES];
+	double vgradient[7];
+	double m[7 + FEATURES] = { 0 };
+	double v[7 + FEATURES] = { 0 };
+	double *params[7 + FEATURES];
+	double *grads[7 + FEATURES];
+	double error;
+	double rate = 1.0;
+	double lambda = 0.0;
+	double b1 = 1.0;
+	double b2 = 1.0;
+	const char *output = NULL;
+	FILE *out = stdout;
+	unsigned long long start;
+	size_t feature = 0;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int epochs = DEFAULT_EPOCHS;
+	int epoch;
+	int opt;
+	while ((opt = getopt(argc, argv, "t:e:r:k:l:o:")) != -1) {
+		switch (opt) {
+		case 't':
+			nthreads = atoi(optarg);
+			break;
+		case 'e':
+			epochs = atoi(optarg);
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 'k':
+			scale = atof(optarg);
+			break;
+		case 'l':
+			lambda = atof(optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		default:
+			optind = argc + 1;
+			break;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "usage: %s [-t threads] [-e epochs] [-r rate] "
+				"[-k scale] [-l lambda] [-o output] "
+				"data...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+	start = get_time_ms();
+	for (int i = optind; i < argc; ++i)
+		if (!load_archive(argv[i]))
+			load_text(argv[i]);
+	if (data.size == 0) {
+		fprintf(stderr, "No positions loaded\n");
+		return EXIT_FAILURE;
+	}
+	fprintf(stderr, "Loaded %zu positions in %llu ms\n", data.size,
+			get_time_ms() - start);
+	if ((size_t)nthreads > data.size)
+		nthreads = data.size;
+	if (posix_memalign((void **)&slices, CACHE_LINE_SIZE,
+				nthreads * sizeof(struct slice_t)))
+		return EXIT_FAILURE;
+	for (int t = 0; t < nthreads; ++t) {
+		slices[t].start = (data.size * t) / nthreads;
+		slices[t].end = (data.size * (t + 1)) / nthreads;
+		slices[t].feature = feature;
+		for (size_t i = slices[t].start; i < slices[t].end; ++i)
+			feature += data.count[i];
+	}
+	for (int i = 0; i < 7; ++i)
+		values[i] = piece_values[i];
+	for (int i = 0; i < FEATURES; ++i)
+		psts[i] = piece_square_tables[(i / 64) + 1][i % 64];
+	/* the king is never off the board, its value stays 0 */
+	for (int i = PAWN; i < KING; ++i) {
+		params[i - PAWN] = &values[i];
+		grads[i - PAWN] = &vgradient[i];
+	}
+	for (int i = 0; i < FEATURES; ++i) {
+		params[KING - PAWN + i] = &psts[i];
+		grads[KING - PAWN + i] = &gradient[i];
+	}
+	set_weights(values, psts);
+	if (scale <= 0.0) {
+		find_scale(slices, nthreads);
+		fprintf(stderr, "Scale %.4f\n", scale);
+	}
+	if (lambda > 0.0)
+		for (size_t i = 0; i < data.size; ++i)
+			data.target[i] = ((1.0 - lambda) * data.target[i])
+				+ (lambda * sigmoid(data.score[i]));
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	start = get_time_ms();
+	for (epoch = 1; (epoch <= epochs) && !quitting; ++epoch) {
+		error = run_epoch(slices, nthreads, gradient);
+		/* every square of a piece moves its value */
+		for (int i = PAWN; i < KING; ++i) {
+			vgradient[i] = 0.0;
+			for (int sq = 0; sq < 64; ++sq)
+				vgradient[i] += gradient[(64 * (i - 1)) + sq];
+		}
+		b1 *= ADAM_BETA1;
+		b2 *= ADAM_BETA2;
+		for (int i = 0; i < KING - PAWN + FEATURES; ++i) {
+			m[i] = (ADAM_BETA1 * m[i])
+				+ ((1.0 - ADAM_BETA1) * *grads[i]);
+			v[i] = (ADAM_BETA2 * v[i]) + ((1.0 - ADAM_BETA2)
+					* *grads[i] * *grads[i]);
+			*params[i] -= rate * (m[i] / (1.0 - b1))
+				/ (sqrt(v[i] / (1.0 - b2)) + ADAM_EPSILON);
+		}
+		set_weights(values, psts);
+		if ((epoch % REPORT_EPOCHS) == 0)
+			fprintf(stderr, "Epoch %d: error %.6f, %llu ms per "
+					"epoch\n", epoch, error,
+					(get_time_ms() - start) / epoch);
+	}
+	fprintf(stderr, "Epoch %d: error %.6f\n", epoch - 1, run_epoch(slices,
+				nthreads, gradient));
+	if ((output != NULL) && ((out = fopen(output, "w")) == NULL)) {
+		perror(output);
+		return EXIT_FAILURE;
+	}
+	write_tables(out, values, psts);
+	if (out != stdout)
+		fclose(out);
+	free(slices);
+	free(data.count);
+	free(data.features);
+	free(data.target);
+	free(data.score);
+	return EXIT_SUCCESS;
+}
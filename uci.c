@@ -0,0 +1,421 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "headers/chess.h"
+#include "headers/search.h"
+#include "headers/notation.h"
+#include "headers/book.h"
+#include "headers/tbprobe.h"
+#include "headers/testpos.h"
+#include "headers/timeman.h"
+#include "headers/tt.h"
+
+/*
+ * UCI front-end
+ * Besides the UCI commands this understands:
+ * 	bench [depth] - searches the bench positions with a cleared hash table,
+ * 	                prints nodes, speed and how much of the table is on huge
+ * 	                pages
+ * 	stats - writes the search counters since ucinewgame as JSON (only
+ * 	        when compiled with SEARCH_STATS)
+ * 	d - writes the FEN of the current position
+ * With HashFile set the hash table is mapped from that file: it is loaded
+ * again by the next run with the same Hash size, and ucinewgame keeps it
+ * (ClearHash empties it)
+ */
+
+#define INPUT_LENGTH 8192
+#define PATH_LENGTH 1024
+#define BENCH_DEPTH 5
+
+static struct position_t position;
+static struct search_t search;
+static struct tt_t tt;
+static size_t hash_mb = TT_DEFAULT_MB;
+static char hash_file[PATH_LENGTH] = "";
+static pthread_t search_thread;
+static int searching = 0;
+static int infinite = 0;
+static int maxdepth = MAX_PLY - 1;
+static int own_book = 0;
+static char book_file[PATH_LENGTH] = "";
+static unsigned long long move_overhead = MOVE_OVERHEAD;
+
+/* UCI check options turning off selective search techniques */
+static const struct {
+	const char *name;
+	unsigned flag;
+} prune_options[] = {
+	{ "NullMove", PRUNE_NULL_MOVE },
+	{ "LateMoveReductions", PRUNE_LMR },
+	{ "ReverseFutility", PRUNE_REVERSE_FUTILITY },
+	{ "Futility", PRUNE_FUTILITY },
+	{ "Razoring", PRUNE_RAZORING }
+};
+#define PRUNE_OPTIONS (sizeof(prune_options) / sizeof(prune_options[0]))
+
+static void print_score(signed score)
+{
+	if (score > MATE_SCORE - MAX_PLY)
+		printf("mate %d", (MATE_SCORE - score + 1) / 2);
+	else if (score < -MATE_SCORE + MAX_PLY)
+		printf("mate -%d", (MATE_SCORE + score) / 2);
+	else
+		printf("cp %d", score);
+}
+
+/* Writes one info line per line of a multi-pv search */
+static void report(const struct search_t *searchPtr)
+{
+	char mv[MOVE_STRING_LENGTH];
+	unsigned long long elapsed = get_time_ms() - searchPtr->starttime;
+	const struct pv_line_t *linePtr;
+	for (int i = 0; i < searchPtr->nlines; ++i) {
+		linePtr = &searchPtr->lines[i];
+		printf("info depth %d", searchPtr->depth);
+		if (searchPtr->multipv > 1)
+			printf(" multipv %d", i + 1);
+		printf(" score ");
+		print_score(linePtr->score);
+		printf(" nodes %llu nps %llu time %llu", searchPtr->nodes,
+				(searchPtr->nodes * 1000)
+				/ (elapsed ? elapsed : 1), elapsed);
+		if (linePtr->pvsize)
+			printf(" pv");
+		for (int j = 0; j < linePtr->pvsize; ++j) {
+			move_to_coord(linePtr->pv[j], mv);
+			printf(" %s", mv);
+		}
+		printf("\n");
+	}
+	fflush(stdout);
+}
+
+static void *search_main(void *arg)
+{
+	struct position_t pos = position;
+	char mv[MOVE_STRING_LENGTH];
+	(void)arg;
+	search_position(&search, &pos, maxdepth);
+	/* an infinite search only ends on stop */
+	while (infinite && !search.stop)
+		usleep(1000);
+	if (search.deadline)
+		printf("info string time %llu ms overshoot %llu ms\n",
+				get_time_ms() - search.starttime,
+				search.overshoot);
+#ifdef SEARCH_STATS
+	stats_print_info(stdout, &search.stats);
+#endif
+	move_to_coord(search.bestmove, mv);
+	printf("bestmove %s\n", search.bestmove ? mv : "0000");
+	fflush(stdout);
+	return NULL;
+}
+
+static void stop_search(void)
+{
+	if (!searching)
+		return;
+	search.stop = 1;
+	infinite = 0;
+	pthread_join(search_thread, NULL);
+	searching = 0;
+}
+
+static void set_position(char *args)
+{
+	char *moves;
+	uint16_t mv;
+	if ((moves = strstr(args, "moves")) != NULL)
+		*moves = '\0';
+	if (!strncmp(args, "startpos", 8)) {
+		position = START_POSITION;
+	} else if (!strncmp(args, "fen", 3)) {
+		if (!parse_fen(&position, args + 3)) {
+			printf("info string invalid fen\n");
+			position = START_POSITION;
+		}
+	}
+	if (moves == NULL)
+		return;
+	for (char *tok = strtok(moves + 5, " \t\n"); tok;
+			tok = strtok(NULL, " \t\n")) {
+		if (!(mv = parse_coord(&position, tok))) {
+			printf("info string illegal move %s\n", tok);
+			return;
+		}
+		make_move(&position, mv);
+	}
+}
+
+/* Number of threads clearing the hash table, one per core */
+static int cores(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return (n > 0) ? n : 1;
+}
+
+/*
+ * Maps the hash table from hash_file if it is set, else from memory, falling
+ * back to a table of TT_DEFAULT_MB and then to searching without one
+ */
+static void resize_hash(void)
+{
+	int result;
+	search.tt = &tt;
+	if (*hash_file) {
+		result = tt_map_file(&tt, hash_file, hash_mb, cores());
+		if (result == TT_FILE_LOADED) {
+			printf("info string loaded hash from %s\n", hash_file);
+			return;
+		}
+		if (result == TT_FILE_NEW) {
+			printf("info string created hash file %s\n", hash_file);
+			return;
+		}
+		printf("info string could not map %s\n", hash_file);
+	}
+	if (tt_alloc(&tt, hash_mb, cores())
+			|| tt_alloc(&tt, TT_DEFAULT_MB, cores()))
+		return;
+	printf("info string could not allocate a hash table\n");
+	search.tt = NULL;
+}
+
+/* Returns the number after the current token of strtok(), 0 if there is none */
+static unsigned long long next_value(void)
+{
+	char *tok = strtok(NULL, " \t\n");
+	return tok ? strtoull(tok, NULL, 10) : 0;
+}
+
+static void go(char *args)
+{
+	unsigned long long times[2] = { 0, 0 };
+	unsigned long long incs[2] = { 0, 0 };
+	unsigned long long movetime = 0;
+	int color = (position.flags & WHITE_TO_MOVE) ? WHITE : BLACK;
+	int movestogo = 0;
+	char mv[MOVE_STRING_LENGTH];
+	uint16_t bookmv;
+	maxdepth = MAX_PLY - 1;
+	search.maxnodes = 0;
+	infinite = 0;
+	for (char *tok = strtok(args, " \t\n"); tok;
+			tok = strtok(NULL, " \t\n")) {
+		if (!strcmp(tok, "infinite"))
+			infinite = 1;
+		else if (!strcmp(tok, "depth"))
+			maxdepth = next_value();
+		else if (!strcmp(tok, "nodes"))
+			search.maxnodes = next_value();
+		else if (!strcmp(tok, "movetime"))
+			movetime = next_value();
+		else if (!strcmp(tok, "wtime"))
+			times[WHITE] = next_value();
+		else if (!strcmp(tok, "btime"))
+			times[BLACK] = next_value();
+		else if (!strcmp(tok, "winc"))
+			incs[WHITE] = next_value();
+		else if (!strcmp(tok, "binc"))
+			incs[BLACK] = next_value();
+		else if (!strcmp(tok, "movestogo"))
+			movestogo = next_value();
+	}
+	if ((maxdepth < 1) || (maxdepth >= MAX_PLY))
+		maxdepth = MAX_PLY - 1;
+	if (own_book && !infinite && (bookmv = book_probe(&position, 0))) {
+		move_to_coord(bookmv, mv);
+		printf("bestmove %s\n", mv);
+		fflush(stdout);
+		return;
+	}
+	time_allocate(&search, infinite ? 0 : times[color], incs[color],
+			movestogo, move_overhead);
+	/* a fixed time per move is used in full */
+	if (movetime) {
+		search.softlimit = 0;
+		search.deadline = get_time_ms() + movetime;
+	}
+	search.report = report;
+	search.stop = 0;
+	searching = 1;
+	pthread_create(&search_thread, NULL, search_main, NULL);
+}
+
+static void bench(int depth)
+{
+	struct position_t pos;
+	unsigned long long nodes = 0;
+	unsigned long long start = get_time_ms();
+	unsigned long long elapsed;
+	search.report = NULL;
+	search.maxnodes = 0;
+	time_allocate(&search, 0, 0, 0, 0);
+	tt_clear(&tt, cores());
+	for (int i = 0; i < BENCH_POSITIONS; ++i) {
+		parse_fen(&pos, bench_positions[i]);
+		search.stop = 0;
+		search_position(&search, &pos, depth);
+		printf("Position %d: %llu nodes\n", i + 1, search.nodes);
+		nodes += search.nodes;
+	}
+	elapsed = get_time_ms() - start;
+	printf("Nodes searched: %llu\nTime: %llu ms\nNodes/second: %llu\n",
+			nodes, elapsed, (nodes * 1000) / (elapsed ? elapsed : 1));
+	printf("Hash: %zu MB, %zu MB on %s huge pages\n", tt.size >> 20,
+			tt_huge_bytes(&tt) >> 20,
+			tt.hugetlb ? "reserved" : "transparent");
+#ifdef SEARCH_STATS
+	stats_print_info(stdout, &search.stats);
+	stats_print_json(stdout, &search.stats);
+#endif
+	fflush(stdout);
+}
+
+static void set_option(char *args)
+{
+	char name[PATH_LENGTH];
+	char *value;
+	int n;
+	if (sscanf(args, " name %1023[^\n]", name) != 1)
+		return;
+	if ((value = strstr(name, " value ")) != NULL) {
+		*value = '\0';
+		value += 7;
+	} else {
+		value = "";
+	}
+	for (unsigned i = 0; i < PRUNE_OPTIONS; ++i) {
+		if (strcmp(name, prune_options[i].name))
+			continue;
+		if (!strcmp(value, "true"))
+			search.disabled &= ~prune_options[i].flag;
+		else
+			search.disabled |= prune_options[i].flag;
+		return;
+	}
+	if (!strcmp(name, "Hash")) {
+		hash_mb = strtoull(value, NULL, 10);
+		if ((hash_mb < 1) || (hash_mb > TT_MAX_MB))
+			hash_mb = TT_DEFAULT_MB;
+		resize_hash();
+	} else if (!strcmp(name, "HashFile")) {
+		strncpy(hash_file, strcmp(value, "<empty>") ? value : "",
+				PATH_LENGTH - 1);
+		resize_hash();
+	} else if (!strcmp(name, "SaveHash")) {
+		tt_sync(&tt);
+	} else if (!strcmp(name, "ClearHash")) {
+		tt_clear(&tt, cores());
+	} else if (!strcmp(name, "SyzygyPath")) {
+		n = tb_init(strcmp(value, "<empty>") ? value : NULL);
+		tb_probe_limit = tb_largest;
+		printf("info string found %d tablebases\n", n);
+	} else if (!strcmp(name, "MultiPV")) {
+		search.multipv = atoi(value);
+		if (search.multipv < 1)
+			search.multipv = 1;
+		else if (search.multipv > MAX_MULTIPV)
+			search.multipv = MAX_MULTIPV;
+	} else if (!strcmp(name, "MoveOverhead")) {
+		move_overhead = strtoull(value, NULL, 10);
+	} else if (!strcmp(name, "SyzygyProbeLimit")) {
+		tb_probe_limit = atoi(value);
+	} else if (!strcmp(name, "OwnBook")) {
+		own_book = !strcmp(value, "true");
+		book_open(own_book ? book_file : NULL);
+	} else if (!strcmp(name, "BookFile")) {
+		strncpy(book_file, value, PATH_LENGTH - 1);
+		if (own_book && !book_open(book_file))
+			printf("info string could not open %s\n", book_file);
+	}
+}
+
+int main(void)
+{
+	char line[INPUT_LENGTH];
+	char fen[FEN_LENGTH];
+	char *args;
+	position = START_POSITION;
+	resize_hash();
+#ifdef SEARCH_STATS
+	stats_clear(&search.stats);
+#endif
+	while (fgets(line, sizeof(line), stdin)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		args = line + strcspn(line, " ");
+		if (*args)
+			*args++ = '\0';
+		if (!strcmp(line, "uci")) {
+			printf("id name chess-engine\nid author ManiacalMichael\n");
+			printf("option name SyzygyPath type string default "
+					"<empty>\n");
+			printf("option name SyzygyProbeLimit type spin default "
+					"%d min 0 max %d\n", TB_MAX_PIECES,
+					TB_MAX_PIECES);
+			printf("option name Hash type spin default %d min 1 "
+					"max %d\n", TT_DEFAULT_MB, TT_MAX_MB);
+			printf("option name HashFile type string default "
+					"<empty>\n");
+			printf("option name SaveHash type button\n");
+			printf("option name ClearHash type button\n");
+			printf("option name MultiPV type spin default 1 min 1 "
+					"max %d\n", MAX_MULTIPV);
+			printf("option name MoveOverhead type spin default %d "
+					"min 0 max 5000\n", MOVE_OVERHEAD);
+			for (unsigned i = 0; i < PRUNE_OPTIONS; ++i)
+				printf("option name %s type check default "
+						"true\n", prune_options[i].name);
+			printf("option name OwnBook type check default false\n");
+			printf("option name BookFile type string default "
+					"<empty>\n");
+			printf("uciok\n");
+		} else if (!strcmp(line, "isready")) {
+			printf("readyok\n");
+		} else if (!strcmp(line, "ucinewgame")) {
+			stop_search();
+			position = START_POSITION;
+			/* a table from a file is kept for the analysis to go on */
+			if (tt.header == NULL)
+				tt_clear(&tt, cores());
+#ifdef SEARCH_STATS
+			stats_clear(&search.stats);
+#endif
+		} else if (!strcmp(line, "position")) {
+			stop_search();
+			set_position(args);
+		} else if (!strcmp(line, "go")) {
+			stop_search();
+			go(args);
+		} else if (!strcmp(line, "stop")) {
+			stop_search();
+		} else if (!strcmp(line, "setoption")) {
+			stop_search();
+			set_option(args);
+		} else if (!strcmp(line, "bench")) {
+			stop_search();
+			bench(*args ? atoi(args) : BENCH_DEPTH);
+		} else if (!strcmp(line, "stats")) {
+#ifdef SEARCH_STATS
+			stats_print_json(stdout, &search.stats);
+#else
+			printf("info string compiled without SEARCH_STATS\n");
+#endif
+		} else if (!strcmp(line, "d")) {
+			write_fen(&position, fen);
+			printf("%s\n", fen);
+		} else if (!strcmp(line, "quit")) {
+			break;
+		}
+		fflush(stdout);
+	}
+	stop_search();
+	tb_free();
+	book_close();
+	tt_free(&tt);
+	return 0;
+}